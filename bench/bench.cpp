@@ -0,0 +1,372 @@
+// Benchmark suite for the resize methods. Every method runs at every scale on
+// synthetic gradients, noise and hard edges of several sizes and channel
+// counts, with a warmup and a number of timed repeats. Results go to stdout
+// as a table and, with --json, to a file a later run can be compared against
+// with --baseline.
+//
+// The inputs are generated from fixed seeds, so two runs on the same machine
+// time the same work.
+
+#include "AIS_cubic.hpp"
+#include "IMDDT.hpp"
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+#include "bilinear.hpp"
+#include "cpu.hpp"
+#include "kernels.hpp"
+#include "resize.hpp"
+#include <algorithm>
+#include <argagg/argagg.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define DOCTEST_CONFIG_IMPLEMENT
+#include <doctest\doctest.h>
+
+namespace {
+	enum class Pattern { gradient, noise, edges };
+
+	const char* pattern_name(Pattern pattern) {
+		switch(pattern) {
+			case Pattern::gradient: return "gradient";
+			case Pattern::noise: return "noise";
+			case Pattern::edges: return "edges";
+			default: return "unknown";
+		}
+	}
+
+	Image synthetic(Pattern           pattern,
+	                const Dimensions& dimensions,
+	                unsigned int      channels) {
+		Image                              image(dimensions, channels);
+		std::mt19937                       rng(1);
+		std::uniform_int_distribution<int> noise(0, 255);
+		for(unsigned int y = 0; y < dimensions.height; ++y) {
+			uint8_t* row = image.row(y);
+			for(unsigned int x = 0; x < dimensions.width; ++x) {
+				for(unsigned int channel = 0; channel < channels; ++channel) {
+					int value = 0;
+					switch(pattern) {
+						case Pattern::gradient:
+							value = (x + y + 64 * channel) * 255 /
+							        (dimensions.width + dimensions.height);
+							break;
+						case Pattern::noise: value = noise(rng); break;
+						case Pattern::edges:
+							// Checkerboard of 16 pixel squares with a diagonal through it
+							value = ((x / 16 + y / 16) % 2 == 0) != (x > y) ? 230 : 25;
+							break;
+						default: break;
+					}
+					row[x * channels + channel] = value;
+				}
+			}
+		}
+		return image;
+	}
+
+	// Something to time: the engine for a method, or its reference version
+	struct Subject final {
+		std::string                               name;
+		Method                                    method;
+		bool                                      doublesOnly;
+		std::function<Image(const Image&, float)> run;
+	};
+
+	std::vector<Subject> subjects(bool references) {
+		auto engine = [](Method method) {
+			return [method](const Image& src, float scale) {
+				return resize(method, src, scale);
+			};
+		};
+		auto target = [](const Image& src, float scale) {
+			return target_dimensions(Method::bilinear, src.dimensions(), scale);
+		};
+
+		std::vector<Subject> list = {
+		  {"bilinear", Method::bilinear, false, engine(Method::bilinear)},
+		  {"bicubic", Method::bicubic, false, engine(Method::bicubic)},
+		  {"lanczos3", Method::lanczos3, false, engine(Method::lanczos3)},
+		  {"IMDDT", Method::IMDDT, false, engine(Method::IMDDT)},
+		  {"AIS", Method::AIS, false, engine(Method::AIS)}};
+		if(references) {
+			list.push_back({"bilinear_reference",
+			                Method::bilinear,
+			                false,
+			                [target](const Image& src, float scale) {
+				                return bilinear_reference(src, target(src, scale));
+			                }});
+			list.push_back({"IMDDT_reference",
+			                Method::IMDDT,
+			                false,
+			                [target](const Image& src, float scale) {
+				                return IMDDT_reference(src, target(src, scale));
+			                }});
+			list.push_back({"AIS_reference",
+			                Method::AIS,
+			                true,
+			                [](const Image& src, float) {
+				                return AIS_cubic_reference(src);
+			                }});
+			// The engine with each stage over the whole image in turn, which
+			// streams it through memory once per stage instead of once per tile
+			list.push_back({"AIS_untiled",
+			                Method::AIS,
+			                true,
+			                [](const Image& src, float) {
+				                const Dimensions doubled =
+				                  target_dimensions(Method::AIS, src.dimensions(), 2);
+				                Image dst(doubled, src.channels(), Image::Init::none);
+				                AIS_cubic(ImageView(src),
+				                          MutableImageView(dst),
+				                          AisBorder::mirror,
+				                          doubled.height);
+				                return dst;
+			                }});
+		}
+		return list;
+	}
+
+	struct Timing final {
+		double min;
+		double p50;
+		double p90;
+		double p99;
+	};
+
+	// Nearest-rank percentiles over the repeats, after one untimed warmup run
+	Timing time_repeats(const std::function<void()>& function, int repeats) {
+		function();
+		std::vector<double> times;
+		for(int i = 0; i < repeats; ++i) {
+			const auto start = std::chrono::steady_clock::now();
+			function();
+			const auto end = std::chrono::steady_clock::now();
+			times.push_back(
+			  std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		std::sort(times.begin(), times.end());
+		auto percentile = [&](double p) {
+			const std::size_t rank = std::ceil(p / 100 * times.size());
+			return times[std::max<std::size_t>(rank, 1) - 1];
+		};
+		return {times.front(), percentile(50), percentile(90), percentile(99)};
+	}
+
+	struct Result final {
+		std::string name;
+		double      megapixels; // output pixels
+		Timing      timing;
+	};
+
+	std::vector<unsigned int> parse_list(const std::string& list) {
+		std::vector<unsigned int> values;
+		std::stringstream         ss(list);
+		std::string               item;
+		while(std::getline(ss, item, ',')) { values.push_back(std::stoul(item)); }
+		return values;
+	}
+
+	std::vector<Dimensions> parse_sizes(const std::string& list) {
+		std::vector<Dimensions> sizes;
+		std::stringstream       ss(list);
+		std::string             item;
+		while(std::getline(ss, item, ',')) {
+			const std::size_t x = item.find('x');
+			if(x == std::string::npos) {
+				throw std::runtime_error("size " + item + " is not WIDTHxHEIGHT\n");
+			}
+			sizes.emplace_back(std::stoul(item.substr(0, x)),
+			                   std::stoul(item.substr(x + 1)));
+		}
+		return sizes;
+	}
+
+	void write_json(const std::string&         filename,
+	                const std::vector<Result>& results,
+	                SimdLevel                  simd,
+	                int                        repeats) {
+		std::ofstream out(filename);
+		if(!out) {
+			throw std::runtime_error("cannot write file " + filename + "\n");
+		}
+		out << std::setprecision(6) << "{\n"
+		    << "  \"simd\": \"" << simd_name(simd) << "\",\n"
+		    << "  \"threads\": " << ThreadPool::global().size() << ",\n"
+		    << "  \"repeats\": " << repeats << ",\n"
+		    << "  \"results\": [\n";
+		// One result per line, which keeps the file diffable and lets
+		// read_baseline get by without a JSON parser
+		for(std::size_t i = 0; i < results.size(); ++i) {
+			const Result& result = results[i];
+			out << "    {\"name\": \"" << result.name << "\", "
+			    << "\"mpix_per_s\": "
+			    << result.megapixels / (result.timing.p50 / 1000) << ", "
+			    << "\"min_ms\": " << result.timing.min << ", "
+			    << "\"p50_ms\": " << result.timing.p50 << ", "
+			    << "\"p90_ms\": " << result.timing.p90 << ", "
+			    << "\"p99_ms\": " << result.timing.p99 << "}"
+			    << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+	// Median times by name from a file write_json produced
+	std::map<std::string, double> read_baseline(const std::string& filename) {
+		std::ifstream in(filename);
+		if(!in) { throw std::runtime_error("cannot open file " + filename + "\n"); }
+
+		std::map<std::string, double> medians;
+		std::string                   line;
+		const std::string             name_key = "\"name\": \"";
+		const std::string             p50_key  = "\"p50_ms\": ";
+		while(std::getline(in, line)) {
+			const std::size_t name = line.find(name_key);
+			const std::size_t p50  = line.find(p50_key);
+			if(name == std::string::npos || p50 == std::string::npos) { continue; }
+			const std::size_t first = name + name_key.size();
+			medians[line.substr(first, line.find('"', first) - first)] =
+			  std::stod(line.substr(p50 + p50_key.size()));
+		}
+		return medians;
+	}
+} // namespace
+
+int main(int argc, char* argv[]) {
+	try {
+		argagg::parser parser{
+		  {{"help", {"-h", "--help"}, "produce help message", 0},
+		   {"sizes",
+		    {"--sizes"},
+		    "source sizes (default: 640x480,1920x1080)",
+		    1},
+		   {"channels", {"--channels"}, "channel counts (default: 1,3,4)", 1},
+		   {"scales", {"--scales"}, "scale factors (default: 0.5,2)", 1},
+		   {"repeats", {"-r", "--repeats"}, "timed runs per case (default: 7)", 1},
+		   {"threads",
+		    {"-t", "--threads"},
+		    "number of threads (default: one per core)",
+		    1},
+		   {"simd",
+		    {"--simd"},
+		    "instruction set (auto, scalar, sse4.1, avx2, avx512)",
+		    1},
+		   {"reference",
+		    {"--reference"},
+		    "also time the per-pixel reference versions, and AIS untiled",
+		    0},
+		   {"json", {"--json"}, "write the results to this file", 1},
+		   {"baseline",
+		    {"--baseline"},
+		    "compare against the results of an earlier --json run",
+		    1},
+		   {"tolerance",
+		    {"--tolerance"},
+		    "median slowdown over the baseline that counts as a regression "
+		    "(default: 0.1)",
+		    1}}};
+		const argagg::parser_results args = parser.parse(argc, argv);
+		if(args["help"]) {
+			argagg::fmt_ostream fmt(std::cout);
+			fmt << parser;
+			return EXIT_SUCCESS;
+		}
+
+		const auto sizes =
+		  parse_sizes(args["sizes"].as<std::string>("640x480,1920x1080"));
+		const auto channel_counts =
+		  parse_list(args["channels"].as<std::string>("1,3,4"));
+		std::vector<float> scales;
+		{
+			std::stringstream ss(args["scales"].as<std::string>("0.5,2"));
+			std::string       item;
+			while(std::getline(ss, item, ',')) { scales.push_back(std::stof(item)); }
+		}
+		const int repeats = std::max(1, args["repeats"].as<int>(7));
+		if(args["threads"]) {
+			ThreadPool::set_global_threads(args["threads"].as<unsigned int>());
+		}
+		const SimdLevel simd = args["simd"] ?
+		                         parse_simd(args["simd"].as<std::string>()) :
+		                         detect_simd();
+		select_kernels(simd);
+
+		std::vector<Result> results;
+		std::cout << std::fixed << std::setprecision(2);
+		for(const Subject& subject : subjects(args["reference"].count() > 0)) {
+			for(const Dimensions& size : sizes) {
+				for(unsigned int channels : channel_counts) {
+					for(Pattern pattern :
+					    {Pattern::gradient, Pattern::noise, Pattern::edges}) {
+						const Image src = synthetic(pattern, size, channels);
+						for(float scale : scales) {
+							// The reference AIS only doubles, so it runs once whatever
+							// the scales
+							const bool doubles = subject.doublesOnly;
+							if(doubles && scale != scales.front()) { continue; }
+
+							std::stringstream name;
+							name << subject.name << "/" << pattern_name(pattern) << "/"
+							     << size.width << "x" << size.height << "x" << channels;
+							if(!doubles) { name << "/" << scale << "x"; }
+
+							const Dimensions target =
+							  target_dimensions(subject.method, size, doubles ? 2 : scale);
+							const Timing timing = time_repeats(
+							  [&] { subject.run(src, scale); }, repeats);
+							const double megapixels =
+							  target.width * (target.height / 1e6);
+							results.push_back({name.str(), megapixels, timing});
+
+							std::cout << std::left << std::setw(44) << name.str()
+							          << std::right << std::setw(10)
+							          << megapixels / (timing.p50 / 1000) << " Mpix/s"
+							          << "  p50 " << std::setw(9) << timing.p50
+							          << " ms  p90 " << std::setw(9) << timing.p90
+							          << " ms  p99 " << std::setw(9) << timing.p99
+							          << " ms\n";
+						}
+					}
+				}
+			}
+		}
+
+		if(args["json"]) {
+			write_json(args["json"].as<std::string>(), results, simd, repeats);
+		}
+
+		if(args["baseline"]) {
+			const auto   baseline = read_baseline(args["baseline"].as<std::string>());
+			const double tolerance = args["tolerance"].as<double>(0.1);
+			int          regressions = 0;
+			for(const Result& result : results) {
+				const auto before = baseline.find(result.name);
+				if(before == baseline.end()) { continue; }
+				const double change = result.timing.p50 / before->second - 1;
+				if(change > tolerance) {
+					std::cout << "regression: " << result.name << " "
+					          << before->second << " -> " << result.timing.p50
+					          << " ms (+" << change * 100 << "%)\n";
+					++regressions;
+				}
+			}
+			if(regressions > 0) { return EXIT_FAILURE; }
+			std::cout << "no regressions against the baseline\n";
+		}
+		return EXIT_SUCCESS;
+	} catch(const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+}
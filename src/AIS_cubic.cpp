@@ -6,24 +6,70 @@
 
 #include "AIS_cubic.hpp"
 #include "Image.hpp"
+#include "ImageT.hpp"
+#include "ThreadPool.hpp"
+#include "kernels.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <gsl\gsl-lite.hpp>
+#include <random>
+#include <vector>
 
 #include <doctest\doctest.h>
 
 using namespace gsl;
 
+namespace {
+#if defined(DEBUG)
+	constexpr bool CHECK_STENCILS = true;
+#else
+	constexpr bool CHECK_STENCILS = false;
+#endif
+
+	// The stencils read unchecked in release builds: their callers solve
+	// pixels of a framed image, which holds every neighbour they reach
+	inline void expect_inside(const Image& image,
+	                          int          first_x,
+	                          int          last_x,
+	                          int          first_y,
+	                          int          last_y) {
+		if constexpr(CHECK_STENCILS) {
+			Expects(first_x >= 0);
+			Expects(last_x < static_cast<long long>(image.dimensions().width));
+			Expects(first_y >= 0);
+			Expects(last_y < static_cast<long long>(image.dimensions().height));
+		}
+	}
+
+	inline int pixel(const Image& image, int x, int y, int channel) {
+		if constexpr(CHECK_STENCILS) { return image.at(x, y, channel); }
+		const std::size_t at = std::size_t{image.dimensions().width} * y + x;
+		return image.data()[at * image.channels() + channel];
+	}
+
+	// The pixel a position past either end of an axis `size` pixels long
+	// takes the place of
+	inline index fold(index position, index size, AisBorder border) {
+		if(border == AisBorder::replicate || size == 1) {
+			return std::clamp<index>(position, 0, size - 1);
+		}
+		// Reflected about the edge pixels, which are not repeated
+		const index period = 2 * (size - 1);
+		position           = std::abs(position) % period;
+		return position < size ? position : period - position;
+	}
+} // namespace
+
 // Stage 1 Strong Edge Detection
 // -----------------------------
 
 int G1_stage1(const Image& dst, int x, int y, int channel) {
-	Expects(x >= 3);
-	Expects(x + 3 < static_cast<long long>(dst.dimensions().width));
-	Expects(y >= 3);
-	Expects(y + 3 < static_cast<long long>(dst.dimensions().height));
+	expect_inside(dst, x - 3, x + 3, y - 3, y + 3);
 
 	auto delta = [&](int dx, int dy) {
-		return abs(dst.at(x + dx, y + dy, channel) -
-		           dst.at(x + dx + 2, y + dy - 2, channel));
+		return abs(pixel(dst, x + dx, y + dy, channel) -
+		           pixel(dst, x + dx + 2, y + dy - 2, channel));
 	};
 
 	int accumulator = 0;
@@ -45,14 +91,11 @@ int G1_stage1(const Image& dst, int x, int y, int channel) {
 }
 
 int G1_stage2(const Image& dst, int x, int y, int channel) {
-	Expects(x >= 2);
-	Expects(x + 2 < static_cast<long long>(dst.dimensions().width));
-	Expects(y >= 2);
-	Expects(y + 2 < static_cast<long long>(dst.dimensions().height));
+	expect_inside(dst, x - 2, x + 2, y - 2, y + 2);
 
 	auto delta = [&](int dx, int dy) {
-		return abs(dst.at(x + dx, y + dy, channel) -
-		           dst.at(x + dx + 2, y + dy, channel));
+		return abs(pixel(dst, x + dx, y + dy, channel) -
+		           pixel(dst, x + dx + 2, y + dy, channel));
 	};
 
 	int accumulator = 0;
@@ -72,14 +115,11 @@ int G1_stage2(const Image& dst, int x, int y, int channel) {
 // -----------------------------
 
 int G2_stage1(const Image& dst, int x, int y, int channel) {
-	Expects(x >= 3);
-	Expects(x + 3 < static_cast<long long>(dst.dimensions().width));
-	Expects(y >= 3);
-	Expects(y + 3 < static_cast<long long>(dst.dimensions().height));
+	expect_inside(dst, x - 3, x + 3, y - 3, y + 3);
 
 	auto delta = [&](int dx, int dy) {
-		return abs(dst.at(x + dx, y + dy, channel) -
-		           dst.at(x + dx + 2, y + dy + 2, channel));
+		return abs(pixel(dst, x + dx, y + dy, channel) -
+		           pixel(dst, x + dx + 2, y + dy + 2, channel));
 	};
 
 	int accumulator = 0;
@@ -101,14 +141,11 @@ int G2_stage1(const Image& dst, int x, int y, int channel) {
 }
 
 int G2_stage2(const Image& dst, int x, int y, int channel) {
-	Expects(x >= 2);
-	Expects(x + 2 < static_cast<long long>(dst.dimensions().width));
-	Expects(y >= 2);
-	Expects(y + 2 < static_cast<long long>(dst.dimensions().height));
+	expect_inside(dst, x - 2, x + 2, y - 2, y + 2);
 
 	auto delta = [&](int dx, int dy) {
-		return abs(dst.at(x + dx, y + dy, channel) -
-		           dst.at(x + dx, y + dy + 2, channel));
+		return abs(pixel(dst, x + dx, y + dy, channel) -
+		           pixel(dst, x + dx, y + dy + 2, channel));
 	};
 
 	int accumulator = 0;
@@ -128,61 +165,69 @@ int G2_stage2(const Image& dst, int x, int y, int channel) {
 // -------------------------------
 
 int RU(const Image& dst, int x, int y, int channel) {
+	expect_inside(dst, x - 3, x + 3, y - 3, y + 3);
+
 	int accumulator = 0;
 
 	for(int q = -1; q <= 3; q += 2) {
-		accumulator +=
-		  abs(dst.at(x - q, y - 1, channel) - dst.at(x - q + 2, y - 3, channel));
+		accumulator += abs(pixel(dst, x - q, y - 1, channel) -
+		                   pixel(dst, x - q + 2, y - 3, channel));
 	}
 	accumulator +=
-	  abs(dst.at(x + 1, y + 1, channel) - dst.at(x + 3, y - 1, channel));
+	  abs(pixel(dst, x + 1, y + 1, channel) - pixel(dst, x + 3, y - 1, channel));
 	accumulator +=
-	  abs(dst.at(x + 1, y + 3, channel) - dst.at(x + 3, y + 1, channel));
+	  abs(pixel(dst, x + 1, y + 3, channel) - pixel(dst, x + 3, y + 1, channel));
 
 	return accumulator;
 }
 
 int RD(const Image& dst, int x, int y, int channel) {
+	expect_inside(dst, x - 3, x + 3, y - 3, y + 3);
+
 	int accumulator = 0;
 
 	for(int q = -1; q <= 3; q += 2) {
-		accumulator +=
-		  abs(dst.at(x - q, y + 1, channel) - dst.at(x - q + 2, y + 3, channel));
+		accumulator += abs(pixel(dst, x - q, y + 1, channel) -
+		                   pixel(dst, x - q + 2, y + 3, channel));
 	}
 	accumulator +=
-	  abs(dst.at(x + 1, y - 1, channel) - dst.at(x + 3, y + 1, channel));
+	  abs(pixel(dst, x + 1, y - 1, channel) - pixel(dst, x + 3, y + 1, channel));
 	accumulator +=
-	  abs(dst.at(x + 1, y - 3, channel) - dst.at(x + 3, y - 1, channel));
+	  abs(pixel(dst, x + 1, y - 3, channel) - pixel(dst, x + 3, y - 1, channel));
 
 	return accumulator;
 }
 
 int LU(const Image& dst, int x, int y, int channel) {
+	expect_inside(dst, x - 3, x + 3, y - 3, y + 3);
+
 	int accumulator = 0;
 
 	for(int q = -1; q <= 3; q += 2) {
-		accumulator +=
-		  abs(dst.at(x - q, y - 3, channel) - dst.at(x - q + 2, y - 1, channel));
+		accumulator += abs(pixel(dst, x - q, y - 3, channel) -
+		                   pixel(dst, x - q + 2, y - 1, channel));
 	}
 	accumulator +=
-	  abs(dst.at(x - 3, y - 1, channel) - dst.at(x - 1, y + 1, channel));
+	  abs(pixel(dst, x - 3, y - 1, channel) - pixel(dst, x - 1, y + 1, channel));
 	accumulator +=
-	  abs(dst.at(x - 3, y + 1, channel) - dst.at(x - 1, y + 3, channel));
+	  abs(pixel(dst, x - 3, y + 1, channel) - pixel(dst, x - 1, y + 3, channel));
 
 	return accumulator;
 }
 
 int LD(const Image& dst, int x, int y, int channel) {
+	expect_inside(dst, x - 3, x + 3, y - 3, y + 3);
+
 	int accumulator = 0;
 
 	for(int q = -1; q <= 3; q += 2) {
-		accumulator +=
-		  abs(dst.at(x - q, y + 3, channel) - dst.at(x - q + 2, y + 1, channel));
+		accumulator += abs(pixel(dst, x - q, y + 3, channel) -
+		                   pixel(dst, x - q + 2, y + 1, channel));
 	}
 	accumulator +=
-	  abs(dst.at(x - 3, y + 1, channel) - dst.at(x - 1, y - 1, channel));
+	  abs(pixel(dst, x - 3, y + 1, channel) - pixel(dst, x - 1, y - 1, channel));
 	accumulator +=
-	  abs(dst.at(x - 3, y - 1, channel) - dst.at(x - 1, y - 3, channel));
+	  abs(pixel(dst, x - 3, y - 1, channel) - pixel(dst, x - 1, y - 3, channel));
 
 	return accumulator;
 }
@@ -191,14 +236,11 @@ int LD(const Image& dst, int x, int y, int channel) {
 // -------------------------------
 
 int R(const Image& dst, int x, int y, int channel) {
-	Expects(x >= 1);
-	Expects(x + 3 < static_cast<long long>(dst.dimensions().width));
-	Expects(y >= 2);
-	Expects(y + 2 < static_cast<long long>(dst.dimensions().height));
+	expect_inside(dst, x - 1, x + 3, y - 2, y + 2);
 
 	auto delta = [&](int dx, int dy) {
-		return abs(dst.at(x + dx, y + dy, channel) -
-		           dst.at(x + dx + 2, y + dy, channel));
+		return abs(pixel(dst, x + dx, y + dy, channel) -
+		           pixel(dst, x + dx + 2, y + dy, channel));
 	};
 
 	int accumulator = 0;
@@ -213,14 +255,11 @@ int R(const Image& dst, int x, int y, int channel) {
 }
 
 int D(const Image& dst, int x, int y, int channel) {
-	Expects(x >= 2);
-	Expects(x + 2 < static_cast<long long>(dst.dimensions().width));
-	Expects(y >= 1);
-	Expects(y + 3 < static_cast<long long>(dst.dimensions().height));
+	expect_inside(dst, x - 2, x + 2, y - 1, y + 3);
 
 	auto delta = [&](int dx, int dy) {
-		return abs(dst.at(x + dx, y + dy, channel) -
-		           dst.at(x + dx, y + dy + 2, channel));
+		return abs(pixel(dst, x + dx, y + dy, channel) -
+		           pixel(dst, x + dx, y + dy + 2, channel));
 	};
 
 	int accumulator = 0;
@@ -235,14 +274,11 @@ int D(const Image& dst, int x, int y, int channel) {
 }
 
 int L(const Image& dst, int x, int y, int channel) {
-	Expects(x >= 3);
-	Expects(x + 1 < static_cast<long long>(dst.dimensions().width));
-	Expects(y >= 2);
-	Expects(y + 2 < static_cast<long long>(dst.dimensions().height));
+	expect_inside(dst, x - 3, x + 1, y - 2, y + 2);
 
 	auto delta = [&](int dx, int dy) {
-		return abs(dst.at(x + dx, y + dy, channel) -
-		           dst.at(x + dx + 2, y + dy, channel));
+		return abs(pixel(dst, x + dx, y + dy, channel) -
+		           pixel(dst, x + dx + 2, y + dy, channel));
 	};
 
 	int accumulator = 0;
@@ -257,14 +293,11 @@ int L(const Image& dst, int x, int y, int channel) {
 }
 
 int U(const Image& dst, int x, int y, int channel) {
-	Expects(x >= 2);
-	Expects(x + 2 < static_cast<long long>(dst.dimensions().width));
-	Expects(y >= 3);
-	Expects(y + 1 < static_cast<long long>(dst.dimensions().height));
+	expect_inside(dst, x - 2, x + 2, y - 3, y + 1);
 
 	auto delta = [&](int dx, int dy) {
-		return abs(dst.at(x + dx, y + dy, channel) -
-		           dst.at(x + dx, y + dy + 2, channel));
+		return abs(pixel(dst, x + dx, y + dy, channel) -
+		           pixel(dst, x + dx, y + dy + 2, channel));
 	};
 
 	int accumulator = 0;
@@ -281,148 +314,749 @@ int U(const Image& dst, int x, int y, int channel) {
 // Solvers
 // -------
 
+namespace {
+	const int threshold = 100;
+
+	// Cubic convolution through four pixels along a strong edge
+	double
+	cubic(double pixel_1, double pixel_2, double pixel_3, double pixel_4) {
+		return -(1.0 / 16.0) * pixel_1 + (9.0 / 16.0) * pixel_2 +
+		       (9.0 / 16.0) * pixel_3 - (1.0 / 16.0) * pixel_4;
+	}
+
+	// Average of four neighbours, each weighted by the inverse of the gradient
+	// on its side
+	double inverse_gradient_average(int    gradient_1,
+	                                int    gradient_2,
+	                                int    gradient_3,
+	                                int    gradient_4,
+	                                double pixel_1,
+	                                double pixel_2,
+	                                double pixel_3,
+	                                double pixel_4) {
+		double       weight_1   = 0.25 / (gradient_1 + 1);
+		double       weight_2   = 0.25 / (gradient_2 + 1);
+		double       weight_3   = 0.25 / (gradient_3 + 1);
+		double       weight_4   = 0.25 / (gradient_4 + 1);
+		const double weight_sum = weight_1 + weight_2 + weight_3 + weight_4;
+		return (weight_1 / weight_sum) * pixel_1 +
+		       (weight_2 / weight_sum) * pixel_2 +
+		       (weight_3 / weight_sum) * pixel_3 +
+		       (weight_4 / weight_sum) * pixel_4;
+	}
+
+	uint8_t saturate(double result) {
+		if(result > 255) {
+			return 255;
+		} else if(result < 0) {
+			return 0;
+		} else {
+			return result;
+		}
+	}
+} // namespace
+
 uint8_t solve_interior_stage1(const Image& dst, int x, int y, int channel) {
 	int gradient_1 = G1_stage1(dst, x, y, channel);
 	int gradient_2 = G2_stage1(dst, x, y, channel);
 
-	double    result    = 0;
-	const int threshold = 100;
 	if(gradient_1 - gradient_2 > threshold) {
 		// Edge in the -45deg direction
-		result = -(1.0 / 16.0) * dst.at(x - 3, y - 3, channel) +
-		         (9.0 / 16.0) * dst.at(x - 1, y - 1, channel) +
-		         (9.0 / 16.0) * dst.at(x + 1, y + 1, channel) -
-		         (1.0 / 16.0) * dst.at(x + 3, y + 3, channel);
+		return saturate(cubic(pixel(dst, x - 3, y - 3, channel),
+		                      pixel(dst, x - 1, y - 1, channel),
+		                      pixel(dst, x + 1, y + 1, channel),
+		                      pixel(dst, x + 3, y + 3, channel)));
 	} else if(gradient_2 - gradient_1 > threshold) {
 		// Edge in the +45deg direction
-		result = -(1.0 / 16.0) * dst.at(x - 3, y + 3, channel) +
-		         (9.0 / 16.0) * dst.at(x - 1, y + 1, channel) +
-		         (9.0 / 16.0) * dst.at(x + 1, y - 1, channel) -
-		         (1.0 / 16.0) * dst.at(x + 3, y - 3, channel);
-	} else {
-		// Non-strong edge
-		int gradient__left_up    = LU(dst, x, y, channel);
-		int gradient__right_up   = RU(dst, x, y, channel);
-		int gradient__left_down  = LD(dst, x, y, channel);
-		int gradient__right_down = RD(dst, x, y, channel);
-
-		double       weight_1   = 0.25 / (gradient__left_up + 1);
-		double       weight_2   = 0.25 / (gradient__right_up + 1);
-		double       weight_3   = 0.25 / (gradient__left_down + 1);
-		double       weight_4   = 0.25 / (gradient__right_down + 1);
-		const double weight_sum = weight_1 + weight_2 + weight_3 + weight_4;
-		result = (weight_1 / weight_sum) * dst.at(x - 1, y - 1, channel) +
-		         (weight_2 / weight_sum) * dst.at(x + 1, y - 1, channel) +
-		         (weight_3 / weight_sum) * dst.at(x - 1, y + 1, channel) +
-		         (weight_4 / weight_sum) * dst.at(x + 1, y + 1, channel);
-	}
-	if(result > 255) {
-		return 255;
-	} else if(result < 0) {
-		return 0;
-	} else {
-		return result;
+		return saturate(cubic(pixel(dst, x - 3, y + 3, channel),
+		                      pixel(dst, x - 1, y + 1, channel),
+		                      pixel(dst, x + 1, y - 1, channel),
+		                      pixel(dst, x + 3, y - 3, channel)));
 	}
+
+	// Non-strong edge
+	return saturate(inverse_gradient_average(LU(dst, x, y, channel),
+	                                         RU(dst, x, y, channel),
+	                                         LD(dst, x, y, channel),
+	                                         RD(dst, x, y, channel),
+	                                         pixel(dst, x - 1, y - 1, channel),
+	                                         pixel(dst, x + 1, y - 1, channel),
+	                                         pixel(dst, x - 1, y + 1, channel),
+	                                         pixel(dst, x + 1, y + 1, channel)));
 }
 
 uint8_t solve_interior_stage2(const Image& dst, int x, int y, int channel) {
 	int gradient_1 = G1_stage2(dst, x, y, channel);
 	int gradient_2 = G2_stage2(dst, x, y, channel);
 
-	double    result    = 0;
-	const int threshold = 100;
 	if(gradient_1 - gradient_2 > threshold) {
 		// Edge in the -45deg direction
-		result = -(1.0 / 16.0) * dst.at(x - 3, y, channel) +
-		         (9.0 / 16.0) * dst.at(x - 1, y, channel) +
-		         (9.0 / 16.0) * dst.at(x + 1, y, channel) -
-		         (1.0 / 16.0) * dst.at(x + 3, y, channel);
+		return saturate(cubic(pixel(dst, x - 3, y, channel),
+		                      pixel(dst, x - 1, y, channel),
+		                      pixel(dst, x + 1, y, channel),
+		                      pixel(dst, x + 3, y, channel)));
 	} else if(gradient_2 - gradient_1 > threshold) {
 		// Edge in the +45deg direction
-		result = -(1.0 / 16.0) * dst.at(x, y + 3, channel) +
-		         (9.0 / 16.0) * dst.at(x, y + 1, channel) +
-		         (9.0 / 16.0) * dst.at(x, y - 1, channel) -
-		         (1.0 / 16.0) * dst.at(x, y - 3, channel);
-	} else {
-		// Non-strong edge
-		int gradient_left  = L(dst, x, y, channel);
-		int gradient_right = R(dst, x, y, channel);
-		int gradient_up    = U(dst, x, y, channel);
-		int gradient_down  = D(dst, x, y, channel);
-
-		double       weight_1   = 0.25 / (gradient_left + 1);
-		double       weight_2   = 0.25 / (gradient_right + 1);
-		double       weight_3   = 0.25 / (gradient_up + 1);
-		double       weight_4   = 0.25 / (gradient_down + 1);
-		const double weight_sum = weight_1 + weight_2 + weight_3 + weight_4;
-		result = (weight_1 / weight_sum) * dst.at(x - 1, y, channel) +
-		         (weight_2 / weight_sum) * dst.at(x + 1, y, channel) +
-		         (weight_3 / weight_sum) * dst.at(x, y - 1, channel) +
-		         (weight_4 / weight_sum) * dst.at(x, y + 1, channel);
-	}
-	if(result > 255) {
-		return 255;
-	} else if(result < 0) {
-		return 0;
-	} else {
-		return result;
+		return saturate(cubic(pixel(dst, x, y + 3, channel),
+		                      pixel(dst, x, y + 1, channel),
+		                      pixel(dst, x, y - 1, channel),
+		                      pixel(dst, x, y - 3, channel)));
 	}
+
+	// Non-strong edge
+	return saturate(inverse_gradient_average(L(dst, x, y, channel),
+	                                         R(dst, x, y, channel),
+	                                         U(dst, x, y, channel),
+	                                         D(dst, x, y, channel),
+	                                         pixel(dst, x - 1, y, channel),
+	                                         pixel(dst, x + 1, y, channel),
+	                                         pixel(dst, x, y - 1, channel),
+	                                         pixel(dst, x, y + 1, channel)));
 }
 
-// Public Interfaces
-// -----------------
+// Absolute Difference Planes
+// --------------------------
+// Every gradient above is a sum of absolute differences between two pixels
+// two apart in one direction, and neighbouring pixels share most of them.
+// AIS_cubic therefore computes each difference once per stage, into a plane
+// indexed by the first pixel of the pair. A stage only reads one pixel in
+// two on each row, so the plane packs those together: row y holds
+// x = y % 2, y % 2 + 2, ... The entries a row of solved pixels needs from one
+// stencil position then sit next to each other, and the solvers add them up
+// a whole row at a time.
+
+namespace {
+	// plane(x, y) = |dst(x, y) - dst(x + dx, y + dy)| on the lattice a stage
+	// reads: even x and y (stage 1) or even x + y (stage 2), over the rows of
+	// plane's window
+	template<unsigned int Channels>
+	void fill_difference_plane(ImageT<const uint8_t, Channels> dst,
+	                           ImageT<uint8_t, Channels>       plane,
+	                           int                             dx,
+	                           int                             dy,
+	                           bool                            even_rows_only) {
+		const index width    = dst.dimensions().width;
+		const index channels = dst.channels();
+		const index last_x   = width - dx;
+		const index first_y  = std::max<index>(plane.first_row(),
+		                                       dst.first_row() + std::max(0, -dy));
+		const index last_y   = std::min<index>(plane.end_row(),
+		                                       dst.end_row() - std::max(0, dy));
+		const index offset   = dx * channels;
+
+		parallel_for(first_y, last_y, [&](index band_first, index band_last) {
+			for(index y = band_first; y < band_last; ++y) {
+				if(even_rows_only && y % 2 != 0) { continue; }
+				const uint8_t* near = dst.row(y);
+				const uint8_t* far  = dst.row(y + dy);
+				uint8_t*       out  = plane.row(y);
+				for(index x = y % 2; x < last_x; x += 2) {
+					for(index c = 0; c < channels; ++c) {
+						const index i            = x * channels + c;
+						out[x / 2 * channels + c] = std::abs(near[i] - far[i + offset]);
+					}
+				}
+			}
+		});
+	}
 
-Image AIS_cubic(const Image& src) {
-	// Create a new image that's twice the size of the original
-	// minus the last column and row
-	const unsigned int width  = src.dimensions().width * 2 - 1;
-	const unsigned int height = src.dimensions().height * 2 - 1;
-	Image              dst({width, height}, src.channels());
+	// The packed plane entries of pixels (x + dx, y + dy), (x + dx + 2, y + dy)
+	// and so on, for a row of pixels solved from x on
+	template<unsigned int Channels>
+	struct PlaneRow final {
+		ImageT<const uint8_t, Channels> plane;
+		index                           x;
+		index                           y;
+
+		inline const uint8_t* operator()(int dx, int dy) const {
+			const index row = y + dy;
+			return plane.row(row) + (x + dx - row % 2) / 2 * plane.channels();
+		}
+	};
 
-	// Copy pixels from the source to the destination
-	for(index x = 0; x < width; x += 2) {
-		for(index y = 0; y < height; y += 2) {
-			for(index channel = 0; channel < dst.channels(); ++channel) {
-				dst.set(x, y, src.at(x / 2, y / 2, channel), channel);
-			}
+	// sum[i] = entries[0][i] + entries[1][i] + ...
+	template<std::size_t Terms>
+	void add_entries(int16_t*    sum,
+	                 std::size_t count,
+	                 const uint8_t* const (&entries)[Terms]) {
+		for(std::size_t i = 0; i < count; ++i) {
+			int total = 0;
+			for(std::size_t k = 0; k < Terms; ++k) { total += entries[k][i]; }
+			sum[i] = total;
 		}
 	}
 
-	// Fill the interior pixels
-	for(index x = 3; x < width - 3; x += 2) {
-		for(index y = 3; y < height - 3; y += 2) {
-			for(index channel = 0; channel < dst.channels(); ++channel) {
-				// Find the value with solve_interior
-				uint8_t value = solve_interior_stage1(dst, x, y, channel);
-				dst.set(x, y, value, channel);
-			}
+	// Copies pixels (x, y), (x + 2, y) and so on into consecutive lanes
+	template<unsigned int Channels>
+	void gather_pixels(uint8_t*                        lanes,
+	                   ImageT<const uint8_t, Channels> image,
+	                   index                           x,
+	                   index                           y,
+	                   std::size_t                     count) {
+		const index    channels = image.channels();
+		const uint8_t* pixels   = image.row(y) + x * channels;
+		for(std::size_t i = 0; i < count; i += channels) {
+			for(index c = 0; c < channels; ++c) { lanes[i + c] = pixels[2 * i + c]; }
 		}
 	}
 
-	// Fill the aligned pixels
-	// NOTE: The paper only says to flip the interpolation window 45deg
-	//       for stage 2 and is otherwise completely ambiguous. I made
-	//       a guess as to how this should work, but it might not be what
-	//       the authors intended.
-	for(index x = 4; x < width - 3; x += 2) {
-		for(index y = 3; y < height - 3; y += 2) {
-			for(index channel = 0; channel < dst.channels(); ++channel) {
-				uint8_t value = solve_interior_stage2(dst, x, y, channel);
-				dst.set(x, y, value, channel);
+	// The reverse of gather_pixels
+	template<unsigned int Channels>
+	void scatter_pixels(ImageT<uint8_t, Channels> image,
+	                    index                     x,
+	                    index                     y,
+	                    const uint8_t*            lanes,
+	                    std::size_t               count) {
+		const index channels = image.channels();
+		uint8_t*    pixels   = image.row(y) + x * channels;
+		for(std::size_t i = 0; i < count; i += channels) {
+			for(index c = 0; c < channels; ++c) { pixels[2 * i + c] = lanes[i + c]; }
+		}
+	}
+
+	// Kernel inputs for one row, one entry per interleaved channel value of
+	// the pixels the row solves. Gathering them first keeps the per-pixel
+	// edge decision out of the loops and lets the kernels vectorize it.
+	struct Lanes final {
+		std::vector<int16_t> gradient_1;
+		std::vector<int16_t> gradient_2;
+		std::vector<int16_t> smoothness[4];
+		std::vector<uint8_t> line_a[4];
+		std::vector<uint8_t> line_b[4];
+		std::vector<uint8_t> result;
+
+		Lanes() : gradient_1(), gradient_2(), result() {}
+
+		// Grows the lanes to hold any row of a destination `width` pixels wide
+		void fit(unsigned int width, unsigned int channels) {
+			const std::size_t count = (std::size_t{width} / 2 + 1) * channels;
+			if(result.size() >= count) { return; }
+			gradient_1.resize(count);
+			gradient_2.resize(count);
+			result.resize(count);
+			for(int k = 0; k < 4; ++k) {
+				smoothness[k].resize(count);
+				line_a[k].resize(count);
+				line_b[k].resize(count);
 			}
 		}
+
+		// Fills line_a with the pixels (x + step * slope_a_x, y + step *
+		// slope_a_y) for step = -3, -1, 1, 3, and line_b likewise
+		template<unsigned int Channels>
+		void gather_lines(ImageT<const uint8_t, Channels> dst,
+		                  index                           x,
+		                  index                           y,
+		                  int                             slope_a_x,
+		                  int                             slope_a_y,
+		                  int                             slope_b_x,
+		                  int                             slope_b_y,
+		                  std::size_t                     count) {
+			for(int k = 0; k < 4; ++k) {
+				const int step = 2 * k - 3;
+				gather_pixels(line_a[k].data(),
+				              dst,
+				              x + step * slope_a_x,
+				              y + step * slope_a_y,
+				              count);
+				gather_pixels(line_b[k].data(),
+				              dst,
+				              x + step * slope_b_x,
+				              y + step * slope_b_y,
+				              count);
+			}
+		}
+
+		// near[k] are the inner pixels of the two lines, in the given order
+		AisSpan span(int near_1, int near_2, int near_3, int near_4) const {
+			auto inner = [this](int pixel) {
+				return pixel < 2 ? line_a[pixel + 1].data() : line_b[pixel - 1].data();
+			};
+			AisSpan span;
+			for(int k = 0; k < 4; ++k) {
+				span.line_a[k]     = line_a[k].data();
+				span.line_b[k]     = line_b[k].data();
+				span.smoothness[k] = smoothness[k].data();
+			}
+			span.near[0]    = inner(near_1);
+			span.near[1]    = inner(near_2);
+			span.near[2]    = inner(near_3);
+			span.near[3]    = inner(near_4);
+			span.gradient_1 = gradient_1.data();
+			span.gradient_2 = gradient_2.data();
+			return span;
+		}
+	};
+
+	// The lanes of the calling thread, kept from one tile to the next
+	Lanes& thread_lanes(unsigned int width, unsigned int channels) {
+		thread_local Lanes lanes;
+		lanes.fit(width, channels);
+		return lanes;
+	}
+
+	// Tallies the branch each lane of a row takes, for --stats
+	void count_edges(const Lanes& lanes, std::size_t count) {
+		if(!stats_enabled()) { return; }
+		std::uint64_t strong_a = 0;
+		std::uint64_t strong_b = 0;
+		for(std::size_t i = 0; i < count; ++i) {
+			const int difference = lanes.gradient_1[i] - lanes.gradient_2[i];
+			strong_a += difference > AIS_THRESHOLD;
+			strong_b += difference < -AIS_THRESHOLD;
+		}
+		::count(Counter::ais_strong_a, strong_a);
+		::count(Counter::ais_strong_b, strong_b);
+		::count(Counter::ais_weak, count - strong_a - strong_b);
+	}
+
+	// Interleaved values of the pixels from x up to end, in steps of 2
+	std::size_t row_lanes(index x, index end, unsigned int channels) {
+		return x < end ? std::size_t(end - x + 1) / 2 * channels : 0;
 	}
-	for(index x = 3; x < width - 3; x += 2) {
-		for(index y = 4; y < height - 3; y += 2) {
-			for(index channel = 0; channel < dst.channels(); ++channel) {
-				uint8_t value = solve_interior_stage2(dst, x, y, channel);
-				dst.set(x, y, value, channel);
+
+	template<unsigned int Channels>
+	void solve_stage1_row(ImageT<uint8_t, Channels>       dst,
+	                      ImageT<const uint8_t, Channels> rising,
+	                      ImageT<const uint8_t, Channels> falling,
+	                      index                           y,
+	                      Lanes&                          lanes) {
+		const index       x = 3;
+		const std::size_t count =
+		  row_lanes(x, dst.dimensions().width - 3, dst.channels());
+		// |p(x, y) - p(x + 2, y - 2)| and |p(x, y) - p(x + 2, y + 2)|
+		const PlaneRow<Channels> up{rising, x, y};
+		const PlaneRow<Channels> down{falling, x, y};
+
+		add_entries(lanes.gradient_1.data(),
+		            count,
+		            {up(-3, -1), up(-3, +1), up(-1, -1), up(-1, +1), up(-1, +3),
+		             up(+1, +1), up(+1, +3)});
+		add_entries(lanes.gradient_2.data(),
+		            count,
+		            {down(-3, -1), down(-3, +1), down(-1, -3), down(-1, -1),
+		             down(-1, +1), down(+1, -3), down(+1, -1)});
+
+		// Left up, right up, left down and right down
+		add_entries(lanes.smoothness[0].data(),
+		            count,
+		            {down(+1, -3), down(-1, -3), down(-3, -3), down(-3, -1),
+		             down(-3, +1)});
+		add_entries(
+		  lanes.smoothness[1].data(),
+		  count,
+		  {up(+1, -1), up(-1, -1), up(-3, -1), up(+1, +1), up(+1, +3)});
+		add_entries(
+		  lanes.smoothness[2].data(),
+		  count,
+		  {up(+1, +3), up(-1, +3), up(-3, +3), up(-3, +1), up(-3, -1)});
+		add_entries(lanes.smoothness[3].data(),
+		            count,
+		            {down(+1, +1), down(-1, +1), down(-3, +1), down(+1, -1),
+		             down(+1, -3)});
+
+		// Edges in the -45deg and +45deg directions. Left up is the inner
+		// pixel of the first line before the centre, and so on.
+		count_edges(lanes, count);
+		lanes.gather_lines<Channels>(dst, x, y, 1, 1, 1, -1, count);
+		kernels().ais_row(lanes.span(0, 3, 2, 1), lanes.result.data(), count);
+		scatter_pixels(dst, x, y, lanes.result.data(), count);
+	}
+
+	// The pixels of row y in columns [first_x, end_x) that stage 2 solves
+	template<unsigned int Channels>
+	void solve_stage2_row(ImageT<uint8_t, Channels>       dst,
+	                      ImageT<const uint8_t, Channels> horizontal,
+	                      ImageT<const uint8_t, Channels> vertical,
+	                      index                           y,
+	                      index                           first_x,
+	                      index                           end_x,
+	                      Lanes&                          lanes) {
+		const index       x     = first_x + (first_x + y + 1) % 2;
+		const std::size_t count = row_lanes(x, end_x, dst.channels());
+		const PlaneRow<Channels> h{horizontal, x, y}; // |p(x, y) - p(x + 2, y)|
+		const PlaneRow<Channels> v{vertical, x, y};   // |p(x, y) - p(x, y + 2)|
+
+		add_entries(lanes.gradient_1.data(),
+		            count,
+		            {h(-1, -2), h(-2, -1), h(+0, -1), h(-1, +0), h(-2, +1),
+		             h(+0, +1), h(-1, +2)});
+		add_entries(lanes.gradient_2.data(),
+		            count,
+		            {v(-2, -1), v(-1, -2), v(-1, +0), v(+0, -1), v(+1, -2),
+		             v(+1, +0), v(+2, -1)});
+
+		// Left, right, up and down
+		add_entries(lanes.smoothness[0].data(),
+		            count,
+		            {h(-1, -2), h(-2, -1), h(-3, +0), h(-2, +1), h(-1, +2)});
+		add_entries(lanes.smoothness[1].data(),
+		            count,
+		            {h(-1, -2), h(+0, -1), h(+1, +0), h(+0, +1), h(-1, +2)});
+		add_entries(lanes.smoothness[2].data(),
+		            count,
+		            {v(-2, -1), v(-1, -2), v(+0, -3), v(+1, -2), v(+2, -1)});
+		add_entries(lanes.smoothness[3].data(),
+		            count,
+		            {v(-2, -1), v(-1, +0), v(+0, +1), v(+1, +0), v(+2, -1)});
+
+		// Horizontal and vertical edges, the vertical one running upwards
+		count_edges(lanes, count);
+		lanes.gather_lines<Channels>(dst, x, y, 1, 0, 0, -1, count);
+		kernels().ais_row(lanes.span(0, 1, 3, 2), lanes.result.data(), count);
+		scatter_pixels(dst, x, y, lanes.result.data(), count);
+	}
+
+	// Bytes of framed rows, difference planes and output a tile of AIS keeps
+	// in flight between its steps: a share of a typical L2 cache
+	constexpr std::size_t AIS_TILE_BYTES = std::size_t{1} << 20;
+
+	// The most such bytes a pass over every row at once may hold, so that it
+	// stays in a typical last-level cache. Tiling such an image buys little
+	// over what its extra steps cost: 640x480x3 doubled in 121.6 ms tiled and
+	// in 106.8 ms as one tile.
+	constexpr std::size_t AIS_UNTILED_BYTES = std::size_t{16} << 20;
+
+	// Output rows per tile of `rows` with framed rows of `stride` values: all
+	// of them when they fit AIS_UNTILED_BYTES, else as many as fit
+	// AIS_TILE_BYTES, each row holding about its framed row, its two plane rows
+	// (half as wide) and its output row, but enough to share out among the
+	// pool's threads
+	unsigned int fitting_tile_rows(std::size_t stride, unsigned int rows) {
+		const std::size_t row_bytes = 3 * stride;
+		if(row_bytes * (rows + 2 * AIS_HALO) <= AIS_UNTILED_BYTES) {
+			return rows;
+		}
+		const std::size_t fitting = AIS_TILE_BYTES / row_bytes;
+		return std::max<std::size_t>(
+		  {fitting, 8, std::size_t{4} * ThreadPool::global().size()});
+	}
+
+	template<unsigned int Channels>
+	void AIS_cubic_rows(ImageT<const uint8_t, Channels> src,
+	                    ImageT<uint8_t, Channels>       dst,
+	                    AisBorder                       border,
+	                    unsigned int                    tile_rows) {
+		const unsigned int width     = dst.dimensions().width;
+		const unsigned int height    = dst.dimensions().height;
+		const unsigned int channels  = dst.channels();
+		const unsigned int first_row = dst.first_row();
+		const unsigned int end_row   = dst.end_row();
+
+		// AIS works on the output framed by AIS_HALO ghost pixels, an even
+		// number so that the source keeps to even positions. Output row y is
+		// row y + frame of it, which has all the rows dst's stencils reach.
+		const index        frame = AIS_HALO;
+		const Dimensions   framed_size(width + 2 * frame, height + 2 * frame);
+		const unsigned int end_framed = end_row + 2 * frame;
+		const std::size_t  stride = std::size_t{framed_size.width} * channels;
+
+		// Only the framed rows of a tile and the 2 * frame below it that its
+		// steps reach are held at once, in a buffer that rolls down the image.
+		// It has room for a second tile, so that the rows the next tile still
+		// reads are moved back to its start only every other tile.
+		const unsigned int tile =
+		  std::min(tile_rows > 0 ? tile_rows :
+		                           fitting_tile_rows(stride, end_row - first_row),
+		           std::max(1u, end_row - first_row));
+		const unsigned int buffer_rows =
+		  std::min(2 * (tile + AIS_HALO), end_framed - first_row);
+		PooledBuffer framed_data =
+		  BufferPool::global().acquire(stride * buffer_rows);
+		ImageT<uint8_t, Channels> framed(framed_data.data(),
+		                                 framed_size,
+		                                 channels,
+		                                 stride,
+		                                 first_row,
+		                                 first_row + buffer_rows);
+
+		// Copy pixels from the source to the framed image, and past its edges
+		// into the frame. Rows src does not have repeat its nearest: at a window
+		// end that is not an image edge, they are among the inexact ones.
+		const index       source_width  = src.dimensions().width;
+		const index       source_height = src.dimensions().height;
+		const index       last_column   = source_width - 1;
+		const index       last_x        = frame + 2 * last_column;
+		const std::size_t row_size      = std::size_t(source_width) * channels;
+		auto              copy_source   = [&](index from, index to) {
+			StageTimer timer(Stage::ais_copy, (to - from) * stride / 4);
+			parallel_for(from, to, [&](index first, index last) {
+				// Source row `row` lands on the even framed row 2 * row + frame
+				const index first_source = (first + 1) / 2 - frame / 2;
+				const index end_source   = (last + 1) / 2 - frame / 2;
+				for(index row = first_source; row < end_source; ++row) {
+					const index y        = 2 * row + frame;
+					const index source_y =
+					  std::clamp<index>(fold(row, source_height, border),
+					                    src.first_row(),
+					                    src.end_row() - 1);
+					const uint8_t* pixels = src.row(source_y);
+					scatter_pixels(framed, frame, y, pixels, row_size);
+					for(index k = 1; k <= frame / 2; ++k) {
+						const index left  = fold(-k, source_width, border);
+						const index right = fold(last_column + k, source_width, border);
+						std::copy_n(pixels + left * channels,
+						            channels,
+						            &framed.at(frame - 2 * k, y, 0));
+						std::copy_n(pixels + right * channels,
+						            channels,
+						            &framed.at(last_x + 2 * k, y, 0));
+					}
+				}
+			});
+		};
+
+		// Each stage takes its absolute differences from a pair of planes that
+		// hold only the rows one tile of it reads
+		const unsigned int plane_rows = tile + 2 * frame;
+
+		const Dimensions  packed((framed_size.width + 1) / 2, framed_size.height);
+		const std::size_t packed_stride = std::size_t{packed.width} * channels;
+		Image             storage_1({packed.width, plane_rows}, channels);
+		Image             storage_2({packed.width, plane_rows}, channels);
+		auto              plane = [&](Image& storage, index from, index to) {
+			from = std::clamp<index>(from, first_row, end_framed);
+			to   = std::clamp<index>(to, from, end_framed);
+			Expects(to - from <= plane_rows);
+			return ImageT<uint8_t, Channels>(
+			  storage.data(), packed, channels, packed_stride, from, to);
+		};
+
+		// The interior pixels of odd rows [from, to)
+		const unsigned int first_interior_row = (first_row + 3) | 1;
+		const unsigned int end_interior_row   = end_framed - 2;
+		auto        solve_stage1       = [&](index from, index to) {
+			StageTimer timer(Stage::ais_stage1, (to - from) * stride / 4);
+
+			// Stage 1 reads only the copied pixels: diagonal differences
+			const auto rising  = plane(storage_1, from - 1, to + 3);
+			const auto falling = plane(storage_2, from - 3, to + 1);
+			fill_difference_plane<Channels>(framed, rising, 2, -2, true);
+			fill_difference_plane<Channels>(framed, falling, 2, 2, true);
+
+			const index first_interior = from | 1;
+			const index interior_rows  = (to - first_interior + 1) / 2;
+			parallel_for(0, interior_rows, [&](index first, index last) {
+				Lanes& lanes = thread_lanes(framed_size.width, channels);
+				for(index i = first; i < last; ++i) {
+					const index y = first_interior + 2 * i;
+					solve_stage1_row<Channels>(framed, rising, falling, y, lanes);
+				}
+			});
+		};
+
+		// The aligned pixels of rows [from, to)
+		// NOTE: The paper only says to flip the interpolation window 45deg
+		//       for stage 2 and is otherwise completely ambiguous. I made
+		//       a guess as to how this should work, but it might not be what
+		//       the authors intended.
+		// Both passes read only the pixels at even x + y (copied or stage 1),
+		// never each other's output, so they share one parallel sweep. Only
+		// dst's own pixels are solved.
+		const index first_x      = frame;
+		const index end_x        = frame + width;
+		auto        solve_stage2 = [&](index from, index to) {
+			StageTimer timer(Stage::ais_stage2, (to - from) * stride / 2);
+
+			// Stage 2 reads copied and stage 1 pixels: horizontal and vertical
+			// differences
+			const auto horizontal = plane(storage_1, from - 2, to + 2);
+			const auto vertical   = plane(storage_2, from - 3, to + 1);
+			fill_difference_plane<Channels>(framed, horizontal, 2, 0, false);
+			fill_difference_plane<Channels>(framed, vertical, 0, 2, false);
+
+			parallel_for(from, to, [&](index first, index last) {
+				Lanes& lanes = thread_lanes(framed_size.width, channels);
+				for(index y = first; y < last; ++y) {
+					solve_stage2_row<Channels>(
+					  framed, horizontal, vertical, y, first_x, end_x, lanes);
+				}
+			});
+		};
+
+		// dst is the middle of the framed image
+		const std::size_t dst_row_size = std::size_t{width} * channels;
+		auto              copy_out     = [&](index from, index to) {
+			StageTimer timer(Stage::ais_copy, (to - from) * dst_row_size);
+			parallel_for(from, to, [&](index first, index last) {
+				for(index y = first; y < last; ++y) {
+					std::copy_n(
+					  &framed.at(frame, y + frame, 0), dst_row_size, dst.row(y));
+				}
+			});
+		};
+
+		// Tiles of output rows go through every step in turn while their rows
+		// are still in cache. Each step runs ahead of the next by the rows the
+		// next one's stencils reach below a tile: stage 2 reads stage 1 pixels
+		// three rows down, and stage 1 copied pixels three rows further.
+		unsigned int copied = first_row;
+		unsigned int solved = first_interior_row;
+		for(unsigned int from = first_row; from < end_row; from += tile) {
+			const unsigned int to = std::min(from + tile, end_row);
+
+			// Rows above the tile are done with, and those copied below it are
+			// still to be read
+			if(to + 2 * AIS_HALO > framed.end_row()) {
+				uint8_t* const start = framed_data.data();
+				std::copy(start + (from - framed.first_row()) * stride,
+				          start + (copied - framed.first_row()) * stride,
+				          start);
+				framed = ImageT<uint8_t, Channels>(
+				  start,
+				  framed_size,
+				  channels,
+				  stride,
+				  from,
+				  std::min(from + buffer_rows, end_framed));
+			}
+
+			const unsigned int copy_end = to + 2 * AIS_HALO;
+			copy_source(copied, copy_end);
+			copied = copy_end;
+
+			const unsigned int solve_end =
+			  std::min(to + 3 * AIS_HALO / 2, end_interior_row);
+			if(solve_end > solved) {
+				solve_stage1(solved, solve_end);
+				solved = solve_end;
 			}
+
+			solve_stage2(from + frame, to + frame);
+			copy_out(from, to);
 		}
 	}
+} // namespace
+
+// Public Interfaces
+// -----------------
 
-	// TODO: Edge completion
+Image AIS_cubic(const Image& src, AisBorder border) {
+	// Create a new image that's twice the size of the original
+	// minus the last column and row
+	const unsigned int width  = src.dimensions().width * 2 - 1;
+	const unsigned int height = src.dimensions().height * 2 - 1;
+	Image dst({width, height}, src.channels(), Image::Init::none);
+	AIS_cubic(ImageView(src), MutableImageView(dst), border);
+	return dst;
+}
+
+void AIS_cubic(const ImageView&        src,
+               const MutableImageView& dst,
+               AisBorder               border,
+               unsigned int            tile_rows) {
+	Expects(dst.dimensions().width == src.dimensions().width * 2 - 1);
+	Expects(dst.dimensions().height == src.dimensions().height * 2 - 1);
+	Expects(src.full_width() && dst.full_width());
+	dispatch_channels(src, dst, [border, tile_rows](auto in, auto out) {
+		AIS_cubic_rows(in, out, border, tile_rows);
+	});
+}
+
+namespace {
+	// The stencils over all of src, which leave out the three pixels along
+	// each edge that they do not fit around
+	Image AIS_unframed_reference(const Image& src) {
+		// Create a new image that's twice the size of the original
+		// minus the last column and row
+		const unsigned int width  = src.dimensions().width * 2 - 1;
+		const unsigned int height = src.dimensions().height * 2 - 1;
+		Image              dst({width, height}, src.channels());
+		// Each stage only reads pixels written by the stages before it, so the rows
+		// of a stage can be filled in parallel as long as the stages stay ordered.
+		// Row bands are rounded to even boundaries to keep the loop strides intact.
+		auto align_rows = [](index first, index last, index start) {
+			const index begin = std::max(start, first + ((first - start) & 1));
+			return std::make_pair(begin, last);
+		};
+
+		// Copy pixels from the source to the destination
+		parallel_for(0, height, [&](index first_y, index last_y) {
+			const auto rows = align_rows(first_y, last_y, 0);
+			for(index x = 0; x < width; x += 2) {
+				for(index y = rows.first; y < rows.second; y += 2) {
+					for(index channel = 0; channel < dst.channels(); ++channel) {
+						dst.set(x, y, src.at(x / 2, y / 2, channel), channel);
+					}
+				}
+			}
+		});
+
+		// Fill the interior pixels
+		const index last_interior_row = static_cast<index>(height) - 3;
+		parallel_for(3, last_interior_row, [&](index first_y, index last_y) {
+			const auto rows = align_rows(first_y, last_y, 3);
+			for(index x = 3; x < width - 3; x += 2) {
+				for(index y = rows.first; y < rows.second; y += 2) {
+					for(index channel = 0; channel < dst.channels(); ++channel) {
+						// Find the value with solve_interior
+						uint8_t value = solve_interior_stage1(dst, x, y, channel);
+						dst.set(x, y, value, channel);
+					}
+				}
+			}
+		});
+
+		// Fill the aligned pixels
+		// NOTE: The paper only says to flip the interpolation window 45deg
+		//       for stage 2 and is otherwise completely ambiguous. I made
+		//       a guess as to how this should work, but it might not be what
+		//       the authors intended.
+		// Both passes read only the pixels at even x + y (copied or stage 1), never
+		// each other's output, so they share one parallel sweep.
+		parallel_for(3, last_interior_row, [&](index first_y, index last_y) {
+			const auto rows = align_rows(first_y, last_y, 3);
+			for(index x = 4; x < width - 3; x += 2) {
+				for(index y = rows.first; y < rows.second; y += 2) {
+					for(index channel = 0; channel < dst.channels(); ++channel) {
+						uint8_t value = solve_interior_stage2(dst, x, y, channel);
+						dst.set(x, y, value, channel);
+					}
+				}
+			}
+			const auto even_rows = align_rows(first_y, last_y, 4);
+			for(index x = 3; x < width - 3; x += 2) {
+				for(index y = even_rows.first; y < even_rows.second; y += 2) {
+					for(index channel = 0; channel < dst.channels(); ++channel) {
+						uint8_t value = solve_interior_stage2(dst, x, y, channel);
+						dst.set(x, y, value, channel);
+					}
+				}
+			}
+		});
+
+		return dst;
+	}
+} // namespace
+
+Image AIS_cubic_reference(const Image& src, AisBorder border) {
+	// The source framed by half as many ghost pixels as AIS_cubic frames the
+	// output by, doubled, is the output with its frame
+	const unsigned int ghost    = AIS_HALO / 2;
+	const unsigned int width    = src.dimensions().width;
+	const unsigned int height   = src.dimensions().height;
+	const unsigned int channels = src.channels();
+	Image framed({width + 2 * ghost, height + 2 * ghost}, channels);
+	for(index y = -index{ghost}; y < height + ghost; ++y) {
+		const index source_y = fold(y, height, border);
+		for(index x = -index{ghost}; x < width + ghost; ++x) {
+			const index source_x = fold(x, width, border);
+			for(index channel = 0; channel < channels; ++channel) {
+				framed.set(x + ghost,
+				           y + ghost,
+				           src.at(source_x, source_y, channel),
+				           channel);
+			}
+		}
+	}
 
+	const Image doubled = AIS_unframed_reference(framed);
+	Image       dst({2 * width - 1, 2 * height - 1}, channels);
+	for(index y = 0; y < 2 * height - 1; ++y) {
+		std::copy_n(doubled.row(y + AIS_HALO) + AIS_HALO * channels,
+		            (2 * width - 1) * channels,
+		            dst.row(y));
+	}
 	return dst;
 }
 
@@ -444,3 +1078,134 @@ TEST_CASE("Gradients are computed correctly") {
 	SUBCASE("U") { CHECK(U(src, 3, 3, 0) == 100); }
 	SUBCASE("D") { CHECK(D(src, 3, 3, 0) == 100); }
 }
+
+TEST_CASE("Difference planes match the stencils") {
+	std::mt19937                       rng(11);
+	std::uniform_int_distribution<int> value(0, 255);
+
+	Image src({13, 11}, 3);
+	for(index y = 0; y < 11; ++y) {
+		for(index x = 0; x < 13; ++x) {
+			// Smooth ramps with noise, so both the strong and weak edge paths run
+			for(index channel = 0; channel < 3; ++channel) {
+				const int noise = channel == 0 ? value(rng) : value(rng) / 16;
+				src.set(x, y, (x * 9 + y * 4 + noise) % 256, channel);
+			}
+		}
+	}
+
+	// Whichever kernels run, every level of every pixel
+	const Image planes    = AIS_cubic(src);
+	const Image reference = AIS_cubic_reference(src);
+	CHECK(std::equal(planes.data(),
+	                 planes.data() + planes.size(),
+	                 reference.data(),
+	                 reference.data() + reference.size()));
+}
+
+TEST_CASE("AIS completes the edges from a ghost border") {
+	// A flat image stays flat up to its edges, whichever way it is extended
+	Image flat({6, 5}, 3);
+	for(index y = 0; y < 5; ++y) {
+		for(index x = 0; x < 6; ++x) {
+			for(index channel = 0; channel < 3; ++channel) {
+				flat.set(x, y, 90 + channel, channel);
+			}
+		}
+	}
+	for(AisBorder border : {AisBorder::replicate, AisBorder::mirror}) {
+		const Image doubled = AIS_cubic(flat, border);
+		bool        kept    = true;
+		for(index y = 0; y < 9; ++y) {
+			for(index x = 0; x < 11 * 3; ++x) {
+				kept = kept && doubled.row(y)[x] == 90 + x % 3;
+			}
+		}
+		CHECK(kept);
+	}
+
+	// The border only reaches the pixels whose stencils reach past the edge
+	std::mt19937                       rng(5);
+	std::uniform_int_distribution<int> value(0, 255);
+	Image                              noise({13, 11}, 1);
+	for(index y = 0; y < 11; ++y) {
+		for(index x = 0; x < 13; ++x) { noise.set(x, y, value(rng), 0); }
+	}
+	const Image replicated = AIS_cubic(noise, AisBorder::replicate);
+	const Image mirrored   = AIS_cubic(noise, AisBorder::mirror);
+	bool        inside     = true;
+	bool        edges      = false;
+	for(index y = 0; y < 21; ++y) {
+		for(index x = 0; x < 25; ++x) {
+			const bool same = replicated.at(x, y, 0) == mirrored.at(x, y, 0);
+			if(x > AIS_HALO && x < 24 - AIS_HALO && y > AIS_HALO &&
+			   y < 20 - AIS_HALO) {
+				inside = inside && same;
+			} else {
+				edges = edges || !same;
+			}
+		}
+	}
+	CHECK(inside);
+	CHECK(edges);
+
+	const Image reference = AIS_cubic_reference(noise, AisBorder::replicate);
+	CHECK(std::equal(replicated.data(),
+	                 replicated.data() + replicated.size(),
+	                 reference.data(),
+	                 reference.data() + reference.size()));
+}
+
+TEST_CASE("AIS tiles match running each stage over the whole image") {
+	std::mt19937                       rng(23);
+	std::uniform_int_distribution<int> value(0, 255);
+
+	for(unsigned int channels : {1u, 3u, 4u}) {
+		Image src({23, 19}, channels);
+		std::generate_n(src.data(), src.size(), [&] { return value(rng); });
+		const Dimensions  target(45, 37);
+		const std::size_t stride = std::size_t{45} * channels;
+
+		// Output rows [first, end), from the source rows they need
+		auto render = [&](unsigned int first, unsigned int end, unsigned int rows) {
+			const ImageView in =
+			  ImageView(src).window((first + 1) / 2, (end + 1) / 2);
+			std::vector<uint8_t>   out((end - first) * stride);
+			const MutableImageView dst(
+			  out.data(), target, channels, stride, first, end);
+			AIS_cubic(in, dst, AisBorder::mirror, rows);
+			return out;
+		};
+
+		bool same = true;
+		// Tiles that roll the framed rows along once or many times, by an odd
+		// or even number of rows, against one tile of all of them
+		for(unsigned int rows : {1u, 2u, 3u, 5u, 8u, 13u}) {
+			same = same && render(0, 37, rows) == render(0, 37, 37);
+			same = same && render(9, 26, rows) == render(9, 26, 100);
+			same = same && render(10, 35, rows) == render(10, 35, 100);
+		}
+		CHECK(same);
+	}
+}
+
+TEST_CASE("Stats count every AIS pixel") {
+	auto ais_pixels = [] {
+		return counted(Counter::ais_strong_a) + counted(Counter::ais_strong_b) +
+		       counted(Counter::ais_weak);
+	};
+
+	enable_stats(false);
+	const std::uint64_t before = ais_pixels();
+
+	// 13x9 doubles to 25x17, framed by AIS_HALO to 37x29. Stage 1 solves the
+	// odd rows and columns more than 2 in from the frame's edges, 12 rows of
+	// 16; stage 2 the output's pixels at odd x + y, (25 * 17 - 1) / 2.
+	std::mt19937                       rng(11);
+	std::uniform_int_distribution<int> value(0, 255);
+	Image                              src({13, 9}, 3);
+	std::generate_n(src.data(), src.size(), [&] { return value(rng); });
+	CHECK(AIS_cubic(src).dimensions().width == 25);
+	CHECK(ais_pixels() - before == (12 * 16 + (25 * 17 - 1) / 2) * 3);
+	disable_stats();
+}
@@ -4,9 +4,13 @@
 // paper "New adaptive interpolation scheme for image upscaling"
 // (DOI: 10.1007/s11042-015-2647-9)
 
+#ifndef AIS_CUBIC_H
+#define AIS_CUBIC_H
+
 #include <cstdint>
 
 #include "Image.hpp"
+#include "ImageT.hpp"
 
 int G1_stage1(const Image& src, int i, int j, int channel);
 int G2_stage1(const Image& src, int i, int j, int channel);
@@ -26,4 +30,38 @@ int U(const Image& src, int i, int j, int channel);
 uint8_t solve_interior_stage1(const Image& src, int x, int y, int channel);
 uint8_t solve_interior_stage2(const Image& src, int x, int y, int channel);
 
-Image AIS_cubic(const Image& src);
+// How AIS extends the source past its edges, so that the pixels there are
+// solved by the same stencils as the rest: by repeating the edge pixels, or
+// by reflecting the image about them
+enum class AisBorder { replicate, mirror };
+
+Image AIS_cubic(const Image& src, AisBorder border = AisBorder::mirror);
+
+// Rows an AIS stencil reaches above and below the pixel it solves, over both
+// stages, and columns to either side. AIS works on the output framed by this
+// many ghost pixels.
+constexpr unsigned int AIS_HALO = 6;
+
+// Writes every pixel of dst, which must be 2 * width - 1 by 2 * height - 1
+// pixels for a source of width by height.
+//
+// dst may be a window onto output rows [first, end); src then needs the source
+// rows [(first + 1) / 2, (end + 1) / 2). Only the rows at least AIS_HALO away
+// from a window end that is not also an image edge match the full image.
+// Neither view may leave out columns.
+//
+// Tiles of tile_rows output rows go through every stage before the next tile
+// starts; 0 sizes them to stay in cache, or makes one tile of a dst small
+// enough to stay in cache whole, and the height of dst or more runs each
+// stage over all of it in turn. The output is the same either way.
+void AIS_cubic(const ImageView&        src,
+               const MutableImageView& dst,
+               AisBorder               border    = AisBorder::mirror,
+               unsigned int            tile_rows = 0);
+
+// Per-pixel version built directly on the stencil functions above, kept as
+// the reference for AIS_cubic in tests and benchmarks
+Image AIS_cubic_reference(const Image& src,
+                          AisBorder    border = AisBorder::mirror);
+
+#endif
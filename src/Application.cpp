@@ -1,13 +1,24 @@
 #include "Application.hpp"
 
-#include "AIS_cubic.hpp"
-#include "IMDDT.hpp"
 #include "Image.hpp"
-#include "bilinear.hpp"
+#include "ThreadPool.hpp"
+#include "batch.hpp"
+#include "cache.hpp"
+#include "cpu.hpp"
+#include "kernels.hpp"
+#include "pyramid.hpp"
+#include "resize.hpp"
+#include "server.hpp"
+#include "stats.hpp"
+#include "streaming.hpp"
+#include "video.hpp"
 #include <OpenImageIO/imageio.h>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <utility>
 
@@ -33,12 +44,107 @@ int main(int argc, char* argv[]) {
 Application::Application(int argc, char** argv)
   : m_argParser{{{"help", {"-h", "--help"}, "produce help message", 0},
                  {"input", {"-i", "--input"}, "input file", 1},
-                 {"output", {"-o", "--output"}, "output file", 1},
+                 {"output",
+                  {"-o", "--output"},
+                  "output file (directory with --batch)",
+                  1},
                  {"method",
                   {"-m", "--method"},
-                  "interpolation method (bilinear, IMDDT, AIS)",
+                  "interpolation method (bilinear, bicubic, lanczos3, IMDDT, "
+                  "AIS)",
+                  1},
+                 {"scale", {"-s", "--scale"}, "scale factor", 1},
+                 {"threads",
+                  {"-t", "--threads"},
+                  "number of threads (default: one per core)",
+                  1},
+                 {"simd",
+                  {"--simd"},
+                  "instruction set (auto, scalar, sse4.1, avx2, avx512)",
+                  1},
+                 {"stream",
+                  {"--stream"},
+                  "read and write scanlines a band at a time, for images too "
+                  "large to hold in memory",
+                  0},
+                 {"pyramid",
+                  {"-p", "--pyramid"},
+                  "write several sizes from one decode, a comma-separated "
+                  "list of scales and WIDTHxHEIGHT sizes, each to the output "
+                  "name with _2x or _640x480 before the extension",
+                  1},
+                 {"region",
+                  {"--region"},
+                  "render only this rectangle of the output, as "
+                  "x,y,widthxheight, reading only the source it needs",
+                  1},
+                 {"mip",
+                  {"--mip"},
+                  "write the resized image and its halvings down to 1x1 as "
+                  "the MIP levels of one tiled output file (TIFF, OpenEXR)",
+                  0},
+                 {"batch",
+                  {"-b", "--batch"},
+                  "resize every image of a directory, a glob or a manifest "
+                  "file listing one path per line",
+                  1},
+                 {"decode-threads",
+                  {"--decode-threads"},
+                  "threads decoding batch inputs (default: 1)",
+                  1},
+                 {"resize-threads",
+                  {"--resize-threads"},
+                  "images resized at once in a batch (default: 1)",
+                  1},
+                 {"encode-threads",
+                  {"--encode-threads"},
+                  "threads encoding batch outputs (default: 1)",
+                  1},
+                 {"video",
+                  {"--video"},
+                  "resize a stream of frames, YUV4MPEG2 or raw RGB with "
+                  "--frame-size, from the input file or stdin to the output "
+                  "file or stdout (either may be -)",
+                  0},
+                 {"frame-size",
+                  {"--frame-size"},
+                  "WIDTHxHEIGHT of the frames of a --video stream of raw RGB, "
+                  "which has no header",
+                  1},
+                 {"frames-in-flight",
+                  {"--frames-in-flight"},
+                  "video frames resized at once (default: 4)",
                   1},
-                 {"scale", {"-s", "--scale"}, "scale factor", 1}}} {
+                 {"serve",
+                  {"--serve"},
+                  "stay up running jobs read from stdin, one JSON object per "
+                  "line with input, output, method and scale, and answer "
+                  "each on stdout with its timings",
+                  0},
+                 {"socket",
+                  {"--socket"},
+                  "serve jobs as --serve does to every connection to a Unix "
+                  "domain socket at this path",
+                  1},
+                 {"cache",
+                  {"--cache"},
+                  "reuse results from, and add them to, this "
+                  "content-addressed cache directory",
+                  1},
+                 {"cache-size",
+                  {"--cache-size"},
+                  "megabytes the cache keeps before evicting the least "
+                  "recently used results (default: 1024)",
+                  1},
+                 {"stats",
+                  {"--stats"},
+                  "print time and bytes per stage and AIS edge counts as JSON",
+                  0},
+                 {"trace",
+                  {"--trace"},
+                  "write a Chrome trace of the stages on every thread to this "
+                  "file",
+                  1}}} {
 	m_args = m_argParser.parse(argc, argv);
 }
 
@@ -49,50 +155,178 @@ void Application::run() {
 		return;
 	}
 
+	const bool serving = m_args["serve"] || m_args["socket"];
+
 	// Determine input file
 	std::string inFile;
 	if(m_args["input"]) {
 		inFile = m_args["input"].as<std::string>();
 	} else if(m_args.pos.size() >= 1) {
 		inFile = m_args.as<std::string>(0);
-	} else {
+	} else if(m_args["video"]) {
+		inFile = "-";
+	} else if(!m_args["batch"] && !serving) {
 		std::cerr << "input file needed\nUse -h for help.\n";
 		return;
 	}
 
-	// Determine interpolation method
-	if(!m_args["method"]) {
+	// Determine interpolation method, which jobs served may name instead
+	if(!m_args["method"] && !serving) {
 		std::cerr << "interpolation method needed\nUse -h for help.\n";
 		return;
 	}
-	const std::string method = m_args["method"].as<std::string>();
+	const std::string methodName = m_args["method"].as<std::string>("");
 
 	// Determine scale
 	const float scale = m_args["scale"].as<float>(2.0f);
+	check_scale(scale);
+
+	// Determine thread count
+	if(m_args["threads"]) {
+		ThreadPool::set_global_threads(m_args["threads"].as<unsigned int>());
+	}
+
+	// Determine instruction set
+	if(m_args["simd"]) {
+		select_kernels(parse_simd(m_args["simd"].as<std::string>()));
+	}
+
+	// Determine instrumentation
+	const bool trace = m_args["trace"].count() > 0;
+	if(m_args["stats"] || trace) { enable_stats(trace); }
+
+	// Determine result cache
+	std::unique_ptr<ResultCache> cache;
+	if(m_args["cache"]) {
+		const std::uintmax_t megabytes =
+		  m_args["cache-size"].as<std::uintmax_t>(1024);
+		cache = std::make_unique<ResultCache>(
+		  m_args["cache"].as<std::string>(), megabytes << 20);
+	}
+
+	// Serve jobs
+	if(serving) {
+		const JobDefaults defaults{methodName, scale};
+		if(m_args["socket"]) {
+			serve_socket(m_args["socket"].as<std::string>(), defaults, cache.get());
+		} else {
+			serve(std::cin, std::cout, defaults, cache.get());
+		}
+		report(std::cout);
+		return;
+	}
+	const Method method = parse_method(methodName);
+
+	// Process a batch
+	if(m_args["batch"]) {
+		const BatchOptions options{method,
+		                           scale,
+		                           m_args["output"].as<std::string>(""),
+		                           m_args["decode-threads"].as<unsigned int>(1),
+		                           m_args["resize-threads"].as<unsigned int>(1),
+		                           m_args["encode-threads"].as<unsigned int>(1)};
+		const auto inputs = batch_inputs(m_args["batch"].as<std::string>());
+		const auto failed = run_batch(inputs, options);
+		report(std::cout);
+		if(failed > 0) {
+			std::stringstream ss;
+			ss << failed << " of " << inputs.size() << " files failed\n";
+			throw std::runtime_error(ss.str());
+		}
+		return;
+	}
+
+	// Process a video stream. Its output may be stdout, so everything else
+	// goes to stderr.
+	if(m_args["video"]) {
+		const Dimensions   rawSize = m_args["frame-size"] ?
+		                               parse_frame_size(
+		                                 m_args["frame-size"].as<std::string>()) :
+		                               Dimensions(0, 0);
+		const VideoOptions options{
+		  method,
+		  scale,
+		  rawSize,
+		  m_args["frames-in-flight"].as<unsigned int>(4)};
+		const std::string outFile = m_args["output"].as<std::string>("-");
+		std::ifstream     inStream;
+		std::ofstream     outStream;
+		if(inFile != "-") {
+			inStream.open(inFile, std::ios::binary);
+			if(!inStream) {
+				throw std::runtime_error("cannot open file " + inFile + "\n");
+			}
+		}
+		if(outFile != "-") {
+			outStream.open(outFile, std::ios::binary);
+			if(!outStream) {
+				throw std::runtime_error("cannot write file " + outFile + "\n");
+			}
+		}
+
+		const auto        start  = std::chrono::steady_clock::now();
+		const std::size_t frames = run_video(inFile == "-" ? std::cin : inStream,
+		                                     outFile == "-" ? std::cout : outStream,
+		                                     options);
+		const std::chrono::duration<double> seconds =
+		  std::chrono::steady_clock::now() - start;
+		std::cerr << frames << " frames in " << seconds.count() << " s, "
+		          << frames / seconds.count() << " fps\n";
+		report(outFile == "-" ? std::cerr : std::cout);
+		return;
+	}
 
 	// Determine output file
 	std::stringstream ss;
-	ss << m_args["method"].as<std::string>() << "-" << scale << "x_" << inFile;
+	ss << methodName;
+	if(!m_args["pyramid"]) { ss << "-" << scale << "x"; }
+	ss << "_" << inFile;
 	const std::string outFile = m_args["output"].as<std::string>(ss.str());
 
+	// Answer from the cache. Pyramids, MIP files and regions are many
+	// outputs, formats or parts of their own, and are not cached.
+	const bool  cached =
+	  cache && !m_args["pyramid"] && !m_args["mip"] && !m_args["region"];
+	std::string key;
+	if(cached) {
+		key = cache->key(inFile, method, scale, outFile);
+		if(cache->fetch(key, outFile)) {
+			report(std::cout);
+			return;
+		}
+		replace_output(outFile);
+	}
+
 	// Process image
-	const Image src(inFile);
-	if(method.compare("IMDDT") == 0) {
-		const Image dst =
-		  IMDDT(src,
-		        {static_cast<unsigned int>(src.dimensions().width * scale),
-		         static_cast<unsigned int>(src.dimensions().height * scale)});
-		dst.save(outFile);
-	} else if(method.compare("bilinear") == 0) {
-		const Image dst =
-		  bilinear(src,
-		           {static_cast<unsigned int>(src.dimensions().width * scale),
-		            static_cast<unsigned int>(src.dimensions().height * scale)});
-		dst.save(outFile);
-	} else if(method.compare("AIS") == 0) {
-		const Image dst = AIS_cubic(src);
-		dst.save(outFile);
+	if(m_args["region"]) {
+		const Region region = parse_region(m_args["region"].as<std::string>());
+		resize_region(method, inFile, outFile, scale, region);
+	} else if(m_args["stream"]) {
+		resize_streaming(method, inFile, outFile, scale);
+	} else if(m_args["pyramid"]) {
+		const Image              src(inFile);
+		std::vector<Dimensions>  targets;
+		std::vector<std::string> filenames;
+		for(const auto& level :
+		    parse_pyramid(m_args["pyramid"].as<std::string>())) {
+			targets.push_back(level_dimensions(method, src.dimensions(), level));
+			filenames.push_back(pyramid_output(outFile, level));
+		}
+		save_pyramid(render_pyramid(method, src, targets), filenames);
+	} else if(m_args["mip"]) {
+		const Image      src(inFile);
+		const Dimensions top = target_dimensions(method, src.dimensions(), scale);
+		save_mip(render_pyramid(method, src, mip_dimensions(top)), outFile);
 	} else {
-		std::cerr << "method unrecognized\n";
+		const Image src(inFile);
+		const Image dst = resize(method, src, scale, outFile);
+		dst.save(outFile);
 	}
+	if(cached) { cache->store(key, outFile); }
+	report(std::cout);
+}
+
+void Application::report(std::ostream& statsOut) const {
+	if(m_args["stats"]) { write_stats_json(statsOut); }
+	if(m_args["trace"]) { write_trace(m_args["trace"].as<std::string>()); }
 }
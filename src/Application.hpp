@@ -2,12 +2,16 @@
 #define APPLICATION_H
 
 #include <argagg/argagg.hpp>
+#include <iosfwd>
 
 class Application final {
 	private:
 	argagg::parser_results m_args;
 	argagg::parser         m_argParser;
 
+	// Prints --stats to statsOut and writes --trace, when asked for
+	void report(std::ostream& statsOut) const;
+
 	public:
 	Application(int argc, char* argv[]);
 	void run();
@@ -0,0 +1,68 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// A first-in first-out queue between pipeline stages. push blocks while the
+// queue is full, which holds back the stages before a slow one; pop blocks
+// while it is empty. Once closed, pop drains what is left and then reports the
+// end.
+template<typename T>
+class BoundedQueue final {
+	private:
+	std::deque<T>           m_items;
+	std::size_t             m_capacity;
+	bool                    m_closed;
+	std::mutex              m_mutex;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+
+	public:
+	explicit BoundedQueue(std::size_t capacity)
+	  : m_items()
+	  , m_capacity(capacity > 0 ? capacity : 1)
+	  , m_closed(false)
+	  , m_mutex()
+	  , m_notFull()
+	  , m_notEmpty() {}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	void push(T item) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_notFull.wait(lock, [this] { return m_items.size() < m_capacity; });
+			m_items.push_back(std::move(item));
+		}
+		m_notEmpty.notify_one();
+	}
+
+	// Waits for the next item; false once the queue is closed and empty
+	bool pop(T& item) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+			if(m_items.empty()) { return false; }
+			item = std::move(m_items.front());
+			m_items.pop_front();
+		}
+		m_notFull.notify_one();
+		return true;
+	}
+
+	// No more items will be pushed
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_closed = true;
+		}
+		m_notEmpty.notify_all();
+	}
+};
+
+#endif
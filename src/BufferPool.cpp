@@ -0,0 +1,128 @@
+#include "BufferPool.hpp"
+
+#include "stats.hpp"
+#include <new>
+#include <utility>
+
+#include <doctest\doctest.h>
+
+namespace {
+	// Keeps a batch of 4x upscales of large photos in the pool, not more
+	constexpr std::size_t GLOBAL_LIMIT = std::size_t{1} << 30;
+
+	constexpr std::size_t SMALLEST_CLASS = 4096;
+
+	std::size_t size_class(std::size_t size) {
+		if(size <= SMALLEST_CLASS) { return SMALLEST_CLASS; }
+		std::size_t power = SMALLEST_CLASS;
+		while(power * 2 < size) { power *= 2; }
+		const std::size_t step = power / 8;
+		return (size + step - 1) / step * step;
+	}
+
+	void free_aligned(uint8_t* data) {
+		::operator delete(data, std::align_val_t(BufferPool::ALIGNMENT));
+	}
+} // namespace
+
+PooledBuffer::PooledBuffer()
+  : m_data(nullptr), m_size(0), m_capacity(0), m_pool(nullptr) {}
+
+PooledBuffer::PooledBuffer(uint8_t*    data,
+                           std::size_t size,
+                           std::size_t capacity,
+                           BufferPool* pool)
+  : m_data(data), m_size(size), m_capacity(capacity), m_pool(pool) {}
+
+PooledBuffer::~PooledBuffer() {
+	if(m_data) { m_pool->release(m_data, m_capacity); }
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+  : m_data(std::exchange(other.m_data, nullptr))
+  , m_size(std::exchange(other.m_size, 0))
+  , m_capacity(std::exchange(other.m_capacity, 0))
+  , m_pool(other.m_pool) {}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+	if(this != &other) {
+		if(m_data) { m_pool->release(m_data, m_capacity); }
+		m_data     = std::exchange(other.m_data, nullptr);
+		m_size     = std::exchange(other.m_size, 0);
+		m_capacity = std::exchange(other.m_capacity, 0);
+		m_pool     = other.m_pool;
+	}
+	return *this;
+}
+
+BufferPool::BufferPool(std::size_t limit)
+  : m_free(), m_cached(0), m_limit(limit), m_mutex() {}
+
+BufferPool::~BufferPool() { trim(); }
+
+PooledBuffer BufferPool::acquire(std::size_t size) {
+	if(size == 0) { return PooledBuffer(); }
+
+	const std::size_t capacity = size_class(size);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto                        buffers = m_free.find(capacity);
+		if(buffers != m_free.end() && !buffers->second.empty()) {
+			uint8_t* data = buffers->second.back();
+			buffers->second.pop_back();
+			m_cached -= capacity;
+			count(Counter::pool_reuses, 1);
+			return PooledBuffer(data, size, capacity, this);
+		}
+	}
+
+	count(Counter::pool_allocations, 1);
+	count(Counter::pool_allocated_bytes, capacity);
+	uint8_t* data = static_cast<uint8_t*>(
+	  ::operator new(capacity, std::align_val_t(ALIGNMENT)));
+	return PooledBuffer(data, size, capacity, this);
+}
+
+void BufferPool::release(uint8_t* data, std::size_t capacity) {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_cached + capacity <= m_limit) {
+			m_free[capacity].push_back(data);
+			m_cached += capacity;
+			return;
+		}
+	}
+	free_aligned(data);
+}
+
+void BufferPool::trim() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for(auto& buffers : m_free) {
+		for(uint8_t* data : buffers.second) { free_aligned(data); }
+	}
+	m_free.clear();
+	m_cached = 0;
+}
+
+BufferPool& BufferPool::global() {
+	static BufferPool pool(GLOBAL_LIMIT);
+	return pool;
+}
+
+TEST_CASE("Buffer pool recycles aligned buffers") {
+	BufferPool pool(1 << 20);
+
+	const uint8_t* first = nullptr;
+	{
+		PooledBuffer buffer = pool.acquire(100000);
+		first               = buffer.data();
+		CHECK(buffer.size() == 100000);
+		CHECK(reinterpret_cast<std::uintptr_t>(first) % BufferPool::ALIGNMENT ==
+		      0);
+	}
+
+	// A released buffer serves the next request of its size class
+	PooledBuffer again = pool.acquire(99000);
+	CHECK(again.data() == first);
+	CHECK(pool.acquire(100000).data() != first);
+}
@@ -0,0 +1,72 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+class BufferPool;
+
+// Uninitialized, 64-byte aligned memory from a BufferPool, handed back to it
+// on destruction
+class PooledBuffer final {
+	private:
+	uint8_t*    m_data;
+	std::size_t m_size;
+	std::size_t m_capacity;
+	BufferPool* m_pool;
+
+	public:
+	PooledBuffer();
+	PooledBuffer(uint8_t*    data,
+	             std::size_t size,
+	             std::size_t capacity,
+	             BufferPool* pool);
+	~PooledBuffer();
+
+	PooledBuffer(PooledBuffer&& other) noexcept;
+	PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+	PooledBuffer(const PooledBuffer&) = delete;
+	PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+	inline uint8_t*       data() { return m_data; }
+	inline const uint8_t* data() const { return m_data; }
+	inline std::size_t    size() const { return m_size; }
+};
+
+// Recycles image-sized buffers, so that processing one image after another of
+// similar sizes stops allocating after the first. Sizes are rounded up to
+// classes an eighth of a power of two apart, so a buffer serves any request
+// up to 12.5% smaller. Released buffers are kept up to a byte limit and freed
+// beyond it.
+class BufferPool final {
+	private:
+	std::map<std::size_t, std::vector<uint8_t*>> m_free; // by capacity
+	std::size_t                                  m_cached;
+	std::size_t                                  m_limit;
+	std::mutex                                   m_mutex;
+
+	friend class PooledBuffer;
+	void release(uint8_t* data, std::size_t capacity);
+
+	public:
+	static constexpr std::size_t ALIGNMENT = 64;
+
+	explicit BufferPool(std::size_t limit);
+	~BufferPool();
+
+	BufferPool(const BufferPool&) = delete;
+	BufferPool& operator=(const BufferPool&) = delete;
+
+	PooledBuffer acquire(std::size_t size);
+
+	// Frees every cached buffer
+	void trim();
+
+	// The pool Image allocates from
+	static BufferPool& global();
+};
+
+#endif
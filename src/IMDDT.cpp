@@ -10,8 +10,17 @@
 
 #include "IMDDT.hpp"
 
+#include "ImageT.hpp"
+#include "ThreadPool.hpp"
+#include "kernels.hpp"
+#include "sampling.hpp"
+#include "stats.hpp"
+#include <array>
 #include <cstdint>
+#include <cstdlib>
 #include <gsl\gsl-lite.hpp>
+#include <random>
+#include <utility>
 
 #include <doctest\doctest.h>
 using doctest::Approx;
@@ -23,11 +32,9 @@ constexpr double IMDDT_single(double pixel_1,
                               double pixel_3,
                               double pixel_4,
                               double distance_x,
-                              double distance_y) {
-	const double ascendingDifference  = std::abs(pixel_3 - pixel_2);
-	const double descendingDifference = std::abs(pixel_1 - pixel_4);
-
-	if(ascendingDifference > descendingDifference) {
+                              double distance_y,
+                              bool   ascending) {
+	if(ascending) {
 		if(distance_y > distance_x) {
 			const double weight_1 = 0.5 * (1.0 - distance_y);
 			const double weight_4 = 0.5 * distance_x;
@@ -52,40 +59,342 @@ constexpr double IMDDT_single(double pixel_1,
 	}
 }
 
+constexpr double IMDDT_single(double pixel_1,
+                              double pixel_2,
+                              double pixel_3,
+                              double pixel_4,
+                              double distance_x,
+                              double distance_y) {
+	const double ascendingDifference  = std::abs(pixel_3 - pixel_2);
+	const double descendingDifference = std::abs(pixel_1 - pixel_4);
+	return IMDDT_single(pixel_1,
+	                    pixel_2,
+	                    pixel_3,
+	                    pixel_4,
+	                    distance_x,
+	                    distance_y,
+	                    ascendingDifference > descendingDifference);
+}
+
+namespace {
+	// What picks the diagonal of a cell: luma for colour, otherwise the first
+	// channel, which the alpha of a grey image follows
+	inline int luma(const uint8_t* pixel, unsigned int channels) {
+		if(channels < 3) { return pixel[0]; }
+		return (77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2] + 128) >> 8;
+	}
+
+	// IMDDT_ASCENDING when luma changes more from pixel 2 to pixel 3 than from
+	// pixel 1 to pixel 4, so that the split runs along the edge, otherwise 0
+	inline uint8_t
+	diagonal(int luma_1, int luma_2, int luma_3, int luma_4) {
+		return std::abs(luma_3 - luma_2) > std::abs(luma_1 - luma_4) ?
+		         IMDDT_ASCENDING :
+		         0;
+	}
+
+	// The samples [first, end) of an axis at which a new source cell starts,
+	// relative to first, and into cell_of the index among them of each
+	// sample's cell
+	std::vector<index> cell_starts(const std::vector<AxisSample>& axis,
+	                               index                          first,
+	                               index                          end,
+	                               std::vector<index>&            cell_of) {
+		std::vector<index> starts;
+		cell_of.resize(end - first);
+		for(index i = first; i < end; ++i) {
+			if(starts.empty() || axis[i].first != axis[first + starts.back()].first) {
+				starts.push_back(i - first);
+			}
+			cell_of[i - first] = starts.size() - 1;
+		}
+		return starts;
+	}
+
+	// Where the kernel reads its samples from
+	struct Corners final {
+		uint8_t* pixel_1;
+		uint8_t* pixel_2;
+		uint8_t* pixel_3;
+		uint8_t* pixel_4;
+		uint8_t* geometry;
+	};
+
+	// One channel of the Ratio samples of a source cell, spelled out so that it
+	// needs no loop
+	template<unsigned int Channels, std::size_t Ratio, std::size_t... K>
+	inline void gather_channel(Corners                    out,
+	                           index                      value,
+	                           uint8_t                    pixel_1,
+	                           uint8_t                    pixel_2,
+	                           uint8_t                    pixel_3,
+	                           uint8_t                    pixel_4,
+	                           std::array<uint8_t, Ratio> triangles,
+	                           uint8_t                    diagonal,
+	                           std::index_sequence<K...>) {
+		((out.pixel_1[value + K * Channels]  = pixel_1,
+		  out.pixel_2[value + K * Channels]  = pixel_2,
+		  out.pixel_3[value + K * Channels]  = pixel_3,
+		  out.pixel_4[value + K * Channels]  = pixel_4,
+		  out.geometry[value + K * Channels] = triangles[K] | diagonal),
+		 ...);
+	}
+
+	// Every channel of them. Each is read once, as the writes could alias it.
+	template<unsigned int Channels, std::size_t Ratio, std::size_t... C>
+	inline void gather_cell(Corners                    out,
+	                        index                      value,
+	                        const uint8_t*             upper,
+	                        const uint8_t*             lower,
+	                        std::array<uint8_t, Ratio> triangles,
+	                        uint8_t                    diagonal,
+	                        std::index_sequence<C...>) {
+		(gather_channel<Channels>(out,
+		                          value + C,
+		                          upper[C],
+		                          upper[Channels + C],
+		                          lower[C],
+		                          lower[Channels + C],
+		                          triangles,
+		                          diagonal,
+		                          std::make_index_sequence<Ratio>()),
+		 ...);
+	}
+
+	// Ratio is that of the output width to the source's when it is a whole
+	// number that has a specialisation, or 0
+	template<unsigned int Ratio, unsigned int Channels>
+	void IMDDT_rows(ImageT<const uint8_t, Channels> src,
+	                ImageT<uint8_t, Channels>       dst) {
+		if(dst.values() == 0) { return; }
+
+		const Dimensions&  targetDim = dst.dimensions();
+		const unsigned int channels  = src.channels();
+		const auto columns = sample_axis(src.dimensions().width, targetDim.width);
+		const auto rows = sample_axis(src.dimensions().height, targetDim.height);
+
+		// Only the columns dst has, when it is a window onto a region
+		const index       first_x  = dst.first_column();
+		const index       width    = dst.end_column() - first_x;
+		const std::size_t row_size = std::size_t(width) * channels;
+		Expects(width == 0 || (columns[first_x].first >= src.first_column() &&
+		                       columns[first_x + width - 1].second <
+		                         src.end_column()));
+
+		// Source offsets of both neighbours per output column, and the distance
+		// per interleaved output value
+		std::vector<index>   offset_1(width);
+		std::vector<index>   offset_2(width);
+		std::vector<uint8_t> distance_x(row_size);
+		for(index i = 0; i < width; ++i) {
+			const AxisSample&  column = columns[first_x + i];
+			const unsigned int distance =
+			  fixed_distance(column.distance, IMDDT_BITS);
+			offset_1[i] = (column.first - src.first_column()) * channels;
+			offset_2[i] = (column.second - src.first_column()) * channels;
+			for(index channel = 0; channel < channels; ++channel) {
+				distance_x[i * channels + channel] = distance;
+			}
+		}
+
+		// Only the rows dst has, when it is a window onto a band
+		const index first_row = dst.first_row();
+		const index end_row   = dst.end_row();
+
+		// First the diagonal of every source cell in the rows dst samples,
+		// picked once and shared by all of the cell's samples and channels
+		const Kernels&     simd = kernels();
+		std::vector<index> row_cell;
+		const auto         row_starts =
+		  cell_starts(rows, first_row, end_row, row_cell);
+
+		const index          map_width = src.end_column() - src.first_column();
+		std::vector<uint8_t> diagonals(std::size_t(map_width) * row_starts.size());
+		parallel_for(0, row_starts.size(), [&](index first_cell, index last_cell) {
+			// Luma of the rows above and below the cells, each row once when
+			// cells follow each other. The last cell of the image pairs its
+			// pixels with themselves.
+			std::vector<uint8_t> upper_luma(map_width + 1);
+			std::vector<uint8_t> lower_luma(map_width + 1);
+
+			auto to_luma = [&](index y, std::vector<uint8_t>& out) {
+				const uint8_t* pixels = src.row(y);
+				for(index x = 0; x < map_width; ++x) {
+					out[x] = luma(pixels + x * channels, channels);
+				}
+				out[map_width] = out[map_width - 1];
+			};
+
+			index lower_y = -1;
+			for(index cell_y = first_cell; cell_y < last_cell; ++cell_y) {
+				const AxisSample& row = rows[first_row + row_starts[cell_y]];
+				if(row.first == lower_y) {
+					std::swap(upper_luma, lower_luma);
+				} else {
+					to_luma(row.first, upper_luma);
+				}
+				to_luma(row.second, lower_luma);
+				lower_y = row.second;
+				simd.imddt_diagonals(upper_luma.data(),
+				                     lower_luma.data(),
+				                     diagonals.data() + cell_y * map_width,
+				                     map_width);
+			}
+		});
+
+		// Then every output row from the map
+		const index last_pixel = src.dimensions().width - 1;
+		parallel_for(first_row, end_row, [&](index first_y, index last_y) {
+			std::vector<uint8_t> pixel_1(row_size);
+			std::vector<uint8_t> pixel_2(row_size);
+			std::vector<uint8_t> pixel_3(row_size);
+			std::vector<uint8_t> pixel_4(row_size);
+			std::vector<uint8_t> geometry(row_size);
+
+			for(index pos_dst_y = first_y; pos_dst_y < last_y; ++pos_dst_y) {
+				const AxisSample& row   = rows[pos_dst_y];
+				const uint8_t*    upper = src.row(row.first);
+				const uint8_t*    lower = src.row(row.second);
+				const uint8_t*    cells =
+				  diagonals.data() + row_cell[pos_dst_y - first_row] * map_width;
+
+				// Gather the cell corners and pick each sample's triangle on the
+				// exact distances; the kernel then only does fixed-point arithmetic
+				auto triangle = [&](double distance) -> uint8_t {
+					return (row.distance > distance ? IMDDT_DY_GT_DX : 0) |
+					       (distance + row.distance < 1.0 ? IMDDT_DX_DY_LT_1 : 0);
+				};
+				auto gather = [&](index begin, index end) {
+					for(index i = begin; i < end; ++i) {
+						const index   first  = offset_1[i];
+						const index   second = offset_2[i];
+						const uint8_t triangle_i =
+						  triangle(columns[first_x + i].distance) | cells[first / channels];
+						for(index channel = 0; channel < channels; ++channel) {
+							const index value = i * channels + channel;
+							pixel_1[value]    = upper[first + channel];
+							pixel_2[value]    = upper[second + channel];
+							pixel_3[value]    = lower[first + channel];
+							pixel_4[value]    = lower[second + channel];
+							geometry[value]   = triangle_i;
+						}
+					}
+				};
+
+				if constexpr(Ratio == 0 || Channels == DYNAMIC_CHANNELS) {
+					gather(0, width);
+				} else {
+					// A whole ratio splits each source pixel into the same Ratio
+					// samples, whose triangles are picked once per row. Part of a
+					// pixel at the edge of a region, and the last pixel, go the
+					// general way.
+					std::array<uint8_t, Ratio> triangles;
+					for(unsigned int k = 0; k < Ratio; ++k) {
+						triangles[k] = triangle(columns[k].distance);
+					}
+					const Corners corners = {pixel_1.data(),
+					                         pixel_2.data(),
+					                         pixel_3.data(),
+					                         pixel_4.data(),
+					                         geometry.data()};
+					const index end_cell =
+					  std::min(width - Ratio + 1, last_pixel * Ratio - first_x);
+					index i = (Ratio - first_x % Ratio) % Ratio;
+					gather(0, std::min(i, width));
+					for(; i < end_cell; i += Ratio) {
+						gather_cell<Channels>(corners,
+						                      i * channels,
+						                      upper + offset_1[i],
+						                      lower + offset_1[i],
+						                      triangles,
+						                      cells[offset_1[i] / channels],
+						                      std::make_index_sequence<Channels>());
+					}
+					gather(std::min(i, width), width);
+				}
+
+				const ImddtSpan span = {pixel_1.data(),
+				                        pixel_2.data(),
+				                        pixel_3.data(),
+				                        pixel_4.data(),
+				                        distance_x.data(),
+				                        geometry.data(),
+				                        fixed_distance(row.distance, IMDDT_BITS)};
+				simd.imddt_row(span, dst.row(pos_dst_y), row_size);
+			}
+		});
+	}
+} // namespace
+
 Image IMDDT(const Image& src, const Dimensions& targetDim) {
+	Image dst(targetDim, src.channels(), Image::Init::none);
+	IMDDT(ImageView(src), MutableImageView(dst));
+	return dst;
+}
+
+void IMDDT(const ImageView& src, const MutableImageView& dst) {
+	StageTimer timer(Stage::IMDDT, dst.values());
+	dispatch_channels(src, dst, [](auto in, auto out) {
+		switch(integer_ratio(in.dimensions().width, out.dimensions().width)) {
+			case 2: IMDDT_rows<2>(in, out); break;
+			case 3: IMDDT_rows<3>(in, out); break;
+			case 4: IMDDT_rows<4>(in, out); break;
+			default: IMDDT_rows<0>(in, out); break;
+		}
+	});
+}
+
+Image IMDDT_reference(const Image& src, const Dimensions& targetDim) {
 	Image dst(targetDim, src.channels());
 
-	const double scale_x =
-	  static_cast<double>(src.dimensions().width) / targetDim.width;
-	const double scale_y =
-	  static_cast<double>(src.dimensions().height) / targetDim.height;
+	// Positions as the kernels see them, so that samples on a diagonal pick
+	// the same triangle
+	const auto columns = sample_axis(src.dimensions().width, targetDim.width);
+	const auto rows    = sample_axis(src.dimensions().height, targetDim.height);
 
-	for(index pos_dst_x = 0; pos_dst_x < targetDim.width; ++pos_dst_x) {
-		const index pos_src_x  = scale_x * pos_dst_x;
-		const index distance_x = scale_x * pos_dst_x - pos_src_x;
-		for(index pos_dst_y = 0; pos_dst_y < targetDim.height; ++pos_dst_y) {
-			const index  pos_src_y  = scale_y * pos_dst_y;
-			const double distance_y = scale_y * pos_dst_y - pos_src_y;
+	parallel_for(0, targetDim.height, [&](index first_y, index last_y) {
+		for(index pos_dst_x = 0; pos_dst_x < targetDim.width; ++pos_dst_x) {
+			const index  pos_src_x  = columns[pos_dst_x].first;
+			const double distance_x = columns[pos_dst_x].distance;
+			for(index pos_dst_y = first_y; pos_dst_y < last_y; ++pos_dst_y) {
+				const index  pos_src_y  = rows[pos_dst_y].first;
+				const double distance_y = rows[pos_dst_y].distance;
 
-			for(index channel = 0; channel < src.channels(); ++channel) {
 				const index x_incremented = pos_src_x + 1 >= src.dimensions().width ?
-                                      src.dimensions().width - 1 :
-                                      pos_src_x + 1;
+                                    src.dimensions().width - 1 :
+                                    pos_src_x + 1;
 				const index y_incremented = pos_src_y + 1 >= src.dimensions().height ?
-                                      src.dimensions().height - 1 :
-                                      pos_src_y + 1;
+                                    src.dimensions().height - 1 :
+                                    pos_src_y + 1;
 
-				const uint8_t pixel_1 = src.at(pos_src_x, pos_src_y, channel);
-				const uint8_t pixel_2 = src.at(x_incremented, pos_src_y, channel);
-				const uint8_t pixel_3 = src.at(pos_src_x, y_incremented, channel);
-				const uint8_t pixel_4 = src.at(x_incremented, y_incremented, channel);
+				// One diagonal for every channel of the cell
+				const unsigned int channels = src.channels();
+				const uint8_t*     upper    = src.row(pos_src_y);
+				const uint8_t*     lower    = src.row(y_incremented);
+				const bool         ascending =
+				  diagonal(luma(upper + pos_src_x * channels, channels),
+				           luma(upper + x_incremented * channels, channels),
+				           luma(lower + pos_src_x * channels, channels),
+				           luma(lower + x_incremented * channels, channels)) != 0;
 
-				const uint8_t interpolated = IMDDT_single(
-				  pixel_1, pixel_2, pixel_3, pixel_4, distance_x, distance_y);
-				dst.set(pos_dst_x, pos_dst_y, interpolated, channel);
+				for(index channel = 0; channel < channels; ++channel) {
+					const uint8_t pixel_1 = src.at(pos_src_x, pos_src_y, channel);
+					const uint8_t pixel_2 = src.at(x_incremented, pos_src_y, channel);
+					const uint8_t pixel_3 = src.at(pos_src_x, y_incremented, channel);
+					const uint8_t pixel_4 = src.at(x_incremented, y_incremented, channel);
+
+					const uint8_t interpolated = IMDDT_single(pixel_1,
+					                                          pixel_2,
+					                                          pixel_3,
+					                                          pixel_4,
+					                                          distance_x,
+					                                          distance_y,
+					                                          ascending);
+					dst.set(pos_dst_x, pos_dst_y, interpolated, channel);
+				}
 			}
 		}
-	}
+	});
 	return dst;
 }
 
@@ -103,3 +412,72 @@ TEST_CASE("IMDDT_single returns expected results") {
 		CHECK(IMDDT_single(0, 30, 60, 255, 0.9, 0.3) == Approx(166.5));
 	}
 }
+
+TEST_CASE("Fixed-point IMDDT stays within one level of the reference") {
+	std::mt19937                       rng(11);
+	std::uniform_int_distribution<int> value(0, 255);
+
+	Image src({19, 13}, 3);
+	for(index y = 0; y < 13; ++y) {
+		for(index x = 0; x < 19; ++x) {
+			for(index channel = 0; channel < 3; ++channel) {
+				src.set(x, y, value(rng), channel);
+			}
+		}
+	}
+
+	auto within_one = [&](const Dimensions& targetDim) {
+		const Image fast      = IMDDT(src, targetDim);
+		const Image reference = IMDDT_reference(src, targetDim);
+		for(index y = 0; y < targetDim.height; ++y) {
+			for(index x = 0; x < targetDim.width; ++x) {
+				for(index channel = 0; channel < 3; ++channel) {
+					const int difference =
+					  fast.at(x, y, channel) - reference.at(x, y, channel);
+					if(std::abs(difference) > 1) { return false; }
+				}
+			}
+		}
+		return true;
+	};
+
+	SUBCASE("Upscale") { CHECK(within_one({47, 32})); }
+	SUBCASE("Downscale") { CHECK(within_one({8, 6})); }
+	SUBCASE("Whole ratios") {
+		CHECK(within_one({38, 26}));
+		CHECK(within_one({57, 39}));
+		CHECK(within_one({76, 52}));
+	}
+}
+
+TEST_CASE("IMDDT splits every channel of a cell along one diagonal") {
+	// Red and green cross the cell from pixel 2 to pixel 3, so luma splits it
+	// between pixels 1 and 4. Blue alone would be split the other way.
+	Image src({2, 2}, 3);
+	const uint8_t red[4]  = {0, 0, 200, 0};
+	const uint8_t blue[4] = {0, 100, 100, 255};
+	for(index k = 0; k < 4; ++k) {
+		src.set(k % 2, k / 2, red[k], 0);
+		src.set(k % 2, k / 2, red[k], 1);
+		src.set(k % 2, k / 2, blue[k], 2);
+	}
+
+	const Image dst     = IMDDT(src, {8, 8});
+	const auto  samples = sample_axis(2, 8);
+	bool        shared  = true;
+	bool        differs = false;
+	for(index y = 0; y < 4; ++y) {
+		for(index x = 0; x < 4; ++x) {
+			const double distance_x = samples[x].distance;
+			const double distance_y = samples[y].distance;
+			const double ascending  = IMDDT_single(
+			  blue[0], blue[1], blue[2], blue[3], distance_x, distance_y, true);
+			const double own = IMDDT_single(
+			  blue[0], blue[1], blue[2], blue[3], distance_x, distance_y);
+			shared  = shared && std::abs(dst.at(x, y, 2) - ascending) <= 1;
+			differs = differs || std::abs(ascending - own) > 1;
+		}
+	}
+	CHECK(shared);
+	CHECK(differs);
+}
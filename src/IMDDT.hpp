@@ -12,6 +12,7 @@
 #define IMDDT_H
 
 #include "Image.hpp"
+#include "ImageT.hpp"
 
 constexpr double IMDDT_single(double pixel_1,
                               double pixel_2,
@@ -20,6 +21,22 @@ constexpr double IMDDT_single(double pixel_1,
                               double distance_x,
                               double distance_y);
 
+// With the cell's diagonal given rather than picked from these pixels
+constexpr double IMDDT_single(double pixel_1,
+                              double pixel_2,
+                              double pixel_3,
+                              double pixel_4,
+                              double distance_x,
+                              double distance_y,
+                              bool   ascending);
+
 Image IMDDT(const Image& src, const Dimensions& targetDim);
 
+// Resizes src to the size of dst, in place through the views
+void IMDDT(const ImageView& src, const MutableImageView& dst);
+
+// Double-precision IMDDT_single per pixel, the reference for the fixed-point
+// kernels. Like them, it splits each cell along the diagonal its luma picks.
+Image IMDDT_reference(const Image& src, const Dimensions& targetDim);
+
 #endif
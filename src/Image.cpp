@@ -1,14 +1,83 @@
 #include "Image.hpp"
 
+#include "stats.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+#include <doctest\doctest.h>
+
 Dimensions::Dimensions(unsigned int w, unsigned int h) : width(w), height(h) {}
 
-Image::Image(const Dimensions& dimensions, unsigned int channels)
-  : m_dimensions(dimensions), m_channels(channels), m_data() {
-	m_data.resize(dimensions.width * dimensions.height * channels);
+Image::Image(const Dimensions& dimensions, unsigned int channels, Init init)
+  : m_dimensions(dimensions)
+  , m_channels(channels)
+  , m_data(BufferPool::global().acquire(std::size_t{dimensions.width} *
+                                        dimensions.height * channels))
+  , m_mapping()
+  , m_pixels(m_data.data()) {
+	if(init == Init::zero) { std::fill_n(m_pixels, size(), uint8_t{0}); }
+}
+
+Image::Image(const std::string& filename,
+             const Dimensions&  dimensions,
+             unsigned int       channels)
+  : m_dimensions(dimensions)
+  , m_channels(channels)
+  , m_data()
+  , m_mapping()
+  , m_pixels(nullptr) {
+	const std::string header = raw_header(
+	  filename, dimensions.width, dimensions.height, channels);
+	if(!header.empty()) {
+		m_mapping = MappedFile(filename, header.size() + size());
+	}
+	if(m_mapping) {
+		std::copy(header.begin(), header.end(), m_mapping.data());
+		m_pixels = m_mapping.data() + header.size();
+		count(Counter::mapped_files, 1);
+	} else {
+		*this = Image(dimensions, channels);
+	}
+}
+
+Image::Image(const Image& other)
+  : Image(other.m_dimensions, other.m_channels, Init::none) {
+	std::copy_n(other.m_pixels, size(), m_pixels);
+}
+
+Image& Image::operator=(const Image& other) {
+	if(this != &other) { *this = Image(other); }
+	return *this;
+}
+
+// Points the image at filename's pixels where they are stored raw
+bool Image::map(const std::string& filename) {
+	MappedFile mapping(filename);
+	RawLayout  layout{0, 0, 0, 0};
+	if(!mapping || !raw_layout(mapping.data(), mapping.size(), layout)) {
+		return false;
+	}
+	m_dimensions = Dimensions(layout.width, layout.height);
+	m_channels   = layout.channels;
+	m_mapping    = std::move(mapping);
+	m_pixels     = m_mapping.data() + layout.offset;
+	count(Counter::mapped_files, 1);
+	return true;
 }
 
 Image::Image(const std::string& filename)
-  : m_dimensions(0, 0), m_channels(0), m_data() {
+  : m_dimensions(0, 0)
+  , m_channels(0)
+  , m_data()
+  , m_mapping()
+  , m_pixels(nullptr) {
+	StageTimer timer(Stage::load);
+	if(map(filename)) {
+		timer.add_bytes(size());
+		return;
+	}
+
 	auto input = OIIO::ImageInput::open(filename);
 	if(!input) {
 		std::stringstream ss;
@@ -25,25 +94,81 @@ Image::Image(const std::string& filename)
 	m_dimensions.height = yres;
 	m_channels          = nchannels;
 
-	m_data.resize(xres * yres * nchannels);
+	m_data   = BufferPool::global().acquire(size());
+	m_pixels = m_data.data();
 
-	input->read_image(
-	  {OIIO::TypeDesc::UINT8, OIIO::TypeDesc::SCALAR, OIIO::TypeDesc::COLOR},
-	  m_data.data());
+	if(!input->read_image(
+	     {OIIO::TypeDesc::UINT8, OIIO::TypeDesc::SCALAR, OIIO::TypeDesc::COLOR},
+	     m_pixels)) {
+		throw std::runtime_error(input->geterror() + "\n");
+	}
 
 	input->close();
+	timer.add_bytes(size());
 }
 
 void Image::save(const std::string& filename) const {
+	StageTimer timer(Stage::save, size());
+	if(!m_mapping.filename().empty() && m_mapping.filename() == filename &&
+	   m_mapping.publish()) {
+		return;
+	}
+
+	std::remove(filename.c_str());
 	auto            out = OIIO::ImageOutput::create(filename);
 	OIIO::ImageSpec spec(
 	  m_dimensions.width,
 	  m_dimensions.height,
 	  m_channels,
 	  {OIIO::TypeDesc::UINT8, OIIO::TypeDesc::SCALAR, OIIO::TypeDesc::COLOR});
-	out->open(filename, spec);
-	out->write_image(
-	  {OIIO::TypeDesc::UINT8, OIIO::TypeDesc::SCALAR, OIIO::TypeDesc::COLOR},
-	  m_data.data());
+	if(!out || !out->open(filename, spec)) {
+		std::stringstream ss;
+		ss << "cannot write file " << filename << "\n";
+		throw std::runtime_error(ss.str());
+	}
+	if(!out->write_image(
+	     {OIIO::TypeDesc::UINT8, OIIO::TypeDesc::SCALAR, OIIO::TypeDesc::COLOR},
+	     m_pixels)) {
+		throw std::runtime_error(out->geterror() + "\n");
+	}
 	out->close();
 }
+
+TEST_CASE("Images map files that store pixels raw") {
+	const std::string filename =
+	  (std::filesystem::temp_directory_path() / "resize-mapped-test.ppm")
+	    .string();
+	{
+		Image written(filename, {5, 3}, 3);
+		CHECK(written.at(4, 2, 2) == 0);
+		for(unsigned int y = 0; y < 3; ++y) {
+			for(unsigned int x = 0; x < 5; ++x) {
+				for(unsigned int c = 0; c < 3; ++c) {
+					written.set(x, y, uint8_t(10 * y + 3 * x + c), c);
+				}
+			}
+		}
+		written.save(filename);
+	}
+	{
+		Image read(filename);
+		CHECK(read.dimensions().width == 5);
+		CHECK(read.dimensions().height == 3);
+		CHECK(read.channels() == 3);
+		CHECK(read.at(4, 2, 1) == 10 * 2 + 3 * 4 + 1);
+
+		// Changes stay in memory
+		read.set(0, 0, 255, 0);
+		CHECK(Image(filename).at(0, 0, 0) == 0);
+	}
+
+	// A resize that fails before saving leaves the old file as it was
+	CHECK_THROWS([&] {
+		Image failed(filename, {5, 3}, 3);
+		failed.set(4, 2, 255, 1);
+		throw std::runtime_error("resize failed\n");
+	}());
+	CHECK(Image(filename).at(4, 2, 1) == 10 * 2 + 3 * 4 + 1);
+	CHECK(!std::filesystem::exists(filename + ".partial"));
+	std::remove(filename.c_str());
+}
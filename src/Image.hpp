@@ -1,6 +1,8 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include "BufferPool.hpp"
+#include "mapped.hpp"
 #include <OpenImageIO/imageio.h>
 #include <cstdint>
 #include <gsl\gsl-lite.hpp>
@@ -17,27 +19,71 @@ struct Dimensions final {
 	Dimensions(unsigned int w, unsigned int h);
 };
 
+// Pixels in a buffer from the global BufferPool, or in a file mapped into
+// memory when it stores them raw (see raw_layout and raw_header)
 class Image final {
 	private:
-	Dimensions           m_dimensions;
-	unsigned int         m_channels;
-	std::vector<uint8_t> m_data;
+	Dimensions   m_dimensions;
+	unsigned int m_channels;
+	PooledBuffer m_data;
+	MappedFile   m_mapping;
+	uint8_t*     m_pixels; // in m_data or m_mapping
+
+	bool map(const std::string& filename);
 
 	public:
-	explicit Image(const Dimensions& dimensions, unsigned int channels);
+	// Whether a new image starts black or with whatever its buffer held, for
+	// callers about to overwrite every pixel
+	enum class Init { zero, none };
+
+	explicit Image(const Dimensions& dimensions,
+	               unsigned int      channels,
+	               Init              init = Init::zero);
 	explicit Image(const std::string& filename);
 
+	// A black image that is the pixels of a new file for filename when its
+	// format stores them raw, so that they are written as they are set and
+	// saving them to filename has only to put that file in place. An image
+	// dropped unsaved leaves any old file at filename as it was.
+	Image(const std::string& filename,
+	      const Dimensions&  dimensions,
+	      unsigned int       channels);
+
+	Image(Image&&) = default;
+	Image& operator=(Image&&) = default;
+	Image(const Image& other);
+	Image& operator=(const Image& other);
+
 	inline uint8_t
 	at(unsigned int x, unsigned int y, unsigned int channel) const {
 		Expects(x < m_dimensions.width);
 		Expects(y < m_dimensions.height);
 		Expects(channel < m_channels);
 		const index index = m_channels * (y * m_dimensions.width + x);
-		return m_data.at(index + channel);
+		return m_pixels[index + channel];
 	}
 
 	inline const Dimensions& dimensions() const { return m_dimensions; }
 
+	inline const uint8_t* data() const { return m_pixels; }
+	inline uint8_t*       data() { return m_pixels; }
+
+	// Interleaved channel data of row y, for kernels that stream whole rows
+	inline const uint8_t* row(unsigned int y) const {
+		Expects(y < m_dimensions.height);
+		return m_pixels + std::size_t{m_channels} * y * m_dimensions.width;
+	}
+
+	inline uint8_t* row(unsigned int y) {
+		Expects(y < m_dimensions.height);
+		return m_pixels + std::size_t{m_channels} * y * m_dimensions.width;
+	}
+
+	// Bytes of pixel data
+	inline std::size_t size() const {
+		return std::size_t{m_dimensions.width} * m_dimensions.height * m_channels;
+	}
+
 	inline unsigned int channels() const { return m_channels; }
 
 	inline void
@@ -46,9 +92,11 @@ class Image final {
 		Expects(y < m_dimensions.height);
 		Expects(channel < m_channels);
 		const index index = m_channels * (y * m_dimensions.width + x) + channel;
-		m_data[index]     = value;
+		m_pixels[index] = value;
 	}
 
+	// Writes the pixels to filename, replacing rather than rewriting any file
+	// there, which may be mapped
 	void save(const std::string& filename) const;
 };
 
@@ -0,0 +1,200 @@
+#ifndef IMAGET_H
+#define IMAGET_H
+
+#include "Image.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <gsl\gsl-lite.hpp>
+#include <type_traits>
+
+// Channel count of an ImageT that only knows it at runtime
+constexpr unsigned int DYNAMIC_CHANNELS = 0;
+
+// Typed, unchecked access to interleaved pixel rows, for the inner loops of
+// the resize methods. An ImageT does not own its pixels, and its rows may be
+// further apart than their width (a crop, or a padded buffer). It may also be
+// a window onto a region of a larger image: the dimensions are those of the
+// whole image, but only rows [first_row(), end_row()) and columns
+// [first_column(), end_column()) exist, and row(y) starts at the first of
+// those columns. With the channel count fixed at compile time, per-pixel
+// strides are constants and loops over the channels unroll.
+template<typename Pixel, unsigned int Channels>
+class ImageT final {
+	private:
+	Pixel*       m_data;
+	Dimensions   m_dimensions;
+	unsigned int m_channels;
+	std::size_t  m_stride; // values from one row to the next
+	unsigned int m_firstRow;
+	unsigned int m_endRow;
+	unsigned int m_firstColumn;
+	unsigned int m_endColumn;
+
+	using ImageRef =
+	  std::conditional_t<std::is_const<Pixel>::value, const Image&, Image&>;
+
+	public:
+	ImageT(Pixel*            data,
+	       const Dimensions& dimensions,
+	       unsigned int      channels,
+	       std::size_t       stride)
+	  : ImageT(data, dimensions, channels, stride, 0, dimensions.height) {}
+
+	// Rows [first_row, end_row) of an image of `dimensions`, the first of them
+	// at data
+	ImageT(Pixel*            data,
+	       const Dimensions& dimensions,
+	       unsigned int      channels,
+	       std::size_t       stride,
+	       unsigned int      first_row,
+	       unsigned int      end_row)
+	  : ImageT(data,
+	           dimensions,
+	           channels,
+	           stride,
+	           first_row,
+	           end_row,
+	           0,
+	           dimensions.width) {}
+
+	// Rows [first_row, end_row) and columns [first_column, end_column) of an
+	// image of `dimensions`, the first of them at data
+	ImageT(Pixel*            data,
+	       const Dimensions& dimensions,
+	       unsigned int      channels,
+	       std::size_t       stride,
+	       unsigned int      first_row,
+	       unsigned int      end_row,
+	       unsigned int      first_column,
+	       unsigned int      end_column)
+	  : m_data(data)
+	  , m_dimensions(dimensions)
+	  , m_channels(channels)
+	  , m_stride(stride)
+	  , m_firstRow(first_row)
+	  , m_endRow(end_row)
+	  , m_firstColumn(first_column)
+	  , m_endColumn(end_column) {
+		Expects(Channels == DYNAMIC_CHANNELS || channels == Channels);
+		Expects(first_row <= end_row && end_row <= dimensions.height);
+		Expects(first_column <= end_column && end_column <= dimensions.width);
+		Expects(stride >= std::size_t{end_column - first_column} * channels);
+	}
+
+	// All of an image, read-only when Pixel is const
+	explicit ImageT(ImageRef image)
+	  : ImageT(image.data(),
+	           image.dimensions(),
+	           image.channels(),
+	           std::size_t{image.dimensions().width} * image.channels()) {}
+
+	// The same pixels with the channel count fixed or forgotten, or made
+	// read-only. Fixing the count checks it.
+	template<typename Other,
+	         unsigned int OtherChannels,
+	         typename = std::enable_if_t<
+	           std::is_same<Other, Pixel>::value ||
+	           std::is_same<const Other, Pixel>::value>>
+	ImageT(const ImageT<Other, OtherChannels>& image)
+	  : ImageT(image.row(image.first_row()),
+	           image.dimensions(),
+	           image.channels(),
+	           image.stride(),
+	           image.first_row(),
+	           image.end_row(),
+	           image.first_column(),
+	           image.end_column()) {}
+
+	inline unsigned int channels() const {
+		return Channels == DYNAMIC_CHANNELS ? m_channels : Channels;
+	}
+
+	inline const Dimensions& dimensions() const { return m_dimensions; }
+
+	inline std::size_t stride() const { return m_stride; }
+
+	inline unsigned int first_row() const { return m_firstRow; }
+	inline unsigned int end_row() const { return m_endRow; }
+
+	inline unsigned int first_column() const { return m_firstColumn; }
+	inline unsigned int end_column() const { return m_endColumn; }
+
+	// Whether every column is there, as the methods that only take bands of
+	// rows need
+	inline bool full_width() const {
+		return m_firstColumn == 0 && m_endColumn == m_dimensions.width;
+	}
+
+	// Values in the rows the view has, not counting the gaps between rows
+	inline std::size_t values() const {
+		const std::size_t rows = m_endRow - m_firstRow;
+		return rows * (m_endColumn - m_firstColumn) * channels();
+	}
+
+	inline Pixel* row(unsigned int y) const {
+		return m_data + (y - m_firstRow) * m_stride;
+	}
+
+	inline Pixel& at(unsigned int x, unsigned int y, unsigned int channel) const {
+		return row(y)[std::size_t{x - m_firstColumn} * channels() + channel];
+	}
+
+	// The region of `dimensions` pixels from (x, y), sharing these pixels
+	ImageT
+	crop(unsigned int x, unsigned int y, const Dimensions& dimensions) const {
+		Expects(x >= m_firstColumn && x + dimensions.width <= m_endColumn);
+		Expects(y >= m_firstRow && y + dimensions.height <= m_endRow);
+		return ImageT(&at(x, y, 0), dimensions, channels(), m_stride);
+	}
+
+	// Rows [first_row, end_row) of these, still a window onto the whole image
+	ImageT window(unsigned int first_row, unsigned int end_row) const {
+		return window(first_row, end_row, m_firstColumn, m_endColumn);
+	}
+
+	// Rows [first_row, end_row) and columns [first_column, end_column) of
+	// these, still a window onto the whole image
+	ImageT window(unsigned int first_row,
+	              unsigned int end_row,
+	              unsigned int first_column,
+	              unsigned int end_column) const {
+		Expects(first_row >= m_firstRow && end_row <= m_endRow);
+		Expects(first_column >= m_firstColumn && end_column <= m_endColumn);
+		return ImageT(&at(first_column, first_row, 0),
+		              m_dimensions,
+		              channels(),
+		              m_stride,
+		              first_row,
+		              end_row,
+		              first_column,
+		              end_column);
+	}
+};
+
+// Strided views over pixels owned elsewhere: an Image, a crop of one, a
+// decoder's plane or a mapped file
+using ImageView        = ImageT<const uint8_t, DYNAMIC_CHANNELS>;
+using MutableImageView = ImageT<uint8_t, DYNAMIC_CHANNELS>;
+
+// Calls function(src, dst) with both views specialised for the common channel
+// counts (grey, RGB and RGBA), or left dynamic otherwise
+template<typename Function>
+void dispatch_channels(const ImageView&        src,
+                       const MutableImageView& dst,
+                       Function                function) {
+	Expects(src.channels() == dst.channels());
+	switch(src.channels()) {
+		case 1:
+			function(ImageT<const uint8_t, 1>(src), ImageT<uint8_t, 1>(dst));
+			break;
+		case 3:
+			function(ImageT<const uint8_t, 3>(src), ImageT<uint8_t, 3>(dst));
+			break;
+		case 4:
+			function(ImageT<const uint8_t, 4>(src), ImageT<uint8_t, 4>(dst));
+			break;
+		default: function(src, dst); break;
+	}
+}
+
+#endif
@@ -0,0 +1,207 @@
+#include "ThreadPool.hpp"
+
+#include "stats.hpp"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include <doctest\doctest.h>
+
+namespace {
+	// Lets tasks submitted from inside a worker land on that worker's own queue
+	thread_local const ThreadPool* t_pool  = nullptr;
+	thread_local unsigned          t_queue = 0;
+
+	std::mutex                  g_globalMutex;
+	std::unique_ptr<ThreadPool> g_global;
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threads)
+  : m_queues()
+  , m_threads()
+  , m_nextQueue(0)
+  , m_queued(0)
+  , m_stopping(false)
+  , m_sleepMutex()
+  , m_wake() {
+	const unsigned workers = threads > 1 ? threads - 1 : 0;
+	for(unsigned i = 0; i < workers; ++i) {
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+	for(unsigned i = 0; i < workers; ++i) {
+		m_threads.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for(auto& thread : m_threads) { thread.join(); }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+	if(m_queues.empty()) {
+		task();
+		return;
+	}
+
+	const unsigned queue =
+	  t_pool == this ? t_queue : m_nextQueue++ % m_queues.size();
+	{
+		std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+		m_queues[queue]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		++m_queued;
+	}
+	m_wake.notify_one();
+}
+
+bool ThreadPool::pop(unsigned queue, std::function<void()>& task) {
+	std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+	if(m_queues[queue]->tasks.empty()) { return false; }
+	task = std::move(m_queues[queue]->tasks.back());
+	m_queues[queue]->tasks.pop_back();
+	--m_queued;
+	return true;
+}
+
+bool ThreadPool::steal(unsigned thief, std::function<void()>& task) {
+	const unsigned count = m_queues.size();
+	for(unsigned i = 1; i <= count; ++i) {
+		Queue&                      victim = *m_queues[(thief + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if(victim.tasks.empty()) { continue; }
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		--m_queued;
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::work(unsigned queue) {
+	t_pool  = this;
+	t_queue = queue;
+
+	std::function<void()> task;
+	while(true) {
+		if(pop(queue, task) || steal(queue, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this] { return m_stopping || m_queued > 0; });
+		if(m_stopping && m_queued == 0) { return; }
+	}
+}
+
+bool ThreadPool::run_pending_task() {
+	if(m_queues.empty()) { return false; }
+
+	std::function<void()> task;
+	const unsigned        start = t_pool == this ? t_queue : 0;
+	if(!steal(start, task)) { return false; }
+	task();
+	return true;
+}
+
+ThreadPool& ThreadPool::global() {
+	std::lock_guard<std::mutex> lock(g_globalMutex);
+	if(!g_global) {
+		const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+		g_global               = std::make_unique<ThreadPool>(threads);
+	}
+	return *g_global;
+}
+
+void ThreadPool::set_global_threads(unsigned threads) {
+	std::lock_guard<std::mutex> lock(g_globalMutex);
+	g_global.reset();
+	g_global = std::make_unique<ThreadPool>(std::max(1u, threads));
+}
+
+void parallel_for(std::ptrdiff_t   begin,
+                  std::ptrdiff_t   end,
+                  const ChunkBody& body) {
+	if(end <= begin) { return; }
+
+	ThreadPool&          pool  = ThreadPool::global();
+	const std::ptrdiff_t count = end - begin;
+	const Stage          stage = current_stage();
+	if(pool.size() == 1 || count == 1) {
+		ChunkTrace trace(stage);
+		body(begin, end);
+		return;
+	}
+
+	// A few chunks per thread keeps everyone busy when bands take uneven time
+	const std::ptrdiff_t threads   = pool.size();
+	const std::ptrdiff_t chunks    = std::min(count, threads * 4);
+	const std::ptrdiff_t chunkSize = (count + chunks - 1) / chunks;
+
+	std::atomic<std::ptrdiff_t> remaining(0);
+	std::mutex                  errorMutex;
+	std::exception_ptr          error;
+
+	auto runChunk = [&](std::ptrdiff_t first, std::ptrdiff_t last) {
+		ChunkTrace trace(stage);
+		try {
+			body(first, last);
+		} catch(...) {
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if(!error) { error = std::current_exception(); }
+		}
+		--remaining;
+	};
+
+	for(std::ptrdiff_t first = begin + chunkSize; first < end;
+	    first += chunkSize) {
+		const std::ptrdiff_t last = std::min(first + chunkSize, end);
+		++remaining;
+		pool.submit([&runChunk, first, last] { runChunk(first, last); });
+	}
+	++remaining;
+	runChunk(begin, std::min(begin + chunkSize, end));
+
+	while(remaining > 0) {
+		if(!pool.run_pending_task()) { std::this_thread::yield(); }
+	}
+
+	if(error) { std::rethrow_exception(error); }
+}
+
+TEST_CASE("Thread pool runs submitted work") {
+	SUBCASE("Submitted tasks all run") {
+		std::atomic<int> done(0);
+		{
+			ThreadPool pool(4);
+			for(int i = 0; i < 64; ++i) {
+				pool.submit([&done] { ++done; });
+			}
+			while(pool.run_pending_task()) {}
+		}
+		CHECK(done == 64);
+	}
+	SUBCASE("Every index is visited once") {
+		std::vector<std::atomic<int>> visits(1000);
+		for(auto& visit : visits) { visit = 0; }
+		parallel_for(0, 1000, [&](std::ptrdiff_t first, std::ptrdiff_t last) {
+			for(std::ptrdiff_t i = first; i < last; ++i) { ++visits[i]; }
+		});
+		bool once = true;
+		for(auto& visit : visits) { once = once && visit == 1; }
+		CHECK(once);
+	}
+	SUBCASE("Exceptions reach the caller") {
+		CHECK_THROWS(parallel_for(0, 100, [](std::ptrdiff_t, std::ptrdiff_t last) {
+			if(last > 50) { throw std::runtime_error("chunk failed"); }
+		}));
+	}
+}
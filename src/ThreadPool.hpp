@@ -0,0 +1,68 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A work-stealing thread pool. Every worker owns a deque: it pops its own
+// work from the back and, when that runs dry, steals from the front of the
+// other workers' deques. Threads that wait on submitted work help run it, so
+// nested parallel loops cannot deadlock the pool.
+class ThreadPool final {
+	private:
+	struct Queue final {
+		std::deque<std::function<void()>> tasks{};
+		std::mutex                        mutex{};
+	};
+
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread>            m_threads;
+	std::atomic<unsigned>               m_nextQueue;
+	std::atomic<std::ptrdiff_t>         m_queued;
+	std::atomic<bool>                   m_stopping;
+	std::mutex                          m_sleepMutex;
+	std::condition_variable             m_wake;
+
+	bool pop(unsigned queue, std::function<void()>& task);
+	bool steal(unsigned thief, std::function<void()>& task);
+	void work(unsigned queue);
+
+	public:
+	// Creates a pool in which `threads` threads (including the caller of
+	// parallel_for) share the work. A pool of size 1 runs everything inline.
+	explicit ThreadPool(unsigned threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	inline unsigned size() const { return m_threads.size() + 1; }
+
+	void submit(std::function<void()> task);
+
+	// Runs one queued task on the calling thread, if there is one
+	bool run_pending_task();
+
+	// The pool used by parallel_for. Resizing it replaces the pool, so it must
+	// not happen while parallel work is in flight.
+	static ThreadPool& global();
+	static void        set_global_threads(unsigned threads);
+};
+
+using ChunkBody = std::function<void(std::ptrdiff_t, std::ptrdiff_t)>;
+
+// Calls body(first, last) over disjoint chunks covering [begin, end) on the
+// global pool and returns once every chunk has finished. The first exception
+// thrown by a chunk is rethrown on the calling thread.
+void parallel_for(std::ptrdiff_t   begin,
+                  std::ptrdiff_t   end,
+                  const ChunkBody& body);
+
+#endif
@@ -0,0 +1,241 @@
+#include "area.hpp"
+
+#include "BufferPool.hpp"
+#include "ThreadPool.hpp"
+#include "kernels.hpp"
+#include "separable.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <gsl\gsl-lite.hpp>
+#include <random>
+#include <vector>
+
+#include <doctest\doctest.h>
+
+using namespace gsl;
+
+namespace {
+	// The sizes of one axis: the source, then each halving of it, for as long
+	// as what is left covers the target at least twice
+	std::vector<unsigned int> halvings(unsigned int source,
+	                                   unsigned int target) {
+		Expects(target > 0);
+		std::vector<unsigned int> sizes{source};
+		while(std::uint64_t{target} << sizes.size() <= source) {
+			sizes.push_back((sizes.back() + 1) / 2);
+		}
+		return sizes;
+	}
+
+	// The area pass of one axis, from its last halving to the target. An odd
+	// size halves to a last pixel that covers only half as much.
+	FilterAxis pass_axis(const std::vector<unsigned int>& sizes,
+	                     unsigned int                     target) {
+		const double extent =
+		  std::ldexp(sizes.front(), -static_cast<int>(sizes.size() - 1));
+		return area_axis(extent, sizes.back(), target);
+	}
+
+	// The rows of every halving that output rows [first, end) need, from the
+	// source up. Each needs twice the rows of the next one, bar an odd last.
+	std::vector<RowRange> needed_rows(const std::vector<unsigned int>& sizes,
+	                                  const FilterAxis&                axis,
+	                                  const RowRange&                  rows) {
+		std::vector<RowRange> needed(sizes.size());
+		needed.back() = {axis.first[rows.first],
+		                 axis.first[rows.end - 1] + axis.taps};
+		for(std::size_t level = sizes.size() - 1; level > 0; --level) {
+			needed[level - 1] = {2 * needed[level].first,
+			                     std::min(2 * needed[level].end, sizes[level - 1])};
+		}
+		return needed;
+	}
+
+	// Halves `below` into out, along its rows, its columns or both
+	void halve(const ImageView&        below,
+	           bool                    rows,
+	           bool                    columns,
+	           const MutableImageView& out) {
+		const Kernels&     simd     = kernels();
+		const unsigned int channels = out.channels();
+		const unsigned int first_x  = out.first_column();
+		const std::size_t  count    = out.end_column() - first_x;
+
+		// An odd last column is averaged with itself
+		const bool odd =
+		  columns && 2 * out.end_column() > below.dimensions().width;
+		const std::size_t boxes = odd ? count - 1 : count;
+		const std::size_t last  = boxes * channels;
+
+		const unsigned int height    = below.dimensions().height;
+		const index        first_row = out.first_row();
+		const index        end_row   = out.end_row();
+		parallel_for(first_row, end_row, [&](index first_y, index last_y) {
+			for(index y = first_y; y < last_y; ++y) {
+				const unsigned int upper_y = rows ? 2 * y : y;
+				const unsigned int lower_y =
+				  rows ? std::min<unsigned int>(2 * y + 1, height - 1) : y;
+				const unsigned int x     = columns ? 2 * first_x : first_x;
+				const uint8_t*     upper = &below.at(x, upper_y, 0);
+				const uint8_t*     lower = &below.at(x, lower_y, 0);
+				uint8_t*           row   = out.row(y);
+				if(!columns) {
+					simd.average_rows(upper, lower, row, count * channels);
+					continue;
+				}
+				simd.box_row(upper, lower, channels, row, boxes);
+				if(odd) {
+					average_rows_scalar(
+					  upper + 2 * last, lower + 2 * last, row + last, channels);
+				}
+			}
+		});
+	}
+} // namespace
+
+bool shrinks(const Dimensions& source, const Dimensions& target) {
+	return target.width <= source.width && target.height <= source.height &&
+	       (target.width < source.width || target.height < source.height);
+}
+
+RowRange
+area_rows(unsigned int source, unsigned int target, const RowRange& rows) {
+	const auto sizes = halvings(source, target);
+	return needed_rows(sizes, pass_axis(sizes, target), rows).front();
+}
+
+Image area(const Image& src, const Dimensions& targetDim) {
+	Image dst(targetDim, src.channels(), Image::Init::none);
+	area(ImageView(src), MutableImageView(dst));
+	return dst;
+}
+
+void area(const ImageView& src, const MutableImageView& dst) {
+	StageTimer timer(Stage::area, dst.values());
+	if(dst.values() == 0) { return; }
+
+	const Dimensions& source  = src.dimensions();
+	const Dimensions& target  = dst.dimensions();
+	const auto        widths  = halvings(source.width, target.width);
+	const auto        heights = halvings(source.height, target.height);
+	const FilterAxis  columns = pass_axis(widths, target.width);
+	const FilterAxis  rows    = pass_axis(heights, target.height);
+
+	// Only what dst's region needs of every halving
+	const auto column_ranges =
+	  needed_rows(widths, columns, {dst.first_column(), dst.end_column()});
+	const auto row_ranges =
+	  needed_rows(heights, rows, {dst.first_row(), dst.end_row()});
+	Expects(row_ranges[0].first >= src.first_row() &&
+	        row_ranges[0].end <= src.end_row());
+	Expects(column_ranges[0].first >= src.first_column() &&
+	        column_ranges[0].end <= src.end_column());
+
+	// An axis that has stopped halving keeps its last size. Levels alternate
+	// between the two buffers: the one below is always in the other.
+	const unsigned int channels = src.channels();
+	const std::size_t  levels   = std::max(widths.size(), heights.size());
+	PooledBuffer       buffers[2];
+	ImageView          below = src;
+	for(std::size_t level = 1; level < levels; ++level) {
+		const std::size_t level_x = std::min(level, widths.size() - 1);
+		const std::size_t level_y = std::min(level, heights.size() - 1);
+		const RowRange&   x_range = column_ranges[level_x];
+		const RowRange&   y_range = row_ranges[level_y];
+		const std::size_t stride =
+		  std::size_t{x_range.end - x_range.first} * channels;
+		PooledBuffer& buffer = buffers[level % 2];
+		buffer =
+		  BufferPool::global().acquire(stride * (y_range.end - y_range.first));
+		const MutableImageView out(buffer.data(),
+		                           {widths[level_x], heights[level_y]},
+		                           channels,
+		                           stride,
+		                           y_range.first,
+		                           y_range.end,
+		                           x_range.first,
+		                           x_range.end);
+		halve(below, level < heights.size(), level < widths.size(), out);
+		below = ImageView(out);
+	}
+	filter_separable(columns, rows, below, dst);
+}
+
+TEST_CASE("Area shrinks average what each pixel covers") {
+	std::mt19937                       rng(17);
+	std::uniform_int_distribution<int> value(0, 255);
+
+	auto noise = [&](const Dimensions& dimensions, unsigned int channels) {
+		Image image(dimensions, channels);
+		for(index y = 0; y < dimensions.height; ++y) {
+			for(index x = 0; x < dimensions.width * channels; ++x) {
+				image.row(y)[x] = value(rng);
+			}
+		}
+		return image;
+	};
+
+	// Within one of the exact average for halvings alone, or an area pass
+	// alone. Together, the pass takes the pixels of the last halving it
+	// partly covers at their mean, which is that much blurrier.
+	auto averages = [&](const Dimensions& source, const Dimensions& target) {
+		const Image  src    = noise(source, 3);
+		const Image  dst    = area(src, target);
+		const double step_x = double(source.width) / target.width;
+		const double step_y = double(source.height) / target.height;
+		for(index y = 0; y < target.height; ++y) {
+			for(index x = 0; x < target.width; ++x) {
+				for(index channel = 0; channel < 3; ++channel) {
+					double sum = 0;
+					for(index v = 0; v < source.height; ++v) {
+						const double cover_y =
+						  std::min((y + 1) * step_y, v + 1.0) -
+						  std::max(y * step_y, double(v));
+						for(index u = 0; u < source.width && cover_y > 0; ++u) {
+							const double cover_x =
+							  std::min((x + 1) * step_x, u + 1.0) -
+							  std::max(x * step_x, double(u));
+							if(cover_x > 0) {
+								sum += cover_x * cover_y * src.at(u, v, channel);
+							}
+						}
+					}
+					const double mean = sum / (step_x * step_y);
+					if(std::abs(dst.at(x, y, channel) - mean) > 1) { return false; }
+				}
+			}
+		}
+		return true;
+	};
+	CHECK(averages({40, 24}, {10, 6}));
+	CHECK(averages({64, 9}, {16, 9}));
+	CHECK(averages({30, 20}, {18, 12}));
+	CHECK(averages({29, 7}, {16, 5}));
+
+	// Odd sizes and every channel count the kernels treat differently
+	for(unsigned int channels : {1u, 3u, 4u, 5u, 9u}) {
+		Image flat({37, 23}, channels);
+		for(index y = 0; y < 23; ++y) {
+			for(index x = 0; x < 37 * channels; ++x) {
+				flat.row(y)[x] = 40 + x % channels;
+			}
+		}
+		for(const Dimensions& target :
+		    {Dimensions(3, 2), Dimensions(12, 11), Dimensions(37, 5)}) {
+			const Image shrunk = area(flat, target);
+			bool        kept   = true;
+			for(index y = 0; y < target.height; ++y) {
+				for(index x = 0; x < target.width * channels; ++x) {
+					kept = kept && shrunk.row(y)[x] == 40 + x % channels;
+				}
+			}
+			CHECK(kept);
+		}
+	}
+
+	CHECK(shrinks({10, 10}, {10, 9}));
+	CHECK(!shrinks({10, 10}, {10, 10}));
+	CHECK(!shrinks({10, 10}, {5, 11}));
+}
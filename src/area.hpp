@@ -0,0 +1,27 @@
+#ifndef AREA_H
+#define AREA_H
+
+#include "Image.hpp"
+#include "ImageT.hpp"
+#include "resize.hpp"
+
+// Shrinking by the average of the source area under each output pixel, so
+// that every source pixel counts at any ratio. The source is halved by 2x2
+// boxes while it is at least twice the target along an axis, then one pass
+// weights the pixels of the last halving by how much of each an output pixel
+// covers. An odd last row or column is paired with itself.
+
+// Whether target is smaller than source, and nowhere larger
+bool shrinks(const Dimensions& source, const Dimensions& target);
+
+// The source rows an area shrink from `source` rows to `target` needs for
+// output rows [first, end); for columns, pass widths
+RowRange
+area_rows(unsigned int source, unsigned int target, const RowRange& rows);
+
+Image area(const Image& src, const Dimensions& targetDim);
+
+// Shrinks src to the size of dst, which may be a window onto any region
+void area(const ImageView& src, const MutableImageView& dst);
+
+#endif
@@ -0,0 +1,261 @@
+#include "batch.hpp"
+
+#include "BoundedQueue.hpp"
+#include "Image.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <doctest\doctest.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+	// An image on its way through the pipeline, with the input it came from
+	struct Job final {
+		std::size_t            file = 0;
+		std::unique_ptr<Image> image{};
+	};
+
+	// Whether name is one batch_output gives, method-scalex_name, so that a
+	// batch run again over a directory it wrote into does not resize its own
+	// results
+	bool is_batch_output(const std::string& name) {
+		for(Method method : {Method::bilinear,
+		                     Method::bicubic,
+		                     Method::lanczos3,
+		                     Method::IMDDT,
+		                     Method::AIS}) {
+			const std::string prefix = std::string(method_name(method)) + "-";
+			if(name.compare(0, prefix.size(), prefix) != 0) { continue; }
+			std::stringstream ss(name.substr(prefix.size()));
+			float             scale = 0;
+			char              times = 0, underscore = 0;
+			if(ss >> scale >> times >> underscore && times == 'x' &&
+			   underscore == '_') {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<std::string> directory_files(const fs::path&    directory,
+	                                         const std::string& pattern) {
+		std::vector<std::string> files;
+		for(const auto& entry : fs::directory_iterator(directory)) {
+			const std::string name = entry.path().filename().string();
+			if(entry.is_regular_file() && matches_wildcard(pattern, name) &&
+			   !is_batch_output(name)) {
+				files.push_back(entry.path().string());
+			}
+		}
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	std::vector<std::string> manifest_files(const std::string& manifest) {
+		std::ifstream file(manifest);
+		if(!file) {
+			std::stringstream ss;
+			ss << "cannot open batch source " << manifest << "\n";
+			throw std::runtime_error(ss.str());
+		}
+
+		std::vector<std::string> files;
+		std::string              line;
+		while(std::getline(file, line)) {
+			if(!line.empty() && line.back() == '\r') { line.pop_back(); }
+			if(line.empty() || line.front() == '#') { continue; }
+			files.push_back(line);
+		}
+		return files;
+	}
+
+	// Starts count threads running body and returns them for joining
+	template<typename Body>
+	std::vector<std::thread> start_stage(unsigned int count, Body body) {
+		std::vector<std::thread> threads;
+		for(unsigned int i = 0; i < std::max(1u, count); ++i) {
+			threads.emplace_back(body);
+		}
+		return threads;
+	}
+
+	void join(std::vector<std::thread>& threads) {
+		for(auto& thread : threads) { thread.join(); }
+	}
+} // namespace
+
+bool matches_wildcard(const std::string& pattern, const std::string& name) {
+	// Greedy with backtracking to the last *, which only ever needs to
+	// stretch further
+	std::size_t p = 0, n = 0, star = std::string::npos, resume = 0;
+	while(n < name.size()) {
+		if(p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+			++p;
+			++n;
+		} else if(p < pattern.size() && pattern[p] == '*') {
+			star   = p++;
+			resume = n;
+		} else if(star != std::string::npos) {
+			p = star + 1;
+			n = ++resume;
+		} else {
+			return false;
+		}
+	}
+	while(p < pattern.size() && pattern[p] == '*') { ++p; }
+	return p == pattern.size();
+}
+
+std::vector<std::string> batch_inputs(const std::string& source) {
+	if(fs::is_directory(source)) { return directory_files(source, "*"); }
+
+	if(source.find_first_of("*?") != std::string::npos) {
+		const fs::path pattern(source);
+		const fs::path directory =
+		  pattern.has_parent_path() ? pattern.parent_path() : fs::path(".");
+		if(!fs::is_directory(directory)) {
+			std::stringstream ss;
+			ss << "cannot open batch source " << source << "\n";
+			throw std::runtime_error(ss.str());
+		}
+		return directory_files(directory, pattern.filename().string());
+	}
+
+	return manifest_files(source);
+}
+
+std::string
+batch_output(const BatchOptions& options, const std::string& input) {
+	const fs::path    path(input);
+	std::stringstream ss;
+	ss << method_name(options.method) << "-" << options.scale << "x_"
+	   << path.filename().string();
+	const fs::path directory = options.outputDir.empty() ?
+	                             path.parent_path() :
+	                             fs::path(options.outputDir);
+	return (directory / ss.str()).string();
+}
+
+std::size_t run_batch(const std::vector<std::string>& inputs,
+                      const BatchOptions&             options) {
+	// Room for a couple of images per consumer keeps every stage fed without
+	// letting a fast decoder run far ahead of the resize
+	BoundedQueue<Job> decoded(2 * std::max(1u, options.resizeThreads));
+	BoundedQueue<Job> resized(2 * std::max(1u, options.encodeThreads));
+
+	std::atomic<std::size_t> next(0);
+	std::atomic<std::size_t> failures(0);
+	std::mutex               reportMutex;
+
+	// Runs one stage of one file, reporting rather than propagating its errors
+	auto attempt = [&](std::size_t file, auto&& stage) {
+		try {
+			stage();
+			return true;
+		} catch(const std::exception& e) {
+			std::lock_guard<std::mutex> lock(reportMutex);
+			std::cerr << inputs[file] << ": " << e.what();
+		}
+		++failures;
+		return false;
+	};
+
+	auto decoders = start_stage(options.decodeThreads, [&] {
+		for(std::size_t file = next++; file < inputs.size(); file = next++) {
+			Job job;
+			job.file    = file;
+			auto decode = [&] { job.image = std::make_unique<Image>(inputs[file]); };
+			if(attempt(file, decode)) { decoded.push(std::move(job)); }
+		}
+	});
+
+	auto resizers = start_stage(options.resizeThreads, [&] {
+		Job job;
+		while(decoded.pop(job)) {
+			auto scale = [&] {
+				job.image = std::make_unique<Image>(
+				  resize(options.method, *job.image, options.scale));
+			};
+			if(attempt(job.file, scale)) { resized.push(std::move(job)); }
+		}
+	});
+
+	auto encoders = start_stage(options.encodeThreads, [&] {
+		Job job;
+		while(resized.pop(job)) {
+			auto encode = [&] {
+				job.image->save(batch_output(options, inputs[job.file]));
+			};
+			attempt(job.file, encode);
+			job.image.reset();
+		}
+	});
+
+	// Each stage ends once the one before it has, and its queue is drained
+	join(decoders);
+	decoded.close();
+	join(resizers);
+	resized.close();
+	join(encoders);
+
+	return failures;
+}
+
+TEST_CASE("Batch inputs and pipeline queues") {
+	SUBCASE("Wildcards") {
+		CHECK(matches_wildcard("*", "photo.png"));
+		CHECK(matches_wildcard("*.png", "photo.png"));
+		CHECK(matches_wildcard("img_??.p*g", "img_07.png"));
+		CHECK(matches_wildcard("a*b*c", "axxbyyc"));
+		CHECK(!matches_wildcard("*.png", "photo.jpg"));
+		CHECK(!matches_wildcard("img_?.png", "img_07.png"));
+	}
+	SUBCASE("Queues hand over every item once, in order") {
+		BoundedQueue<int> queue(2);
+		std::thread producer([&] {
+			for(int i = 0; i < 100; ++i) { queue.push(i); }
+			queue.close();
+		});
+		int  expected = 0;
+		int  item     = 0;
+		bool ordered  = true;
+		while(queue.pop(item)) { ordered = ordered && item == expected++; }
+		producer.join();
+		CHECK(ordered);
+		CHECK(expected == 100);
+	}
+}
+
+TEST_CASE("Batches report failed files and skip their own results") {
+	const fs::path directory = fs::temp_directory_path() / "resize-batch-test";
+	fs::remove_all(directory);
+	fs::create_directories(directory);
+	const std::string good    = (directory / "good.ppm").string();
+	const std::string bad     = (directory / "bad.ppm").string();
+	const std::string missing = (directory / "missing.ppm").string();
+	Image({4, 3}, 3).save(good);
+	std::ofstream(bad) << "not an image";
+
+	const BatchOptions options{Method::bilinear, 2, "", 2, 2, 2};
+	const std::string  output = batch_output(options, good);
+	CHECK(output == (directory / "bilinear-2x_good.ppm").string());
+	CHECK(run_batch({bad, good, missing}, options) == 2);
+	CHECK(Image(output).dimensions().width == 8);
+	CHECK(!fs::exists(batch_output(options, bad)));
+
+	// Run again over the directory, the first run's result is not an input
+	const std::vector<std::string> inputs{bad, good};
+	CHECK(batch_inputs(directory.string()) == inputs);
+	CHECK(batch_inputs((directory / "*good*").string()).size() == 1);
+	fs::remove_all(directory);
+}
@@ -0,0 +1,40 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "resize.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct BatchOptions final {
+	Method       method;
+	float        scale;
+	std::string  outputDir; // next to each input when empty
+	unsigned int decodeThreads;
+	unsigned int resizeThreads;
+	unsigned int encodeThreads;
+};
+
+// The files a batch source names: every file in a directory, the files that
+// match a glob (wildcards in the file name only), or the lines of a manifest
+// file. Blank manifest lines and lines starting with # are skipped, and so
+// are files in a directory or glob named as batch_output names its results.
+std::vector<std::string> batch_inputs(const std::string& source);
+
+// Whether name matches pattern, in which * stands for any run of characters
+// and ? for any one character
+bool matches_wildcard(const std::string& pattern, const std::string& name);
+
+// Where a batch writes the result for input: the default single-file name,
+// method-scalex_name, in outputDir or else next to the input
+std::string batch_output(const BatchOptions& options, const std::string& input);
+
+// Decodes, resizes and encodes every input in a three-stage pipeline, each
+// stage with its own threads and bounded queues between them. Decoding the
+// next files and encoding the previous ones overlap with resizing the current
+// one. A file that fails is reported on std::cerr and skipped; returns how
+// many did.
+std::size_t run_batch(const std::vector<std::string>& inputs,
+                      const BatchOptions&             options);
+
+#endif
@@ -2,6 +2,7 @@
 #define BILINEAR_H
 
 #include "Image.hpp"
+#include "ImageT.hpp"
 
 constexpr double bilinear_single(double pixel_1,
                                  double pixel_2,
@@ -12,4 +13,15 @@ constexpr double bilinear_single(double pixel_1,
 
 Image bilinear(const Image& src, const Dimensions& targetDim);
 
+// Resizes src to the size of dst, in place through the views
+void bilinear(const ImageView& src, const MutableImageView& dst);
+
+// The same with the corner pixels of dst on those of src, each step between
+// samples (source size - 1) / (target size - 1) of a source pixel, as AIS's
+// doublings lay out their pixels
+void bilinear_lattice(const ImageView& src, const MutableImageView& dst);
+
+// The original column-major loop, kept for comparison in tests and benchmarks
+Image bilinear_reference(const Image& src, const Dimensions& targetDim);
+
 #endif
@@ -0,0 +1,219 @@
+#include "cache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <doctest\doctest.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+	// Entries being written, which readers and eviction leave alone
+	constexpr const char* TEMPORARY = ".partial";
+
+	inline std::uint64_t mix(std::uint64_t x) {
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdull;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ull;
+		x ^= x >> 33;
+		return x;
+	}
+
+	// A name no other writer, in this process or another, picks at once
+	std::string temporary_name(const std::string& entry) {
+		static std::atomic<std::uint64_t> counter(0);
+		static const std::uint64_t        process = std::random_device()();
+		const std::uint64_t thread =
+		  std::hash<std::thread::id>()(std::this_thread::get_id());
+		const std::uint64_t now =
+		  std::chrono::steady_clock::now().time_since_epoch().count();
+
+		std::stringstream ss;
+		ss << entry << "." << std::hex << mix(process ^ thread ^ mix(now))
+		   << counter++ << TEMPORARY;
+		return ss.str();
+	}
+
+	bool temporary(const fs::path& path) {
+		return path.extension() == TEMPORARY;
+	}
+} // namespace
+
+std::uint64_t hash_file(const std::string& filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if(!file) { throw std::runtime_error("cannot open file " + filename + "\n"); }
+
+	// Whole chunks are whole words, so only the last one has a tail
+	std::vector<char> buffer(1 << 20);
+	std::uint64_t     hash  = 0x9e3779b97f4a7c15ull;
+	std::uint64_t     total = 0;
+	while(file) {
+		file.read(buffer.data(), buffer.size());
+		const std::size_t count = file.gcount();
+		std::size_t       i     = 0;
+		for(; i + 8 <= count; i += 8) {
+			std::uint64_t word;
+			std::memcpy(&word, buffer.data() + i, 8);
+			hash = mix(hash ^ word);
+		}
+		if(i < count) {
+			std::uint64_t word = 0;
+			std::memcpy(&word, buffer.data() + i, count - i);
+			hash = mix(hash ^ word);
+		}
+		total += count;
+	}
+	return mix(hash ^ total);
+}
+
+ResultCache::ResultCache(const std::string& directory, std::uintmax_t budget)
+  : m_directory(directory), m_budget(budget) {
+	std::error_code error;
+	fs::create_directories(directory, error);
+	if(!fs::is_directory(directory)) {
+		throw std::runtime_error("cannot create cache directory " + directory +
+		                         "\n");
+	}
+}
+
+std::string ResultCache::entry(const std::string& key) const {
+	return (fs::path(m_directory) / key).string();
+}
+
+std::string ResultCache::key(const std::string& input,
+                             Method             method,
+                             float              scale,
+                             const std::string& output) const {
+	std::stringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << hash_file(input)
+	   << std::dec << "-" << method_name(method) << "-" << scale << "x"
+	   << fs::path(output).extension().string();
+	return ss.str();
+}
+
+bool ResultCache::fetch(const std::string& key,
+                        const std::string& output) const {
+	const std::string path = entry(key);
+	std::error_code   error;
+	if(!fs::is_regular_file(path, error)) { return false; }
+
+	// Eviction may remove the entry meanwhile, which is then a miss
+	fs::remove(output, error);
+	fs::create_hard_link(path, output, error);
+	if(error) {
+		error.clear();
+		fs::copy_file(path, output, fs::copy_options::overwrite_existing, error);
+		if(error) { return false; }
+	}
+	fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+	return true;
+}
+
+void ResultCache::store(const std::string& key,
+                        const std::string& output) const {
+	const std::string path    = entry(key);
+	const std::string partial = temporary_name(path);
+	std::error_code   error;
+	fs::copy_file(output, partial, error);
+	if(!error) { fs::rename(partial, path, error); }
+	if(error) {
+		fs::remove(partial, error);
+		return;
+	}
+	evict();
+}
+
+void ResultCache::evict() const {
+	struct Entry final {
+		fs::path           path;
+		std::uintmax_t     size;
+		fs::file_time_type used;
+	};
+
+	std::vector<Entry> entries;
+	std::uintmax_t     total = 0;
+	std::error_code    error;
+	for(const auto& file : fs::directory_iterator(m_directory, error)) {
+		if(!file.is_regular_file(error) || temporary(file.path())) { continue; }
+		const std::uintmax_t     size = file.file_size(error);
+		const fs::file_time_type used = file.last_write_time(error);
+		if(error) { continue; }
+		entries.push_back({file.path(), size, used});
+		total += size;
+	}
+	if(total <= m_budget) { return; }
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.used < b.used;
+	});
+	for(const Entry& entry : entries) {
+		if(total <= m_budget) { break; }
+		// Another process evicting at the same time may have got there first
+		fs::remove(entry.path, error);
+		total -= entry.size;
+	}
+}
+
+void replace_output(const std::string& output) {
+	std::error_code error;
+	fs::remove(output, error);
+}
+
+TEST_CASE("Result cache serves, keys and evicts") {
+	const fs::path scratch =
+	  fs::temp_directory_path() / temporary_name("resize-cache-test");
+	const fs::path directory = scratch / "cache";
+	const fs::path input     = scratch / "input.ppm";
+	const fs::path output    = scratch / "output.png";
+
+	auto write = [](const fs::path& path, const std::string& text) {
+		std::ofstream(path, std::ios::binary) << text;
+	};
+	auto read = [](const fs::path& path) {
+		std::ifstream     file(path, std::ios::binary);
+		std::stringstream ss;
+		ss << file.rdbuf();
+		return ss.str();
+	};
+
+	{
+		// Room for one of the 12-byte results below, not two
+		const ResultCache cache(directory.string(), 20);
+		write(input, "source pixels");
+		const std::string key =
+		  cache.key(input.string(), Method::AIS, 2, "a.png");
+		CHECK(key.size() == 16 + std::string("-AIS-2x.png").size());
+		CHECK(key != cache.key(input.string(), Method::AIS, 3, "a.png"));
+		CHECK(key != cache.key(input.string(), Method::AIS, 2, "a.jpg"));
+
+		CHECK(!cache.fetch(key, output.string()));
+		write(output, "resized once");
+		cache.store(key, output.string());
+		fs::remove(output);
+		CHECK(cache.fetch(key, output.string()));
+		CHECK(read(output) == "resized once");
+
+		// The least recently used entry makes way. output is the entry itself,
+		// linked, so it is replaced rather than written into.
+		fs::last_write_time(directory / key,
+		                    fs::file_time_type::clock::now() -
+		                      std::chrono::hours(1));
+		fs::remove(output);
+		write(output, "resized anew");
+		cache.store("other.png", output.string());
+		CHECK(!fs::exists(directory / key));
+		CHECK(fs::exists(directory / "other.png"));
+	}
+	fs::remove_all(scratch);
+}
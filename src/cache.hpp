@@ -0,0 +1,51 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "resize.hpp"
+#include <cstdint>
+#include <string>
+
+// Resize results on disk, keyed by a hash of the input file's bytes, the
+// method, the scale and the output format, so that a repeated request is
+// answered without decoding anything. Entries are written under a temporary
+// name and renamed into place, so any number of threads and processes can
+// share a directory: a reader sees a whole entry or none. The least recently
+// used entries are evicted once the directory outgrows its budget.
+class ResultCache final {
+	private:
+	std::string    m_directory;
+	std::uintmax_t m_budget;
+
+	std::string entry(const std::string& key) const;
+
+	public:
+	// Creates directory if need be. budget is in bytes.
+	ResultCache(const std::string& directory, std::uintmax_t budget);
+
+	// The key of resizing input by method and scale into a file like output
+	std::string key(const std::string& input,
+	                Method             method,
+	                float              scale,
+	                const std::string& output) const;
+
+	// Puts the entry for key at output, as a hard link where the file system
+	// allows and a copy where not, and marks it used. False on a miss. A
+	// linked output is the entry itself: it must be replaced, not written
+	// into, which is what replace_output is for.
+	bool fetch(const std::string& key, const std::string& output) const;
+
+	// Adds output, just written, as the entry for key, then evicts
+	void store(const std::string& key, const std::string& output) const;
+
+	// Removes the least recently used entries until the rest fit the budget
+	void evict() const;
+};
+
+// Removes output ahead of writing a new one, in case it is linked to a cache
+// entry
+void replace_output(const std::string& output);
+
+// A 64-bit hash of a file's bytes, 8 at a time
+std::uint64_t hash_file(const std::string& filename);
+
+#endif
@@ -0,0 +1,52 @@
+#include "cpu.hpp"
+
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86_BUILTINS 1
+#else
+#define CPU_X86_BUILTINS 0
+#endif
+
+SimdLevel detect_simd() {
+#if CPU_X86_BUILTINS
+	// The builtins also check that the OS saves the wider register state
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+		return SimdLevel::avx512;
+	}
+	if(__builtin_cpu_supports("avx2")) { return SimdLevel::avx2; }
+	if(__builtin_cpu_supports("sse4.1")) { return SimdLevel::sse41; }
+#endif
+	return SimdLevel::scalar;
+}
+
+bool simd_supported(SimdLevel level) {
+	return static_cast<int>(level) <= static_cast<int>(detect_simd());
+}
+
+const char* simd_name(SimdLevel level) {
+	switch(level) {
+		case SimdLevel::scalar: return "scalar";
+		case SimdLevel::sse41: return "sse4.1";
+		case SimdLevel::avx2: return "avx2";
+		case SimdLevel::avx512: return "avx512";
+		default: return "unknown";
+	}
+}
+
+SimdLevel parse_simd(const std::string& name) {
+	if(name == "auto") { return detect_simd(); }
+	for(SimdLevel level : {SimdLevel::scalar,
+	                       SimdLevel::sse41,
+	                       SimdLevel::avx2,
+	                       SimdLevel::avx512}) {
+		if(name == simd_name(level)) {
+			if(!simd_supported(level)) {
+				throw std::runtime_error(name + " is not supported by this CPU\n");
+			}
+			return level;
+		}
+	}
+	throw std::runtime_error("unknown instruction set " + name + "\n");
+}
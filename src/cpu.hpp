@@ -0,0 +1,19 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <string>
+
+// Instruction set levels that have dedicated kernels, in ascending order
+enum class SimdLevel { scalar, sse41, avx2, avx512 };
+
+// The highest level the running CPU (and OS) supports
+SimdLevel detect_simd();
+
+bool simd_supported(SimdLevel level);
+
+const char* simd_name(SimdLevel level);
+
+// Parses "scalar", "sse4.1", "avx2", "avx512" or "auto"
+SimdLevel parse_simd(const std::string& name);
+
+#endif
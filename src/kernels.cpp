@@ -0,0 +1,309 @@
+#include "kernels.hpp"
+
+#include "cpu.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <doctest\doctest.h>
+
+void blend_rows_scalar(const uint16_t* upper,
+                       const uint16_t* lower,
+                       unsigned int    weight,
+                       uint8_t*        out,
+                       std::size_t     count) {
+	const unsigned int complement = (1u << BILINEAR_BITS) - weight;
+	for(std::size_t i = 0; i < count; ++i) {
+		out[i] = (upper[i] * complement + lower[i] * weight) >> (2 * BILINEAR_BITS);
+	}
+}
+
+void imddt_row_scalar(const ImddtSpan& span, uint8_t* out, std::size_t count) {
+	const int half  = 1 << IMDDT_BITS;
+	const int whole = 2 * half;
+	const int dy    = span.distance_y;
+	for(std::size_t i = 0; i < count; ++i) {
+		const int pixel_1 = span.pixel_1[i];
+		const int pixel_2 = span.pixel_2[i];
+		const int pixel_3 = span.pixel_3[i];
+		const int pixel_4 = span.pixel_4[i];
+		const int dx      = span.distance_x[i];
+
+		int weight_1 = 0;
+		int weight_2 = 0;
+		int weight_3 = 0;
+		int weight_4 = 0;
+		if(span.geometry[i] & IMDDT_ASCENDING) {
+			if(span.geometry[i] & IMDDT_DY_GT_DX) {
+				weight_1 = half - dy;
+				weight_4 = dx;
+				weight_3 = whole - weight_1 - weight_4;
+			} else {
+				weight_1 = half - dx;
+				weight_4 = dy;
+				weight_2 = whole - weight_1 - weight_4;
+			}
+		} else {
+			if(span.geometry[i] & IMDDT_DX_DY_LT_1) {
+				weight_2 = dx;
+				weight_3 = dy;
+				weight_1 = whole - weight_2 - weight_3;
+			} else {
+				weight_2 = half - dy;
+				weight_3 = half - dx;
+				weight_4 = whole - weight_2 - weight_3;
+			}
+		}
+		out[i] = (weight_1 * pixel_1 + weight_2 * pixel_2 + weight_3 * pixel_3 +
+		          weight_4 * pixel_4) >>
+		         (IMDDT_BITS + 1);
+	}
+}
+
+void imddt_diagonals_scalar(const uint8_t* upper,
+                            const uint8_t* lower,
+                            uint8_t*       out,
+                            std::size_t    count) {
+	for(std::size_t x = 0; x < count; ++x) {
+		const int across = lower[x] - upper[x + 1];
+		const int along  = upper[x] - lower[x + 1];
+		out[x] = std::abs(across) > std::abs(along) ? IMDDT_ASCENDING : 0;
+	}
+}
+
+// Same double arithmetic as the per-pixel AIS solvers, so AIS_cubic with the
+// scalar kernels reproduces AIS_cubic_reference byte for byte
+void ais_row_scalar(const AisSpan& span, uint8_t* out, std::size_t count) {
+	auto cubic = [](const uint8_t* const* line, std::size_t i) {
+		return -(1.0 / 16.0) * line[0][i] + (9.0 / 16.0) * line[1][i] +
+		       (9.0 / 16.0) * line[2][i] - (1.0 / 16.0) * line[3][i];
+	};
+
+	for(std::size_t i = 0; i < count; ++i) {
+		const int difference = span.gradient_1[i] - span.gradient_2[i];
+
+		double result = 0;
+		if(difference > AIS_THRESHOLD) {
+			result = cubic(span.line_a, i);
+		} else if(-difference > AIS_THRESHOLD) {
+			result = cubic(span.line_b, i);
+		} else {
+			double weight[4];
+			for(int k = 0; k < 4; ++k) {
+				weight[k] = 0.25 / (span.smoothness[k][i] + 1);
+			}
+			const double weight_sum = weight[0] + weight[1] + weight[2] + weight[3];
+			result = (weight[0] / weight_sum) * span.near[0][i] +
+			         (weight[1] / weight_sum) * span.near[1][i] +
+			         (weight[2] / weight_sum) * span.near[2][i] +
+			         (weight[3] / weight_sum) * span.near[3][i];
+		}
+
+		if(result > 255) {
+			out[i] = 255;
+		} else if(result < 0) {
+			out[i] = 0;
+		} else {
+			out[i] = result;
+		}
+	}
+}
+
+void filter_row_scalar(const FilterSpan& span,
+                       uint8_t*          out,
+                       std::size_t       count) {
+	constexpr unsigned int shift = FILTER_BITS + FILTER_INTERMEDIATE_BITS;
+	for(std::size_t i = 0; i < count; ++i) {
+		int32_t sum = 1 << (shift - 1);
+		for(unsigned int k = 0; k < span.taps; ++k) {
+			sum += span.weights[k] * span.rows[k][i];
+		}
+		sum    = sum >> shift;
+		out[i] = sum < 0 ? 0 : sum > 255 ? 255 : sum;
+	}
+}
+
+void box_row_scalar(const uint8_t* upper,
+                    const uint8_t* lower,
+                    unsigned int   channels,
+                    uint8_t*       out,
+                    std::size_t    count) {
+	for(std::size_t x = 0; x < count; ++x) {
+		for(unsigned int channel = 0; channel < channels; ++channel) {
+			const std::size_t i = 2 * x * channels + channel;
+			const int         sum =
+			  upper[i] + upper[i + channels] + lower[i] + lower[i + channels];
+			out[x * channels + channel] = (sum + 2) >> 2;
+		}
+	}
+}
+
+void average_rows_scalar(const uint8_t* upper,
+                         const uint8_t* lower,
+                         uint8_t*       out,
+                         std::size_t    count) {
+	for(std::size_t i = 0; i < count; ++i) {
+		out[i] = (upper[i] + lower[i] + 1) >> 1;
+	}
+}
+
+const Kernels kernels_scalar = {blend_rows_scalar,
+                                imddt_row_scalar,
+                                imddt_diagonals_scalar,
+                                ais_row_scalar,
+                                filter_row_scalar,
+                                box_row_scalar,
+                                average_rows_scalar};
+
+namespace {
+	std::atomic<const Kernels*> g_selected(nullptr);
+} // namespace
+
+const Kernels& kernels_for(SimdLevel level) {
+	switch(level) {
+		case SimdLevel::avx512: return kernels_avx512;
+		case SimdLevel::avx2: return kernels_avx2;
+		case SimdLevel::sse41: return kernels_sse41;
+		case SimdLevel::scalar: return kernels_scalar;
+		default: return kernels_scalar;
+	}
+}
+
+const Kernels& kernels() {
+	const Kernels* selected = g_selected;
+	if(!selected) {
+		selected   = &kernels_for(detect_simd());
+		g_selected = selected;
+	}
+	return *selected;
+}
+
+void select_kernels(SimdLevel level) { g_selected = &kernels_for(level); }
+
+// Unit Tests
+// ----------
+
+TEST_CASE("Vector kernels match the scalar kernels") {
+	std::mt19937                       rng(3);
+	std::uniform_int_distribution<int> byte(0, 255);
+	std::uniform_int_distribution<int> distance(0, 1 << IMDDT_BITS);
+
+	// Odd length so every variant also runs its tail loop
+	const std::size_t     count = 1000 + 37;
+	std::vector<uint16_t> upper(count);
+	std::vector<uint16_t> lower(count);
+	std::vector<uint8_t>  pixels[4];
+	std::vector<uint8_t>  distance_x(count);
+	std::vector<uint8_t>  geometry(count);
+	for(auto& plane : pixels) { plane.resize(count); }
+	for(std::size_t i = 0; i < count; ++i) {
+		upper[i] = byte(rng) * 256;
+		lower[i] = byte(rng) * 256;
+		for(auto& plane : pixels) { plane[i] = byte(rng); }
+		distance_x[i] = distance(rng);
+		geometry[i]   = byte(rng) & 7;
+	}
+	const ImddtSpan span = {pixels[0].data(),
+	                        pixels[1].data(),
+	                        pixels[2].data(),
+	                        pixels[3].data(),
+	                        distance_x.data(),
+	                        geometry.data(),
+	                        45};
+
+	// Gradients spread so about a third of the lanes take each AIS path
+	std::uniform_int_distribution<int> gradient(0, 300);
+	std::vector<int16_t>               gradients[6];
+	for(auto& plane : gradients) {
+		plane.resize(count);
+		for(auto& entry : plane) { entry = gradient(rng); }
+	}
+	const AisSpan ais = {
+	  {pixels[0].data(), pixels[1].data(), pixels[2].data(), pixels[3].data()},
+	  {pixels[3].data(), pixels[2].data(), pixels[0].data(), pixels[1].data()},
+	  {pixels[1].data(), pixels[2].data(), pixels[0].data(), pixels[3].data()},
+	  gradients[0].data(),
+	  gradients[1].data(),
+	  {gradients[2].data(),
+	   gradients[3].data(),
+	   gradients[4].data(),
+	   gradients[5].data()}};
+
+	// Intermediate rows as a filter with negative lobes leaves them, and an
+	// odd number of taps so the pairing has one left over
+	std::uniform_int_distribution<int> intermediate(-2000, 20000);
+	std::vector<int16_t>               filtered[5];
+	const int16_t*                     filtered_rows[5];
+	for(int k = 0; k < 5; ++k) {
+		filtered[k].resize(count);
+		for(auto& entry : filtered[k]) { entry = intermediate(rng); }
+		filtered_rows[k] = filtered[k].data();
+	}
+	const int16_t    filter_weights[5] = {-900, 3000, 12000, 3184, -900};
+	const FilterSpan filter            = {filtered_rows, filter_weights, 5};
+
+	std::vector<uint8_t> expected(count);
+	std::vector<uint8_t> actual(count);
+	for(SimdLevel level :
+	    {SimdLevel::sse41, SimdLevel::avx2, SimdLevel::avx512}) {
+		if(!simd_supported(level)) { continue; }
+		const Kernels& candidate = kernels_for(level);
+
+		for(unsigned int weight : {0u, 1u, 77u, 128u, 255u, 256u}) {
+			blend_rows_scalar(
+			  upper.data(), lower.data(), weight, expected.data(), count);
+			candidate.blend_rows(
+			  upper.data(), lower.data(), weight, actual.data(), count);
+			CHECK(expected == actual);
+		}
+
+		imddt_row_scalar(span, expected.data(), count);
+		candidate.imddt_row(span, actual.data(), count);
+		CHECK(expected == actual);
+
+		imddt_diagonals_scalar(
+		  pixels[0].data(), pixels[1].data(), expected.data(), count - 1);
+		candidate.imddt_diagonals(
+		  pixels[0].data(), pixels[1].data(), actual.data(), count - 1);
+		CHECK(expected == actual);
+
+		ais_row_scalar(ais, expected.data(), count);
+		candidate.ais_row(ais, actual.data(), count);
+		CHECK(expected == actual);
+
+		// Equal neighbours, whose average the double-precision weights may
+		// round to one level below them
+		std::vector<uint8_t> same(count, 24);
+		AisSpan              flat = ais;
+		for(auto& near : flat.near) { near = same.data(); }
+		ais_row_scalar(flat, expected.data(), count);
+		candidate.ais_row(flat, actual.data(), count);
+		CHECK(expected == actual);
+
+		for(std::size_t length : {count, std::size_t{5}}) {
+			filter_row_scalar(filter, expected.data(), length);
+			candidate.filter_row(filter, actual.data(), length);
+			CHECK(expected == actual);
+		}
+
+		// Pixels 2x and 2x + 1 of the planes, as rows of every channel count
+		for(unsigned int channels = 1; channels <= 9; ++channels) {
+			const std::size_t width  = count / 2 / channels;
+			const std::size_t values = width * channels;
+			std::fill(actual.begin(), actual.end(), 0);
+			box_row_scalar(
+			  pixels[0].data(), pixels[1].data(), channels, expected.data(), width);
+			candidate.box_row(
+			  pixels[0].data(), pixels[1].data(), channels, actual.data(), width);
+			CHECK(std::equal(
+			  expected.begin(), expected.begin() + values, actual.begin()));
+		}
+		average_rows_scalar(
+		  pixels[2].data(), pixels[3].data(), expected.data(), count);
+		candidate.average_rows(
+		  pixels[2].data(), pixels[3].data(), actual.data(), count);
+		CHECK(expected == actual);
+	}
+}
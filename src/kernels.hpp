@@ -0,0 +1,154 @@
+// Fixed-point row kernels with one implementation per instruction set. The
+// SSE4.1, AVX2 and AVX-512 variants live in their own translation units,
+// compiled with the matching -m flags, and are picked at runtime, so a
+// binary built for baseline x86-64 still uses the widest unit available.
+//
+// This header is included by those translation units: keep it free of
+// standard library templates, or their wide-instruction instantiations can
+// be chosen by the linker for callers running on older CPUs.
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class SimdLevel; // cpu.hpp
+
+// Fractional bits of the bilinear weights (one source axis each)
+constexpr unsigned int BILINEAR_BITS = 8;
+
+// Fractional bits of the IMDDT distances. The weights are built from half
+// distances, so they carry one bit more and sum to 256.
+constexpr unsigned int IMDDT_BITS = 7;
+
+// Which triangle of a source cell an IMDDT sample falls into, decided on the
+// exact distances so the fixed-point kernels never flip triangles, and which
+// diagonal splits the cell, decided once for all of its channels
+enum ImddtGeometry : uint8_t {
+	IMDDT_DY_GT_DX   = 1, // distance_y > distance_x
+	IMDDT_DX_DY_LT_1 = 2, // distance_x + distance_y < 1
+	IMDDT_ASCENDING  = 4  // split between pixels 1 and 4, else 2 and 3
+};
+
+// One output row of IMDDT, one entry per interleaved channel value
+struct ImddtSpan final {
+	const uint8_t* pixel_1;
+	const uint8_t* pixel_2;
+	const uint8_t* pixel_3;
+	const uint8_t* pixel_4;
+	const uint8_t* distance_x; // IMDDT_BITS fixed-point
+	const uint8_t* geometry;   // ImddtGeometry flags
+	unsigned int   distance_y; // IMDDT_BITS fixed-point
+};
+
+// Fractional bits of the separable filter weights, which sum to one, and of
+// the pixel values kept between the horizontal and the vertical pass
+constexpr unsigned int FILTER_BITS              = 14;
+constexpr unsigned int FILTER_INTERMEDIATE_BITS = 6;
+
+// One output row of the vertical pass of a separable filter: the weighted sum
+// of `taps` horizontally filtered rows, one entry per interleaved channel
+// value
+struct FilterSpan final {
+	const int16_t* const* rows;
+	const int16_t*        weights; // FILTER_BITS fixed-point
+	unsigned int          taps;
+};
+
+// Gradient difference above which AIS treats an edge as strong
+constexpr int AIS_THRESHOLD = 100;
+
+// One row of AIS pixels (either stage), one entry per interleaved channel
+// value. The result is the cubic through line_a when gradient_1 exceeds
+// gradient_2 by more than AIS_THRESHOLD, the cubic through line_b in the
+// opposite case, and otherwise the average of near[k] weighted by
+// 1 / (smoothness[k] + 1), in double precision.
+struct AisSpan final {
+	const uint8_t* line_a[4];
+	const uint8_t* line_b[4];
+	const uint8_t* near[4]; // usually the inner pixels of both lines
+	const int16_t* gradient_1;
+	const int16_t* gradient_2;
+	const int16_t* smoothness[4];
+};
+
+struct Kernels final {
+	// Vertical bilinear pass over two horizontally interpolated rows:
+	// out[i] = (upper[i] * (256 - weight) + lower[i] * weight) >> 16
+	void (*blend_rows)(const uint16_t* upper,
+	                   const uint16_t* lower,
+	                   unsigned int    weight,
+	                   uint8_t*        out,
+	                   std::size_t     count);
+
+	void (*imddt_row)(const ImddtSpan& span, uint8_t* out, std::size_t count);
+
+	// The diagonal of count IMDDT cells in a row, from the luma of the source
+	// row above them and the row below, count + 1 values each:
+	// out[x] = IMDDT_ASCENDING if |lower[x] - upper[x + 1]| exceeds
+	// |upper[x] - lower[x + 1]|, otherwise 0
+	void (*imddt_diagonals)(const uint8_t* upper,
+	                        const uint8_t* lower,
+	                        uint8_t*       out,
+	                        std::size_t    count);
+
+	// Branch-free in the vector variants, which select between all three
+	// results per lane. Exact in every variant: weak edges take the scalar
+	// kernel's double-precision operations in the same order.
+	void (*ais_row)(const AisSpan& span, uint8_t* out, std::size_t count);
+
+	// Exact in every variant: 16-bit products summed in 32 bits, rounded
+	void (*filter_row)(const FilterSpan& span, uint8_t* out, std::size_t count);
+
+	// Halves two rows into one: count pixels of `channels` values, each the
+	// rounded average of the 2x2 box of pixels 2x and 2x + 1 of both rows
+	void (*box_row)(const uint8_t* upper,
+	                const uint8_t* lower,
+	                unsigned int   channels,
+	                uint8_t*       out,
+	                std::size_t    count);
+
+	// out[i] = (upper[i] + lower[i] + 1) >> 1
+	void (*average_rows)(const uint8_t* upper,
+	                     const uint8_t* lower,
+	                     uint8_t*       out,
+	                     std::size_t    count);
+};
+
+// The kernels for the selected (by default, the detected) instruction set
+const Kernels& kernels();
+void           select_kernels(SimdLevel level);
+const Kernels& kernels_for(SimdLevel level);
+
+// Scalar reference kernels, also used for the tails of the vector loops
+void blend_rows_scalar(const uint16_t* upper,
+                       const uint16_t* lower,
+                       unsigned int    weight,
+                       uint8_t*        out,
+                       std::size_t     count);
+void imddt_row_scalar(const ImddtSpan& span, uint8_t* out, std::size_t count);
+void imddt_diagonals_scalar(const uint8_t* upper,
+                            const uint8_t* lower,
+                            uint8_t*       out,
+                            std::size_t    count);
+void ais_row_scalar(const AisSpan& span, uint8_t* out, std::size_t count);
+void filter_row_scalar(const FilterSpan& span,
+                       uint8_t*          out,
+                       std::size_t       count);
+void box_row_scalar(const uint8_t* upper,
+                    const uint8_t* lower,
+                    unsigned int   channels,
+                    uint8_t*       out,
+                    std::size_t    count);
+void average_rows_scalar(const uint8_t* upper,
+                         const uint8_t* lower,
+                         uint8_t*       out,
+                         std::size_t    count);
+
+extern const Kernels kernels_scalar;
+extern const Kernels kernels_sse41;
+extern const Kernels kernels_avx2;
+extern const Kernels kernels_avx512;
+
+#endif
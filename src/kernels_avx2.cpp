@@ -0,0 +1,383 @@
+// Compiled with -mavx2; only called after detect_simd() has seen AVX2
+
+#include "kernels.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace {
+	inline __m128i pack_words(__m256i words) {
+		return _mm_packus_epi16(_mm256_castsi256_si128(words),
+		                        _mm256_extracti128_si256(words, 1));
+	}
+
+	void blend_rows(const uint16_t* upper,
+	                const uint16_t* lower,
+	                unsigned int    weight,
+	                uint8_t*        out,
+	                std::size_t     count) {
+		const __m256i weight_upper =
+		  _mm256_set1_epi32((1 << BILINEAR_BITS) - weight);
+		const __m256i weight_lower = _mm256_set1_epi32(weight);
+
+		std::size_t i = 0;
+		for(; i + 16 <= count; i += 16) {
+			const __m256i u =
+			  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(upper + i));
+			const __m256i l =
+			  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lower + i));
+
+			const __m256i u_lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(u));
+			const __m256i l_lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(l));
+			const __m256i u_hi =
+			  _mm256_cvtepu16_epi32(_mm256_extracti128_si256(u, 1));
+			const __m256i l_hi =
+			  _mm256_cvtepu16_epi32(_mm256_extracti128_si256(l, 1));
+
+			const __m256i sum_lo =
+			  _mm256_add_epi32(_mm256_mullo_epi32(u_lo, weight_upper),
+			                   _mm256_mullo_epi32(l_lo, weight_lower));
+			const __m256i sum_hi =
+			  _mm256_add_epi32(_mm256_mullo_epi32(u_hi, weight_upper),
+			                   _mm256_mullo_epi32(l_hi, weight_lower));
+
+			// packus works within 128-bit lanes; the permute restores the order
+			const __m256i words = _mm256_permute4x64_epi64(
+			  _mm256_packus_epi32(_mm256_srli_epi32(sum_lo, 2 * BILINEAR_BITS),
+			                      _mm256_srli_epi32(sum_hi, 2 * BILINEAR_BITS)),
+			  0xD8);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), pack_words(words));
+		}
+		blend_rows_scalar(upper + i, lower + i, weight, out + i, count - i);
+	}
+
+	inline __m256i load_bytes(const uint8_t* source) {
+		return _mm256_cvtepu8_epi16(
+		  _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)));
+	}
+
+	void imddt_row(const ImddtSpan& span, uint8_t* out, std::size_t count) {
+		const __m256i half       = _mm256_set1_epi16(1 << IMDDT_BITS);
+		const __m256i whole      = _mm256_set1_epi16(2 << IMDDT_BITS);
+		const __m256i dy         = _mm256_set1_epi16(span.distance_y);
+		const __m256i dy_gt_dx   = _mm256_set1_epi16(IMDDT_DY_GT_DX);
+		const __m256i dx_dy_lt_1 = _mm256_set1_epi16(IMDDT_DX_DY_LT_1);
+		const __m256i diagonal   = _mm256_set1_epi16(IMDDT_ASCENDING);
+
+		std::size_t i = 0;
+		for(; i + 16 <= count; i += 16) {
+			const __m256i pixel_1  = load_bytes(span.pixel_1 + i);
+			const __m256i pixel_2  = load_bytes(span.pixel_2 + i);
+			const __m256i pixel_3  = load_bytes(span.pixel_3 + i);
+			const __m256i pixel_4  = load_bytes(span.pixel_4 + i);
+			const __m256i dx       = load_bytes(span.distance_x + i);
+			const __m256i geometry = load_bytes(span.geometry + i);
+
+			const __m256i ascending =
+			  _mm256_cmpeq_epi16(_mm256_and_si256(geometry, diagonal), diagonal);
+			const __m256i lower_left =
+			  _mm256_cmpeq_epi16(_mm256_and_si256(geometry, dy_gt_dx), dy_gt_dx);
+			const __m256i upper_left = _mm256_cmpeq_epi16(
+			  _mm256_and_si256(geometry, dx_dy_lt_1), dx_dy_lt_1);
+
+			// Split along the ascending diagonal: pixels 1 and 4 in both triangles
+			const __m256i a_weight_1 = _mm256_blendv_epi8(
+			  _mm256_sub_epi16(half, dx), _mm256_sub_epi16(half, dy), lower_left);
+			const __m256i a_weight_4 = _mm256_blendv_epi8(dy, dx, lower_left);
+			const __m256i a_rest =
+			  _mm256_sub_epi16(_mm256_sub_epi16(whole, a_weight_1), a_weight_4);
+
+			// Split along the descending diagonal: pixels 2 and 3 in both triangles
+			const __m256i d_weight_2 =
+			  _mm256_blendv_epi8(_mm256_sub_epi16(half, dy), dx, upper_left);
+			const __m256i d_weight_3 =
+			  _mm256_blendv_epi8(_mm256_sub_epi16(half, dx), dy, upper_left);
+			const __m256i d_rest =
+			  _mm256_sub_epi16(_mm256_sub_epi16(whole, d_weight_2), d_weight_3);
+
+			const __m256i weight_1 = _mm256_blendv_epi8(
+			  _mm256_and_si256(d_rest, upper_left), a_weight_1, ascending);
+			const __m256i weight_2 = _mm256_blendv_epi8(
+			  d_weight_2, _mm256_andnot_si256(lower_left, a_rest), ascending);
+			const __m256i weight_3 = _mm256_blendv_epi8(
+			  d_weight_3, _mm256_and_si256(a_rest, lower_left), ascending);
+			const __m256i weight_4 = _mm256_blendv_epi8(
+			  _mm256_andnot_si256(upper_left, d_rest), a_weight_4, ascending);
+
+			const __m256i sum = _mm256_add_epi16(
+			  _mm256_add_epi16(_mm256_mullo_epi16(weight_1, pixel_1),
+			                   _mm256_mullo_epi16(weight_2, pixel_2)),
+			  _mm256_add_epi16(_mm256_mullo_epi16(weight_3, pixel_3),
+			                   _mm256_mullo_epi16(weight_4, pixel_4)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+			                 pack_words(_mm256_srli_epi16(sum, IMDDT_BITS + 1)));
+		}
+
+		ImddtSpan tail = span;
+		tail.pixel_1 += i;
+		tail.pixel_2 += i;
+		tail.pixel_3 += i;
+		tail.pixel_4 += i;
+		tail.distance_x += i;
+		tail.geometry += i;
+		imddt_row_scalar(tail, out + i, count - i);
+	}
+
+	inline __m256i load_block(const uint8_t* source) {
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+	}
+
+	// Unsigned bytes have no abs of a difference, but one of the two saturated
+	// differences is it and the other zero
+	inline __m256i difference(__m256i a, __m256i b) {
+		return _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+	}
+
+	void imddt_diagonals(const uint8_t* upper,
+	                     const uint8_t* lower,
+	                     uint8_t*       out,
+	                     std::size_t    count) {
+		const __m256i ascending = _mm256_set1_epi8(IMDDT_ASCENDING);
+
+		std::size_t x = 0;
+		for(; x + 32 <= count; x += 32) {
+			const __m256i across =
+			  difference(load_block(lower + x), load_block(upper + x + 1));
+			const __m256i along =
+			  difference(load_block(upper + x), load_block(lower + x + 1));
+			const __m256i not_greater = _mm256_cmpeq_epi8(
+			  _mm256_subs_epu8(across, along), _mm256_setzero_si256());
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x),
+			                    _mm256_andnot_si256(not_greater, ascending));
+		}
+		imddt_diagonals_scalar(upper + x, lower + x, out + x, count - x);
+	}
+
+	// AIS works on 32-bit lanes, eight at a time
+	inline __m256i load_lanes(const uint8_t* source) {
+		return _mm256_cvtepu8_epi32(
+		  _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)));
+	}
+
+	inline __m256i load_lanes(const int16_t* source) {
+		return _mm256_cvtepi16_epi32(
+		  _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)));
+	}
+
+	// (9 * (p2 + p3) - p1 - p4) / 16, saturated, which is exact
+	inline __m256i cubic(const uint8_t* const* line, std::size_t i) {
+		const __m256i inner =
+		  _mm256_add_epi32(load_lanes(line[1] + i), load_lanes(line[2] + i));
+		const __m256i outer =
+		  _mm256_add_epi32(load_lanes(line[0] + i), load_lanes(line[3] + i));
+		const __m256i sum =
+		  _mm256_sub_epi32(_mm256_mullo_epi32(inner, _mm256_set1_epi32(9)), outer);
+		return _mm256_min_epi32(
+		  _mm256_srai_epi32(_mm256_max_epi32(sum, _mm256_setzero_si256()), 4),
+		  _mm256_set1_epi32(255));
+	}
+
+	// The weak edge of four lanes, from their near pixels and smoothness + 1:
+	// the scalar kernel's double operations in the same order, so that every
+	// variant rounds alike
+	inline __m128i weak_average(const __m256d (&near)[4], const __m256d (&d)[4]) {
+		__m256d weight[4];
+		for(int k = 0; k < 4; ++k) {
+			weight[k] = _mm256_div_pd(_mm256_set1_pd(0.25), d[k]);
+		}
+		const __m256d weight_sum = _mm256_add_pd(
+		  _mm256_add_pd(_mm256_add_pd(weight[0], weight[1]), weight[2]), weight[3]);
+		__m256d result = _mm256_setzero_pd();
+		for(int k = 0; k < 4; ++k) {
+			result = _mm256_add_pd(
+			  result, _mm256_mul_pd(_mm256_div_pd(weight[k], weight_sum), near[k]));
+		}
+		return _mm256_cvttpd_epi32(result);
+	}
+
+	void ais_row(const AisSpan& span, uint8_t* out, std::size_t count) {
+		const __m256i one                = _mm256_set1_epi32(1);
+		const __m256i threshold          = _mm256_set1_epi32(AIS_THRESHOLD);
+		const __m256i negative_threshold = _mm256_set1_epi32(-AIS_THRESHOLD);
+
+		std::size_t i = 0;
+		for(; i + 8 <= count; i += 8) {
+			const __m256i difference = _mm256_sub_epi32(
+			  load_lanes(span.gradient_1 + i), load_lanes(span.gradient_2 + i));
+			const __m256i strong_a = _mm256_cmpgt_epi32(difference, threshold);
+			const __m256i strong_b =
+			  _mm256_cmpgt_epi32(negative_threshold, difference);
+
+			// Weak edge, four lanes at a time
+			__m256d near[2][4];
+			__m256d d[2][4];
+			for(int k = 0; k < 4; ++k) {
+				const __m256i pixel = load_lanes(span.near[k] + i);
+				const __m256i smoothness =
+				  _mm256_add_epi32(load_lanes(span.smoothness[k] + i), one);
+				near[0][k] = _mm256_cvtepi32_pd(_mm256_castsi256_si128(pixel));
+				near[1][k] = _mm256_cvtepi32_pd(_mm256_extracti128_si256(pixel, 1));
+				d[0][k]    = _mm256_cvtepi32_pd(_mm256_castsi256_si128(smoothness));
+				d[1][k] =
+				  _mm256_cvtepi32_pd(_mm256_extracti128_si256(smoothness, 1));
+			}
+			const __m256i weak = _mm256_set_m128i(weak_average(near[1], d[1]),
+			                                      weak_average(near[0], d[0]));
+
+			const __m256i result = _mm256_blendv_epi8(
+			  _mm256_blendv_epi8(weak, cubic(span.line_a, i), strong_a),
+			  cubic(span.line_b, i),
+			  strong_b);
+			const __m128i words =
+			  _mm_packus_epi32(_mm256_castsi256_si128(result),
+			                   _mm256_extracti128_si256(result, 1));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+			                 _mm_packus_epi16(words, words));
+		}
+
+		AisSpan tail = span;
+		for(int k = 0; k < 4; ++k) {
+			tail.line_a[k] += i;
+			tail.line_b[k] += i;
+			tail.near[k] += i;
+			tail.smoothness[k] += i;
+		}
+		tail.gradient_1 += i;
+		tail.gradient_2 += i;
+		ais_row_scalar(tail, out + i, count - i);
+	}
+	inline __m256i load_words(const int16_t* source) {
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+	}
+
+	// Weights k and k + 1, zero past the last, paired for madd
+	inline int weight_pair(const FilterSpan& span, unsigned int k) {
+		const unsigned int second =
+		  k + 1 < span.taps ? static_cast<uint16_t>(span.weights[k + 1]) : 0;
+		return static_cast<int>(static_cast<uint16_t>(span.weights[k]) |
+		                        second << 16);
+	}
+
+	void filter_row(const FilterSpan& span, uint8_t* out, std::size_t count) {
+		constexpr int shift = FILTER_BITS + FILTER_INTERMEDIATE_BITS;
+		if(count < 16) {
+			filter_row_scalar(span, out, count);
+			return;
+		}
+
+		// The last block steps back to end at count, redoing a few values
+		for(std::size_t i = 0; i < count; i += 16) {
+			const std::size_t at = i + 16 <= count ? i : count - 16;
+			__m256i sum_lo = _mm256_set1_epi32(1 << (shift - 1));
+			__m256i sum_hi = sum_lo;
+			for(unsigned int k = 0; k < span.taps; k += 2) {
+				const __m256i a = load_words(span.rows[k] + at);
+				const __m256i b = k + 1 < span.taps ?
+				                    load_words(span.rows[k + 1] + at) :
+				                    _mm256_setzero_si256();
+				const __m256i weights = _mm256_set1_epi32(weight_pair(span, k));
+
+				const __m256i lo =
+				  _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights);
+				const __m256i hi =
+				  _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights);
+				sum_lo = _mm256_add_epi32(sum_lo, lo);
+				sum_hi = _mm256_add_epi32(sum_hi, hi);
+			}
+			// Unpacking and packing both work within 128-bit lanes, which leaves
+			// the words in order
+			const __m256i words =
+			  _mm256_packs_epi32(_mm256_srai_epi32(sum_lo, shift),
+			                     _mm256_srai_epi32(sum_hi, shift));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + at), pack_words(words));
+		}
+	}
+
+	// Shuffles 16 bytes into the pairs box_row adds, as in kernels_sse41.cpp,
+	// in both lanes
+	inline __m256i box_pairs(unsigned int channels, unsigned int block) {
+		alignas(16) int8_t mask[16];
+		for(unsigned int j = 0; j < 8; ++j) {
+			const int first = 2 * (j / channels) * channels + j % channels;
+			mask[2 * j]     = j < block ? first : -1;
+			mask[2 * j + 1] = j < block ? first + channels : -1;
+		}
+		return _mm256_broadcastsi128_si256(
+		  _mm_load_si128(reinterpret_cast<const __m128i*>(mask)));
+	}
+
+	// Two blocks, 2 * block values apart, one per lane
+	inline __m256i load_blocks(const uint8_t* source, unsigned int block) {
+		return _mm256_inserti128_si256(
+		  _mm256_castsi128_si256(
+		    _mm_loadu_si128(reinterpret_cast<const __m128i*>(source))),
+		  _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 2 * block)),
+		  1);
+	}
+
+	void box_row(const uint8_t* upper,
+	             const uint8_t* lower,
+	             unsigned int   channels,
+	             uint8_t*       out,
+	             std::size_t    count) {
+		const std::size_t values = count * channels;
+		std::size_t       i      = 0;
+		if(channels <= 8) {
+			// Whole pixels per block, whose 8 bytes of output overlap the next
+			const unsigned int block = 8 / channels * channels;
+			const __m256i      pairs = box_pairs(channels, block);
+			const __m256i      ones  = _mm256_set1_epi8(1);
+			const __m256i      two   = _mm256_set1_epi16(2);
+			for(; i + block + 8 <= values; i += 2 * block) {
+				const __m256i u = load_blocks(upper + 2 * i, block);
+				const __m256i l = load_blocks(lower + 2 * i, block);
+				const __m256i sum_u =
+				  _mm256_maddubs_epi16(_mm256_shuffle_epi8(u, pairs), ones);
+				const __m256i sum_l =
+				  _mm256_maddubs_epi16(_mm256_shuffle_epi8(l, pairs), ones);
+				const __m256i words = _mm256_srli_epi16(
+				  _mm256_add_epi16(_mm256_add_epi16(sum_u, sum_l), two), 2);
+				const __m256i bytes = _mm256_packus_epi16(words, words);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+				                 _mm256_castsi256_si128(bytes));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i + block),
+				                 _mm256_extracti128_si256(bytes, 1));
+			}
+		}
+		box_row_scalar(
+		  upper + 2 * i, lower + 2 * i, channels, out + i, (values - i) / channels);
+	}
+
+	void average_rows(const uint8_t* upper,
+	                  const uint8_t* lower,
+	                  uint8_t*       out,
+	                  std::size_t    count) {
+		std::size_t i = 0;
+		for(; i + 32 <= count; i += 32) {
+			const __m256i u =
+			  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(upper + i));
+			const __m256i l =
+			  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lower + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+			                    _mm256_avg_epu8(u, l));
+		}
+		average_rows_scalar(upper + i, lower + i, out + i, count - i);
+	}
+} // namespace
+
+const Kernels kernels_avx2 = {blend_rows,
+                              imddt_row,
+                              imddt_diagonals,
+                              ais_row,
+                              filter_row,
+                              box_row,
+                              average_rows};
+#else
+const Kernels kernels_avx2 = {blend_rows_scalar,
+                              imddt_row_scalar,
+                              imddt_diagonals_scalar,
+                              ais_row_scalar,
+                              filter_row_scalar,
+                              box_row_scalar,
+                              average_rows_scalar};
+#endif
@@ -0,0 +1,368 @@
+// Compiled with -mavx512f -mavx512bw; only called after detect_simd() has
+// seen both extensions
+
+#include "kernels.hpp"
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#include <immintrin.h>
+
+namespace {
+	void blend_rows(const uint16_t* upper,
+	                const uint16_t* lower,
+	                unsigned int    weight,
+	                uint8_t*        out,
+	                std::size_t     count) {
+		const __m512i weight_upper =
+		  _mm512_set1_epi32((1 << BILINEAR_BITS) - weight);
+		const __m512i weight_lower = _mm512_set1_epi32(weight);
+
+		std::size_t i = 0;
+		for(; i + 16 <= count; i += 16) {
+			const __m512i u = _mm512_cvtepu16_epi32(
+			  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(upper + i)));
+			const __m512i l = _mm512_cvtepu16_epi32(
+			  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lower + i)));
+
+			const __m512i sum = _mm512_add_epi32(_mm512_mullo_epi32(u, weight_upper),
+			                                     _mm512_mullo_epi32(l, weight_lower));
+			_mm_storeu_si128(
+			  reinterpret_cast<__m128i*>(out + i),
+			  _mm512_cvtepi32_epi8(_mm512_srli_epi32(sum, 2 * BILINEAR_BITS)));
+		}
+		blend_rows_scalar(upper + i, lower + i, weight, out + i, count - i);
+	}
+
+	inline __m512i load_bytes(const uint8_t* source) {
+		return _mm512_cvtepu8_epi16(
+		  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)));
+	}
+
+	void imddt_row(const ImddtSpan& span, uint8_t* out, std::size_t count) {
+		const __m512i half       = _mm512_set1_epi16(1 << IMDDT_BITS);
+		const __m512i whole      = _mm512_set1_epi16(2 << IMDDT_BITS);
+		const __m512i dy         = _mm512_set1_epi16(span.distance_y);
+		const __m512i dy_gt_dx   = _mm512_set1_epi16(IMDDT_DY_GT_DX);
+		const __m512i dx_dy_lt_1 = _mm512_set1_epi16(IMDDT_DX_DY_LT_1);
+		const __m512i diagonal   = _mm512_set1_epi16(IMDDT_ASCENDING);
+
+		std::size_t i = 0;
+		for(; i + 32 <= count; i += 32) {
+			const __m512i pixel_1  = load_bytes(span.pixel_1 + i);
+			const __m512i pixel_2  = load_bytes(span.pixel_2 + i);
+			const __m512i pixel_3  = load_bytes(span.pixel_3 + i);
+			const __m512i pixel_4  = load_bytes(span.pixel_4 + i);
+			const __m512i dx       = load_bytes(span.distance_x + i);
+			const __m512i geometry = load_bytes(span.geometry + i);
+
+			const __mmask32 ascending  = _mm512_test_epi16_mask(geometry, diagonal);
+			const __mmask32 lower_left = _mm512_test_epi16_mask(geometry, dy_gt_dx);
+			const __mmask32 upper_left =
+			  _mm512_test_epi16_mask(geometry, dx_dy_lt_1);
+
+			// Split along the ascending diagonal: pixels 1 and 4 in both triangles
+			const __m512i a_weight_1 = _mm512_mask_blend_epi16(
+			  lower_left, _mm512_sub_epi16(half, dx), _mm512_sub_epi16(half, dy));
+			const __m512i a_weight_4 = _mm512_mask_blend_epi16(lower_left, dy, dx);
+			const __m512i a_rest =
+			  _mm512_sub_epi16(_mm512_sub_epi16(whole, a_weight_1), a_weight_4);
+
+			// Split along the descending diagonal: pixels 2 and 3 in both triangles
+			const __m512i d_weight_2 =
+			  _mm512_mask_blend_epi16(upper_left, _mm512_sub_epi16(half, dy), dx);
+			const __m512i d_weight_3 =
+			  _mm512_mask_blend_epi16(upper_left, _mm512_sub_epi16(half, dx), dy);
+			const __m512i d_rest =
+			  _mm512_sub_epi16(_mm512_sub_epi16(whole, d_weight_2), d_weight_3);
+
+			const __m512i weight_1 = _mm512_mask_blend_epi16(
+			  ascending, _mm512_maskz_mov_epi16(upper_left, d_rest), a_weight_1);
+			const __m512i weight_2 = _mm512_mask_blend_epi16(
+			  ascending, d_weight_2, _mm512_maskz_mov_epi16(~lower_left, a_rest));
+			const __m512i weight_3 = _mm512_mask_blend_epi16(
+			  ascending, d_weight_3, _mm512_maskz_mov_epi16(lower_left, a_rest));
+			const __m512i weight_4 = _mm512_mask_blend_epi16(
+			  ascending, _mm512_maskz_mov_epi16(~upper_left, d_rest), a_weight_4);
+
+			const __m512i sum = _mm512_add_epi16(
+			  _mm512_add_epi16(_mm512_mullo_epi16(weight_1, pixel_1),
+			                   _mm512_mullo_epi16(weight_2, pixel_2)),
+			  _mm512_add_epi16(_mm512_mullo_epi16(weight_3, pixel_3),
+			                   _mm512_mullo_epi16(weight_4, pixel_4)));
+			_mm256_storeu_si256(
+			  reinterpret_cast<__m256i*>(out + i),
+			  _mm512_cvtepi16_epi8(_mm512_srli_epi16(sum, IMDDT_BITS + 1)));
+		}
+
+		ImddtSpan tail = span;
+		tail.pixel_1 += i;
+		tail.pixel_2 += i;
+		tail.pixel_3 += i;
+		tail.pixel_4 += i;
+		tail.distance_x += i;
+		tail.geometry += i;
+		imddt_row_scalar(tail, out + i, count - i);
+	}
+
+	inline __m512i difference(__m512i a, __m512i b) {
+		return _mm512_sub_epi8(_mm512_max_epu8(a, b), _mm512_min_epu8(a, b));
+	}
+
+	void imddt_diagonals(const uint8_t* upper,
+	                     const uint8_t* lower,
+	                     uint8_t*       out,
+	                     std::size_t    count) {
+		const __m512i ascending = _mm512_set1_epi8(IMDDT_ASCENDING);
+
+		std::size_t x = 0;
+		for(; x + 64 <= count; x += 64) {
+			const __m512i across = difference(_mm512_loadu_si512(lower + x),
+			                                  _mm512_loadu_si512(upper + x + 1));
+			const __m512i along  = difference(_mm512_loadu_si512(upper + x),
+			                                  _mm512_loadu_si512(lower + x + 1));
+			_mm512_storeu_si512(
+			  out + x,
+			  _mm512_maskz_mov_epi8(_mm512_cmpgt_epu8_mask(across, along),
+			                        ascending));
+		}
+		imddt_diagonals_scalar(upper + x, lower + x, out + x, count - x);
+	}
+
+	// AIS works on 32-bit lanes, sixteen at a time
+	inline __m512i load_lanes(const uint8_t* source) {
+		return _mm512_cvtepu8_epi32(
+		  _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)));
+	}
+
+	inline __m512i load_lanes(const int16_t* source) {
+		return _mm512_cvtepi16_epi32(
+		  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)));
+	}
+
+	// (9 * (p2 + p3) - p1 - p4) / 16, saturated, which is exact
+	inline __m512i cubic(const uint8_t* const* line, std::size_t i) {
+		const __m512i inner =
+		  _mm512_add_epi32(load_lanes(line[1] + i), load_lanes(line[2] + i));
+		const __m512i outer =
+		  _mm512_add_epi32(load_lanes(line[0] + i), load_lanes(line[3] + i));
+		const __m512i sum =
+		  _mm512_sub_epi32(_mm512_mullo_epi32(inner, _mm512_set1_epi32(9)), outer);
+		return _mm512_min_epi32(
+		  _mm512_srai_epi32(_mm512_max_epi32(sum, _mm512_setzero_si512()), 4),
+		  _mm512_set1_epi32(255));
+	}
+
+	// The weak edge of eight lanes, from their near pixels and smoothness + 1:
+	// the scalar kernel's double operations in the same order, so that every
+	// variant rounds alike
+	inline __m256i weak_average(const __m512d (&near)[4], const __m512d (&d)[4]) {
+		__m512d weight[4];
+		for(int k = 0; k < 4; ++k) {
+			weight[k] = _mm512_div_pd(_mm512_set1_pd(0.25), d[k]);
+		}
+		const __m512d weight_sum = _mm512_add_pd(
+		  _mm512_add_pd(_mm512_add_pd(weight[0], weight[1]), weight[2]), weight[3]);
+		__m512d result = _mm512_setzero_pd();
+		for(int k = 0; k < 4; ++k) {
+			result = _mm512_add_pd(
+			  result, _mm512_mul_pd(_mm512_div_pd(weight[k], weight_sum), near[k]));
+		}
+		return _mm512_cvttpd_epi32(result);
+	}
+
+	void ais_row(const AisSpan& span, uint8_t* out, std::size_t count) {
+		const __m512i one                = _mm512_set1_epi32(1);
+		const __m512i threshold          = _mm512_set1_epi32(AIS_THRESHOLD);
+		const __m512i negative_threshold = _mm512_set1_epi32(-AIS_THRESHOLD);
+
+		std::size_t i = 0;
+		for(; i + 16 <= count; i += 16) {
+			const __m512i difference = _mm512_sub_epi32(
+			  load_lanes(span.gradient_1 + i), load_lanes(span.gradient_2 + i));
+			const __mmask16 strong_a = _mm512_cmpgt_epi32_mask(difference, threshold);
+			const __mmask16 strong_b =
+			  _mm512_cmplt_epi32_mask(difference, negative_threshold);
+
+			// Weak edge, eight lanes at a time
+			__m512d near[2][4];
+			__m512d d[2][4];
+			for(int k = 0; k < 4; ++k) {
+				const __m512i pixel = load_lanes(span.near[k] + i);
+				const __m512i smoothness =
+				  _mm512_add_epi32(load_lanes(span.smoothness[k] + i), one);
+				near[0][k] = _mm512_cvtepi32_pd(_mm512_castsi512_si256(pixel));
+				near[1][k] = _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(pixel, 1));
+				d[0][k]    = _mm512_cvtepi32_pd(_mm512_castsi512_si256(smoothness));
+				d[1][k] =
+				  _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(smoothness, 1));
+			}
+			const __m512i weak = _mm512_inserti64x4(
+			  _mm512_castsi256_si512(weak_average(near[0], d[0])),
+			  weak_average(near[1], d[1]),
+			  1);
+
+			const __m512i result = _mm512_mask_blend_epi32(
+			  strong_b,
+			  _mm512_mask_blend_epi32(strong_a, weak, cubic(span.line_a, i)),
+			  cubic(span.line_b, i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+			                 _mm512_cvtepi32_epi8(result));
+		}
+
+		AisSpan tail = span;
+		for(int k = 0; k < 4; ++k) {
+			tail.line_a[k] += i;
+			tail.line_b[k] += i;
+			tail.near[k] += i;
+			tail.smoothness[k] += i;
+		}
+		tail.gradient_1 += i;
+		tail.gradient_2 += i;
+		ais_row_scalar(tail, out + i, count - i);
+	}
+	inline __m512i load_words(const int16_t* source) {
+		return _mm512_loadu_si512(source);
+	}
+
+	// Weights k and k + 1, zero past the last, paired for madd
+	inline int weight_pair(const FilterSpan& span, unsigned int k) {
+		const unsigned int second =
+		  k + 1 < span.taps ? static_cast<uint16_t>(span.weights[k + 1]) : 0;
+		return static_cast<int>(static_cast<uint16_t>(span.weights[k]) |
+		                        second << 16);
+	}
+
+	void filter_row(const FilterSpan& span, uint8_t* out, std::size_t count) {
+		constexpr int shift = FILTER_BITS + FILTER_INTERMEDIATE_BITS;
+		if(count < 32) {
+			filter_row_scalar(span, out, count);
+			return;
+		}
+
+		// The last block steps back to end at count, redoing a few values
+		for(std::size_t i = 0; i < count; i += 32) {
+			const std::size_t at = i + 32 <= count ? i : count - 32;
+			__m512i sum_lo = _mm512_set1_epi32(1 << (shift - 1));
+			__m512i sum_hi = sum_lo;
+			for(unsigned int k = 0; k < span.taps; k += 2) {
+				const __m512i a = load_words(span.rows[k] + at);
+				const __m512i b = k + 1 < span.taps ?
+				                    load_words(span.rows[k + 1] + at) :
+				                    _mm512_setzero_si512();
+				const __m512i weights = _mm512_set1_epi32(weight_pair(span, k));
+
+				const __m512i lo =
+				  _mm512_madd_epi16(_mm512_unpacklo_epi16(a, b), weights);
+				const __m512i hi =
+				  _mm512_madd_epi16(_mm512_unpackhi_epi16(a, b), weights);
+				sum_lo = _mm512_add_epi32(sum_lo, lo);
+				sum_hi = _mm512_add_epi32(sum_hi, hi);
+			}
+			// Unpacking and packing both work within 128-bit lanes, which leaves
+			// the words in order
+			const __m512i words = _mm512_max_epi16(
+			  _mm512_packs_epi32(_mm512_srai_epi32(sum_lo, shift),
+			                     _mm512_srai_epi32(sum_hi, shift)),
+			  _mm512_setzero_si512());
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + at),
+			                    _mm512_cvtusepi16_epi8(words));
+		}
+	}
+
+	// Shuffles 16 bytes into the pairs box_row adds, as in kernels_sse41.cpp,
+	// in every lane
+	inline __m512i box_pairs(unsigned int channels, unsigned int block) {
+		alignas(16) int8_t mask[16];
+		for(unsigned int j = 0; j < 8; ++j) {
+			const int first = 2 * (j / channels) * channels + j % channels;
+			mask[2 * j]     = j < block ? first : -1;
+			mask[2 * j + 1] = j < block ? first + channels : -1;
+		}
+		return _mm512_broadcast_i32x4(
+		  _mm_load_si128(reinterpret_cast<const __m128i*>(mask)));
+	}
+
+	// Four blocks, 2 * block values apart, one per lane
+	inline __m512i load_blocks(const uint8_t* source, unsigned int block) {
+		__m512i blocks = _mm512_castsi128_si512(
+		  _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)));
+		blocks = _mm512_inserti32x4(
+		  blocks,
+		  _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 2 * block)),
+		  1);
+		blocks = _mm512_inserti32x4(
+		  blocks,
+		  _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 4 * block)),
+		  2);
+		return _mm512_inserti32x4(
+		  blocks,
+		  _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 6 * block)),
+		  3);
+	}
+
+	void box_row(const uint8_t* upper,
+	             const uint8_t* lower,
+	             unsigned int   channels,
+	             uint8_t*       out,
+	             std::size_t    count) {
+		const std::size_t values = count * channels;
+		std::size_t       i      = 0;
+		if(channels <= 8) {
+			// Whole pixels per block, whose 8 bytes of output overlap the next
+			const unsigned int block = 8 / channels * channels;
+			const __m512i      pairs = box_pairs(channels, block);
+			const __m512i      ones  = _mm512_set1_epi8(1);
+			const __m512i      two   = _mm512_set1_epi16(2);
+			for(; i + 3 * block + 8 <= values; i += 4 * block) {
+				const __m512i u = load_blocks(upper + 2 * i, block);
+				const __m512i l = load_blocks(lower + 2 * i, block);
+				const __m512i sum_u =
+				  _mm512_maddubs_epi16(_mm512_shuffle_epi8(u, pairs), ones);
+				const __m512i sum_l =
+				  _mm512_maddubs_epi16(_mm512_shuffle_epi8(l, pairs), ones);
+				const __m512i words = _mm512_srli_epi16(
+				  _mm512_add_epi16(_mm512_add_epi16(sum_u, sum_l), two), 2);
+				const __m512i bytes = _mm512_packus_epi16(words, words);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+				                 _mm512_castsi512_si128(bytes));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i + block),
+				                 _mm512_extracti32x4_epi32(bytes, 1));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i + 2 * block),
+				                 _mm512_extracti32x4_epi32(bytes, 2));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i + 3 * block),
+				                 _mm512_extracti32x4_epi32(bytes, 3));
+			}
+		}
+		box_row_scalar(
+		  upper + 2 * i, lower + 2 * i, channels, out + i, (values - i) / channels);
+	}
+
+	void average_rows(const uint8_t* upper,
+	                  const uint8_t* lower,
+	                  uint8_t*       out,
+	                  std::size_t    count) {
+		std::size_t i = 0;
+		for(; i + 64 <= count; i += 64) {
+			_mm512_storeu_si512(out + i,
+			                    _mm512_avg_epu8(_mm512_loadu_si512(upper + i),
+			                                    _mm512_loadu_si512(lower + i)));
+		}
+		average_rows_scalar(upper + i, lower + i, out + i, count - i);
+	}
+} // namespace
+
+const Kernels kernels_avx512 = {blend_rows,
+                                imddt_row,
+                                imddt_diagonals,
+                                ais_row,
+                                filter_row,
+                                box_row,
+                                average_rows};
+#else
+const Kernels kernels_avx512 = {blend_rows_scalar,
+                                imddt_row_scalar,
+                                imddt_diagonals_scalar,
+                                ais_row_scalar,
+                                filter_row_scalar,
+                                box_row_scalar,
+                                average_rows_scalar};
+#endif
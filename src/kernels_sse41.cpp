@@ -0,0 +1,355 @@
+// Compiled with -msse4.1; only called after detect_simd() has seen SSE4.1
+
+#include "kernels.hpp"
+
+#if defined(__SSE4_1__)
+#include <cstring>
+#include <immintrin.h>
+
+namespace {
+	void blend_rows(const uint16_t* upper,
+	                const uint16_t* lower,
+	                unsigned int    weight,
+	                uint8_t*        out,
+	                std::size_t     count) {
+		const __m128i weight_upper =
+		  _mm_set1_epi32((1 << BILINEAR_BITS) - weight);
+		const __m128i weight_lower = _mm_set1_epi32(weight);
+
+		std::size_t i = 0;
+		for(; i + 8 <= count; i += 8) {
+			const __m128i u =
+			  _mm_loadu_si128(reinterpret_cast<const __m128i*>(upper + i));
+			const __m128i l =
+			  _mm_loadu_si128(reinterpret_cast<const __m128i*>(lower + i));
+
+			const __m128i sum_lo =
+			  _mm_add_epi32(_mm_mullo_epi32(_mm_cvtepu16_epi32(u), weight_upper),
+			                _mm_mullo_epi32(_mm_cvtepu16_epi32(l), weight_lower));
+			const __m128i u_hi = _mm_cvtepu16_epi32(_mm_srli_si128(u, 8));
+			const __m128i l_hi = _mm_cvtepu16_epi32(_mm_srli_si128(l, 8));
+			const __m128i sum_hi =
+			  _mm_add_epi32(_mm_mullo_epi32(u_hi, weight_upper),
+			                _mm_mullo_epi32(l_hi, weight_lower));
+
+			const __m128i words =
+			  _mm_packus_epi32(_mm_srli_epi32(sum_lo, 2 * BILINEAR_BITS),
+			                   _mm_srli_epi32(sum_hi, 2 * BILINEAR_BITS));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+			                 _mm_packus_epi16(words, words));
+		}
+		blend_rows_scalar(upper + i, lower + i, weight, out + i, count - i);
+	}
+
+	inline __m128i load_bytes(const uint8_t* source) {
+		return _mm_cvtepu8_epi16(
+		  _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)));
+	}
+
+	void imddt_row(const ImddtSpan& span, uint8_t* out, std::size_t count) {
+		const __m128i half       = _mm_set1_epi16(1 << IMDDT_BITS);
+		const __m128i whole      = _mm_set1_epi16(2 << IMDDT_BITS);
+		const __m128i dy         = _mm_set1_epi16(span.distance_y);
+		const __m128i dy_gt_dx   = _mm_set1_epi16(IMDDT_DY_GT_DX);
+		const __m128i dx_dy_lt_1 = _mm_set1_epi16(IMDDT_DX_DY_LT_1);
+		const __m128i diagonal   = _mm_set1_epi16(IMDDT_ASCENDING);
+
+		std::size_t i = 0;
+		for(; i + 8 <= count; i += 8) {
+			const __m128i pixel_1  = load_bytes(span.pixel_1 + i);
+			const __m128i pixel_2  = load_bytes(span.pixel_2 + i);
+			const __m128i pixel_3  = load_bytes(span.pixel_3 + i);
+			const __m128i pixel_4  = load_bytes(span.pixel_4 + i);
+			const __m128i dx       = load_bytes(span.distance_x + i);
+			const __m128i geometry = load_bytes(span.geometry + i);
+
+			const __m128i ascending =
+			  _mm_cmpeq_epi16(_mm_and_si128(geometry, diagonal), diagonal);
+			const __m128i lower_left =
+			  _mm_cmpeq_epi16(_mm_and_si128(geometry, dy_gt_dx), dy_gt_dx);
+			const __m128i upper_left =
+			  _mm_cmpeq_epi16(_mm_and_si128(geometry, dx_dy_lt_1), dx_dy_lt_1);
+
+			// Split along the ascending diagonal: pixels 1 and 4 in both triangles
+			const __m128i a_weight_1 = _mm_blendv_epi8(
+			  _mm_sub_epi16(half, dx), _mm_sub_epi16(half, dy), lower_left);
+			const __m128i a_weight_4 = _mm_blendv_epi8(dy, dx, lower_left);
+			const __m128i a_rest =
+			  _mm_sub_epi16(_mm_sub_epi16(whole, a_weight_1), a_weight_4);
+
+			// Split along the descending diagonal: pixels 2 and 3 in both triangles
+			const __m128i d_weight_2 =
+			  _mm_blendv_epi8(_mm_sub_epi16(half, dy), dx, upper_left);
+			const __m128i d_weight_3 =
+			  _mm_blendv_epi8(_mm_sub_epi16(half, dx), dy, upper_left);
+			const __m128i d_rest =
+			  _mm_sub_epi16(_mm_sub_epi16(whole, d_weight_2), d_weight_3);
+
+			const __m128i weight_1 = _mm_blendv_epi8(
+			  _mm_and_si128(d_rest, upper_left), a_weight_1, ascending);
+			const __m128i weight_2 = _mm_blendv_epi8(
+			  d_weight_2, _mm_andnot_si128(lower_left, a_rest), ascending);
+			const __m128i weight_3 = _mm_blendv_epi8(
+			  d_weight_3, _mm_and_si128(a_rest, lower_left), ascending);
+			const __m128i weight_4 = _mm_blendv_epi8(
+			  _mm_andnot_si128(upper_left, d_rest), a_weight_4, ascending);
+
+			const __m128i sum =
+			  _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(weight_1, pixel_1),
+			                              _mm_mullo_epi16(weight_2, pixel_2)),
+			                _mm_add_epi16(_mm_mullo_epi16(weight_3, pixel_3),
+			                              _mm_mullo_epi16(weight_4, pixel_4)));
+			const __m128i words = _mm_srli_epi16(sum, IMDDT_BITS + 1);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+			                 _mm_packus_epi16(words, words));
+		}
+
+		ImddtSpan tail = span;
+		tail.pixel_1 += i;
+		tail.pixel_2 += i;
+		tail.pixel_3 += i;
+		tail.pixel_4 += i;
+		tail.distance_x += i;
+		tail.geometry += i;
+		imddt_row_scalar(tail, out + i, count - i);
+	}
+
+	inline __m128i load_block(const uint8_t* source) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+	}
+
+	// Unsigned bytes have no abs of a difference, but one of the two saturated
+	// differences is it and the other zero
+	inline __m128i difference(__m128i a, __m128i b) {
+		return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+	}
+
+	void imddt_diagonals(const uint8_t* upper,
+	                     const uint8_t* lower,
+	                     uint8_t*       out,
+	                     std::size_t    count) {
+		const __m128i ascending = _mm_set1_epi8(IMDDT_ASCENDING);
+
+		std::size_t x = 0;
+		for(; x + 16 <= count; x += 16) {
+			const __m128i across =
+			  difference(load_block(lower + x), load_block(upper + x + 1));
+			const __m128i along =
+			  difference(load_block(upper + x), load_block(lower + x + 1));
+			const __m128i not_greater =
+			  _mm_cmpeq_epi8(_mm_subs_epu8(across, along), _mm_setzero_si128());
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x),
+			                 _mm_andnot_si128(not_greater, ascending));
+		}
+		imddt_diagonals_scalar(upper + x, lower + x, out + x, count - x);
+	}
+
+	// AIS works on 32-bit lanes, four at a time
+	inline __m128i load_lanes(const uint8_t* source) {
+		int32_t bytes = 0;
+		std::memcpy(&bytes, source, sizeof(bytes));
+		return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+	}
+
+	inline __m128i load_lanes(const int16_t* source) {
+		return _mm_cvtepi16_epi32(
+		  _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)));
+	}
+
+	// (9 * (p2 + p3) - p1 - p4) / 16, saturated, which is exact
+	inline __m128i cubic(const uint8_t* const* line, std::size_t i) {
+		const __m128i inner =
+		  _mm_add_epi32(load_lanes(line[1] + i), load_lanes(line[2] + i));
+		const __m128i outer =
+		  _mm_add_epi32(load_lanes(line[0] + i), load_lanes(line[3] + i));
+		const __m128i sum =
+		  _mm_sub_epi32(_mm_mullo_epi32(inner, _mm_set1_epi32(9)), outer);
+		return _mm_min_epi32(
+		  _mm_srai_epi32(_mm_max_epi32(sum, _mm_setzero_si128()), 4),
+		  _mm_set1_epi32(255));
+	}
+
+	// The weak edge of two lanes, from their near pixels and smoothness + 1:
+	// the scalar kernel's double operations in the same order, so that every
+	// variant rounds alike
+	inline __m128i weak_average(const __m128d (&near)[4], const __m128d (&d)[4]) {
+		__m128d weight[4];
+		for(int k = 0; k < 4; ++k) {
+			weight[k] = _mm_div_pd(_mm_set1_pd(0.25), d[k]);
+		}
+		const __m128d weight_sum = _mm_add_pd(
+		  _mm_add_pd(_mm_add_pd(weight[0], weight[1]), weight[2]), weight[3]);
+		__m128d result = _mm_setzero_pd();
+		for(int k = 0; k < 4; ++k) {
+			result = _mm_add_pd(
+			  result, _mm_mul_pd(_mm_div_pd(weight[k], weight_sum), near[k]));
+		}
+		return _mm_cvttpd_epi32(result);
+	}
+
+	void ais_row(const AisSpan& span, uint8_t* out, std::size_t count) {
+		const __m128i one                = _mm_set1_epi32(1);
+		const __m128i threshold          = _mm_set1_epi32(AIS_THRESHOLD);
+		const __m128i negative_threshold = _mm_set1_epi32(-AIS_THRESHOLD);
+
+		std::size_t i = 0;
+		for(; i + 4 <= count; i += 4) {
+			const __m128i difference = _mm_sub_epi32(
+			  load_lanes(span.gradient_1 + i), load_lanes(span.gradient_2 + i));
+			const __m128i strong_a = _mm_cmpgt_epi32(difference, threshold);
+			const __m128i strong_b = _mm_cmplt_epi32(difference, negative_threshold);
+
+			// Weak edge, two lanes at a time
+			__m128d near[2][4];
+			__m128d d[2][4];
+			for(int k = 0; k < 4; ++k) {
+				const __m128i pixel = load_lanes(span.near[k] + i);
+				const __m128i smoothness =
+				  _mm_add_epi32(load_lanes(span.smoothness[k] + i), one);
+				near[0][k] = _mm_cvtepi32_pd(pixel);
+				near[1][k] = _mm_cvtepi32_pd(_mm_unpackhi_epi64(pixel, pixel));
+				d[0][k]    = _mm_cvtepi32_pd(smoothness);
+				d[1][k] = _mm_cvtepi32_pd(_mm_unpackhi_epi64(smoothness, smoothness));
+			}
+			const __m128i weak = _mm_unpacklo_epi64(
+			  weak_average(near[0], d[0]), weak_average(near[1], d[1]));
+
+			const __m128i result = _mm_blendv_epi8(
+			  _mm_blendv_epi8(weak, cubic(span.line_a, i), strong_a),
+			  cubic(span.line_b, i),
+			  strong_b);
+			const __m128i words = _mm_packus_epi32(result, result);
+			const int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+			std::memcpy(out + i, &bytes, sizeof(bytes));
+		}
+
+		AisSpan tail = span;
+		for(int k = 0; k < 4; ++k) {
+			tail.line_a[k] += i;
+			tail.line_b[k] += i;
+			tail.near[k] += i;
+			tail.smoothness[k] += i;
+		}
+		tail.gradient_1 += i;
+		tail.gradient_2 += i;
+		ais_row_scalar(tail, out + i, count - i);
+	}
+	inline __m128i load_words(const int16_t* source) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+	}
+
+	// Weights k and k + 1, zero past the last, paired for madd
+	inline int weight_pair(const FilterSpan& span, unsigned int k) {
+		const unsigned int second =
+		  k + 1 < span.taps ? static_cast<uint16_t>(span.weights[k + 1]) : 0;
+		return static_cast<int>(static_cast<uint16_t>(span.weights[k]) |
+		                        second << 16);
+	}
+
+	void filter_row(const FilterSpan& span, uint8_t* out, std::size_t count) {
+		constexpr int shift = FILTER_BITS + FILTER_INTERMEDIATE_BITS;
+		if(count < 8) {
+			filter_row_scalar(span, out, count);
+			return;
+		}
+
+		// The last block steps back to end at count, redoing a few values
+		for(std::size_t i = 0; i < count; i += 8) {
+			const std::size_t at = i + 8 <= count ? i : count - 8;
+			__m128i sum_lo = _mm_set1_epi32(1 << (shift - 1));
+			__m128i sum_hi = sum_lo;
+			for(unsigned int k = 0; k < span.taps; k += 2) {
+				const __m128i a = load_words(span.rows[k] + at);
+				const __m128i b = k + 1 < span.taps ?
+				                    load_words(span.rows[k + 1] + at) :
+				                    _mm_setzero_si128();
+				const __m128i weights = _mm_set1_epi32(weight_pair(span, k));
+
+				const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights);
+				const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights);
+				sum_lo           = _mm_add_epi32(sum_lo, lo);
+				sum_hi           = _mm_add_epi32(sum_hi, hi);
+			}
+			const __m128i words = _mm_packs_epi32(_mm_srai_epi32(sum_lo, shift),
+			                                      _mm_srai_epi32(sum_hi, shift));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + at),
+			                 _mm_packus_epi16(words, words));
+		}
+	}
+
+	// Shuffles 16 bytes into the pairs box_row adds, for up to 8 channels:
+	// output value j of a block is made from input values first and first +
+	// channels of each row, first = 2 * (j / channels) * channels + j %
+	// channels. Only the first `block` values are used.
+	inline __m128i box_pairs(unsigned int channels, unsigned int block) {
+		alignas(16) int8_t mask[16];
+		for(unsigned int j = 0; j < 8; ++j) {
+			const int first = 2 * (j / channels) * channels + j % channels;
+			mask[2 * j]     = j < block ? first : -1;
+			mask[2 * j + 1] = j < block ? first + channels : -1;
+		}
+		return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+	}
+
+	// The 2x2 sums of one block, rounded and shifted, as 16-bit values
+	inline __m128i box_block(__m128i upper, __m128i lower, __m128i pairs) {
+		const __m128i ones = _mm_set1_epi8(1);
+		const __m128i sum  = _mm_add_epi16(
+		  _mm_maddubs_epi16(_mm_shuffle_epi8(upper, pairs), ones),
+		  _mm_maddubs_epi16(_mm_shuffle_epi8(lower, pairs), ones));
+		return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+	}
+
+	void box_row(const uint8_t* upper,
+	             const uint8_t* lower,
+	             unsigned int   channels,
+	             uint8_t*       out,
+	             std::size_t    count) {
+		const std::size_t values = count * channels;
+		std::size_t       i      = 0;
+		if(channels <= 8) {
+			// Whole pixels per block, whose 8 bytes of output overlap the next
+			const unsigned int block = 8 / channels * channels;
+			const __m128i      pairs = box_pairs(channels, block);
+			for(; i + 8 <= values; i += block) {
+				const __m128i words = box_block(load_block(upper + 2 * i),
+				                                load_block(lower + 2 * i),
+				                                pairs);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+				                 _mm_packus_epi16(words, words));
+			}
+		}
+		box_row_scalar(
+		  upper + 2 * i, lower + 2 * i, channels, out + i, (values - i) / channels);
+	}
+
+	void average_rows(const uint8_t* upper,
+	                  const uint8_t* lower,
+	                  uint8_t*       out,
+	                  std::size_t    count) {
+		std::size_t i = 0;
+		for(; i + 16 <= count; i += 16) {
+			_mm_storeu_si128(
+			  reinterpret_cast<__m128i*>(out + i),
+			  _mm_avg_epu8(load_block(upper + i), load_block(lower + i)));
+		}
+		average_rows_scalar(upper + i, lower + i, out + i, count - i);
+	}
+} // namespace
+
+const Kernels kernels_sse41 = {blend_rows,
+                               imddt_row,
+                               imddt_diagonals,
+                               ais_row,
+                               filter_row,
+                               box_row,
+                               average_rows};
+#else
+const Kernels kernels_sse41 = {blend_rows_scalar,
+                               imddt_row_scalar,
+                               imddt_diagonals_scalar,
+                               ais_row_scalar,
+                               filter_row_scalar,
+                               box_row_scalar,
+                               average_rows_scalar};
+#endif
@@ -0,0 +1,398 @@
+#include "mapped.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <doctest\doctest.h>
+
+namespace {
+	// Suffixes an output while it is written, as in the result cache
+	constexpr const char* PARTIAL = ".partial";
+
+	// Reads the numbers of a binary PGM or PPM header, skipping whitespace
+	// and comments
+	bool pnm_number(const uint8_t* data,
+	                std::size_t    size,
+	                std::size_t&   at,
+	                unsigned int&  number) {
+		while(at < size) {
+			if(data[at] == '#') {
+				while(at < size && data[at] != '\n') { ++at; }
+			} else if(std::isspace(data[at])) {
+				++at;
+			} else {
+				break;
+			}
+		}
+		const std::size_t start = at;
+		number                  = 0;
+		while(at < size && std::isdigit(data[at]) && at - start < 9) {
+			number = number * 10 + (data[at++] - '0');
+		}
+		return at > start && at < size && std::isspace(data[at]);
+	}
+
+	bool pnm_layout(const uint8_t* data, std::size_t size, RawLayout& layout) {
+		if(size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+			return false;
+		}
+		std::size_t  at = 2;
+		unsigned int maxval;
+		if(!pnm_number(data, size, at, layout.width) ||
+		   !pnm_number(data, size, at, layout.height) ||
+		   !pnm_number(data, size, at, maxval) || maxval != 255) {
+			return false;
+		}
+		// A single whitespace character ends the header
+		layout.channels = data[1] == '5' ? 1 : 3;
+		layout.offset   = at + 1;
+		return true;
+	}
+
+	// Reads the fields of a classic TIFF file in its byte order
+	class TiffReader final {
+		private:
+		const uint8_t* m_data;
+		std::size_t    m_size;
+		bool           m_big;
+
+		public:
+		TiffReader(const uint8_t* data, std::size_t size, bool big)
+		  : m_data(data), m_size(size), m_big(big) {}
+
+		bool read(std::size_t at, unsigned int bytes, uint32_t& value) const {
+			if(at > m_size || m_size - at < bytes) { return false; }
+			value = 0;
+			for(unsigned int i = 0; i < bytes; ++i) {
+				const uint32_t byte = m_data[at + (m_big ? i : bytes - 1 - i)];
+				value               = value << 8 | byte;
+			}
+			return true;
+		}
+
+		// The values of the field whose entry is at `at`, SHORT or LONG
+		bool values(std::size_t at, std::vector<uint32_t>& values) const {
+			uint32_t type, count, offset;
+			if(!read(at + 2, 2, type) || !read(at + 4, 4, count) ||
+			   (type != 3 && type != 4) || count > m_size) {
+				return false;
+			}
+			const unsigned int bytes = type == 3 ? 2 : 4;
+			std::size_t        first = at + 8;
+			if(std::size_t{count} * bytes > 4) {
+				if(!read(at + 8, 4, offset)) { return false; }
+				first = offset;
+			}
+			values.resize(count);
+			for(std::size_t i = 0; i < count; ++i) {
+				if(!read(first + i * bytes, bytes, values[i])) { return false; }
+			}
+			return true;
+		}
+
+		// The value of a field of one
+		bool value(std::size_t at, uint32_t& value) const {
+			std::vector<uint32_t> found;
+			if(!values(at, found) || found.size() != 1) { return false; }
+			value = found[0];
+			return true;
+		}
+	};
+
+	bool tiff_layout(const uint8_t* data, std::size_t size, RawLayout& layout) {
+		if(size < 8) { return false; }
+		const bool little = std::equal(data, data + 4, "II*\0");
+		const bool big    = std::equal(data, data + 4, "MM\0*");
+		if(!little && !big) { return false; }
+
+		const TiffReader reader(data, size, big);
+		uint32_t         ifd, entries;
+		if(!reader.read(4, 4, ifd) || !reader.read(ifd, 2, entries)) {
+			return false;
+		}
+
+		// Fields left out take their defaults, but for the required ones
+		uint32_t              compression = 1, planar = 1, photometric = 9;
+		uint32_t              samples = 1, width = 0, height = 0;
+		std::vector<uint32_t> bits{8}, format{1}, extra, offsets, counts;
+		for(uint32_t entry = 0; entry < entries; ++entry) {
+			const std::size_t at = ifd + 2 + std::size_t{entry} * 12;
+			uint32_t          tag;
+			if(!reader.read(at, 2, tag)) { return false; }
+			switch(tag) {
+				case 256:
+					if(!reader.value(at, width)) { return false; }
+					break;
+				case 257:
+					if(!reader.value(at, height)) { return false; }
+					break;
+				case 259:
+					if(!reader.value(at, compression)) { return false; }
+					break;
+				case 262:
+					if(!reader.value(at, photometric)) { return false; }
+					break;
+				case 277:
+					if(!reader.value(at, samples)) { return false; }
+					break;
+				case 284:
+					if(!reader.value(at, planar)) { return false; }
+					break;
+				case 258:
+					if(!reader.values(at, bits)) { return false; }
+					break;
+				case 273:
+					if(!reader.values(at, offsets)) { return false; }
+					break;
+				case 279:
+					if(!reader.values(at, counts)) { return false; }
+					break;
+				case 338:
+					if(!reader.values(at, extra)) { return false; }
+					break;
+				case 339:
+					if(!reader.values(at, format)) { return false; }
+					break;
+				case 322: // tiles
+				case 320: // a palette
+					return false;
+				default: break;
+			}
+		}
+
+		// Grey or RGB, with associated or unspecified extra channels, which
+		// are read as they are stored
+		const auto eight = [](uint32_t b) { return b == 8; };
+		const auto plain = [](uint32_t f) { return f == 1; };
+		const auto kept  = [](uint32_t e) { return e != 2; };
+		if(compression != 1 || planar != 1 || width == 0 || height == 0 ||
+		   !(photometric == 1 || (photometric == 2 && samples >= 3)) ||
+		   !std::all_of(bits.begin(), bits.end(), eight) ||
+		   !std::all_of(format.begin(), format.end(), plain) ||
+		   !std::all_of(extra.begin(), extra.end(), kept) || offsets.empty() ||
+		   offsets.size() != counts.size()) {
+			return false;
+		}
+
+		// The strips must follow one another and hold exactly the pixels
+		std::size_t end = offsets[0];
+		for(std::size_t i = 0; i < offsets.size(); ++i) {
+			if(offsets[i] != end) { return false; }
+			end += counts[i];
+		}
+		const std::size_t bytes = std::size_t{width} * height * samples;
+		if(end - offsets[0] != bytes || end > size) { return false; }
+
+		layout = {width, height, samples, offsets[0]};
+		return true;
+	}
+} // namespace
+
+bool raw_layout(const uint8_t* data, std::size_t size, RawLayout& layout) {
+	RawLayout found{0, 0, 0, 0};
+	if(!pnm_layout(data, size, found) && !tiff_layout(data, size, found)) {
+		return false;
+	}
+	const std::size_t bytes =
+	  std::size_t{found.width} * found.height * found.channels;
+	if(found.width == 0 || found.height == 0 || found.offset > size ||
+	   size - found.offset < bytes) {
+		return false;
+	}
+	layout = found;
+	return true;
+}
+
+std::string raw_header(const std::string& filename,
+                       unsigned int       width,
+                       unsigned int       height,
+                       unsigned int       channels) {
+	std::string extension = std::filesystem::path(filename).extension().string();
+	std::transform(
+	  extension.begin(), extension.end(), extension.begin(), [](char c) {
+		  return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	  });
+	if((extension != ".pgm" && extension != ".ppm" && extension != ".pnm") ||
+	   (channels != 1 && channels != 3)) {
+		return "";
+	}
+	std::stringstream ss;
+	ss << (channels == 1 ? "P5" : "P6") << "\n"
+	   << width << " " << height << "\n255\n";
+	return ss.str();
+}
+
+MappedFile::MappedFile()
+  : m_data(nullptr), m_size(0), m_filename(), m_partial() {}
+
+#if defined(__unix__) || defined(__APPLE__)
+namespace {
+	// Gives file disk blocks for size bytes, so that a full disk fails here
+	// rather than as a SIGBUS on a write through the mapping
+	bool allocate(int file, std::size_t size) {
+#if defined(__APPLE__)
+		fstore_t store{
+		  F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0};
+		return fcntl(file, F_PREALLOCATE, &store) != -1 &&
+		       ftruncate(file, static_cast<off_t>(size)) == 0;
+#else
+		return posix_fallocate(file, 0, static_cast<off_t>(size)) == 0;
+#endif
+	}
+} // namespace
+
+MappedFile::MappedFile(const std::string& filename) : MappedFile() {
+	const int file = open(filename.c_str(), O_RDONLY);
+	if(file < 0) { return; }
+	struct stat status;
+	if(fstat(file, &status) == 0 && S_ISREG(status.st_mode) &&
+	   status.st_size > 0) {
+		void* data = mmap(nullptr,
+		                  status.st_size,
+		                  PROT_READ | PROT_WRITE,
+		                  MAP_PRIVATE,
+		                  file,
+		                  0);
+		if(data != MAP_FAILED) {
+			m_data = static_cast<uint8_t*>(data);
+			m_size = status.st_size;
+		}
+	}
+	close(file);
+}
+
+MappedFile::MappedFile(const std::string& filename, std::size_t size)
+  : MappedFile() {
+	// A new file rather than the old one rewritten, which may still be mapped
+	// as an input or linked from a cache, and beside it until published, so
+	// that a resize that fails leaves the old one as it was
+	const std::string partial = filename + PARTIAL;
+	unlink(partial.c_str());
+	const int file = open(partial.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+	if(file < 0) { return; }
+	if(size > 0 && allocate(file, size)) {
+		void* data =
+		  mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if(data != MAP_FAILED) {
+			m_data     = static_cast<uint8_t*>(data);
+			m_size     = size;
+			m_filename = filename;
+			m_partial  = partial;
+		}
+	}
+	close(file);
+	if(!m_data) { unlink(partial.c_str()); }
+}
+
+MappedFile::~MappedFile() {
+	if(m_data) { munmap(m_data, m_size); }
+	if(!m_partial.empty()) { unlink(m_partial.c_str()); }
+}
+#else
+MappedFile::MappedFile(const std::string&) : MappedFile() {}
+
+MappedFile::MappedFile(const std::string&, std::size_t) : MappedFile() {}
+
+MappedFile::~MappedFile() {}
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : m_data(std::exchange(other.m_data, nullptr))
+  , m_size(std::exchange(other.m_size, 0))
+  , m_filename(std::move(other.m_filename))
+  , m_partial(std::move(other.m_partial)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if(this != &other) {
+		MappedFile old(std::move(*this));
+		m_data     = std::exchange(other.m_data, nullptr);
+		m_size     = std::exchange(other.m_size, 0);
+		m_filename = std::move(other.m_filename);
+		m_partial  = std::move(other.m_partial);
+	}
+	return *this;
+}
+
+bool MappedFile::publish() const {
+	if(m_partial.empty()) { return !m_filename.empty(); }
+	if(std::rename(m_partial.c_str(), m_filename.c_str()) != 0) { return false; }
+	m_partial.clear();
+	return true;
+}
+
+TEST_CASE("Raw layouts of PNM and TIFF files") {
+	RawLayout layout{0, 0, 0, 0};
+
+	const std::string ppm = "P6\n# comment\n3 2\n255\n" + std::string(18, 'x');
+	REQUIRE(raw_layout(
+	  reinterpret_cast<const uint8_t*>(ppm.data()), ppm.size(), layout));
+	CHECK(layout.width == 3);
+	CHECK(layout.height == 2);
+	CHECK(layout.channels == 3);
+	CHECK(layout.offset == ppm.size() - 18);
+
+	// Too short, and scaled to 16 bits
+	for(const std::string& pgm : {"P5 3 2 255\n" + std::string(5, 'x'),
+	                              "P5 3 2 65535\n" + std::string(12, 'x')}) {
+		CHECK(!raw_layout(
+		  reinterpret_cast<const uint8_t*>(pgm.data()), pgm.size(), layout));
+	}
+
+	// Little-endian, RGB, in two strips of one row
+	std::vector<uint8_t> tiff = {'I', 'I', 42, 0, 8, 0, 0, 0, 7, 0};
+	auto                 field =
+	  [&](uint16_t tag, uint16_t type, uint32_t count, uint32_t value) {
+		  const uint8_t entry[12] = {uint8_t(tag),
+		                             uint8_t(tag >> 8),
+		                             uint8_t(type),
+		                             0,
+		                             uint8_t(count),
+		                             0,
+		                             0,
+		                             0,
+		                             uint8_t(value),
+		                             uint8_t(value >> 8),
+		                             0,
+		                             0};
+		  tiff.insert(tiff.end(), entry, entry + 12);
+	  };
+	field(256, 3, 1, 2);
+	field(257, 3, 1, 2);
+	field(258, 3, 3, 200); // 8, 8, 8, past the fields
+	field(262, 3, 1, 2);
+	field(273, 4, 2, 206); // 222, 228
+	field(277, 3, 1, 3);
+	field(279, 4, 2, 214); // 6, 6
+	tiff.resize(200, 0);
+	for(uint8_t value :
+	    {8, 0, 8, 0, 8, 0, 222, 0, 0, 0, 228, 0, 0, 0, 6, 0, 0, 0, 6, 0, 0, 0}) {
+		tiff.push_back(value);
+	}
+	tiff.resize(222 + 12, 0);
+	REQUIRE(raw_layout(tiff.data(), tiff.size(), layout));
+	CHECK(layout.width == 2);
+	CHECK(layout.height == 2);
+	CHECK(layout.channels == 3);
+	CHECK(layout.offset == 222);
+
+	// A palette
+	tiff[10 + 12 * 3 + 8] = 3;
+	CHECK(!raw_layout(tiff.data(), tiff.size(), layout));
+
+	CHECK(raw_header("a/b.PPM", 3, 2, 3) == "P6\n3 2\n255\n");
+	CHECK(raw_header("b.pgm", 3, 2, 1) == "P5\n3 2\n255\n");
+	CHECK(raw_header("b.ppm", 3, 2, 4).empty());
+	CHECK(raw_header("b.png", 3, 2, 3).empty());
+}
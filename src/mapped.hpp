@@ -0,0 +1,71 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A file mapped into memory. A mapping that could not be made is empty, and
+// callers fall back to reading or writing the file through OIIO.
+class MappedFile final {
+	private:
+	uint8_t*            m_data;
+	std::size_t         m_size;
+	std::string         m_filename; // of a mapping written through, or empty
+	mutable std::string m_partial;  // where it is written until published
+
+	public:
+	MappedFile();
+
+	// filename's bytes, private to this process: they may be changed, but the
+	// changes are not written back
+	explicit MappedFile(const std::string& filename);
+
+	// A new file of size bytes, all zero, to replace any at filename. Changes
+	// go to the page cache as they are made, to a file beside filename that
+	// publish renames onto it and that is removed if it never is.
+	MappedFile(const std::string& filename, std::size_t size);
+
+	~MappedFile();
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	inline explicit operator bool() const { return m_data != nullptr; }
+
+	inline uint8_t*       data() { return m_data; }
+	inline const uint8_t* data() const { return m_data; }
+	inline std::size_t    size() const { return m_size; }
+
+	inline const std::string& filename() const { return m_filename; }
+
+	// Puts a mapping written through at its filename. False if it cannot be,
+	// or is not such a mapping.
+	bool publish() const;
+};
+
+// Where the pixels of a file stored the way Image holds them begin: 8 bits per
+// channel, channels interleaved, rows contiguous and top first
+struct RawLayout final {
+	unsigned int width;
+	unsigned int height;
+	unsigned int channels;
+	std::size_t  offset;
+};
+
+// Finds the pixels of binary PGM and PPM files of maxval 255 and of
+// uncompressed 8-bit grey or RGB(A) TIFF files in contiguous strips. False
+// for anything else, which needs a decoder.
+bool raw_layout(const uint8_t* data, std::size_t size, RawLayout& layout);
+
+// The header of a binary PGM or PPM file, for a .pgm, .ppm or .pnm filename
+// and 1 or 3 channels, after which the pixels follow raw. Empty for anything
+// else, which needs an encoder.
+std::string raw_header(const std::string& filename,
+                       unsigned int       width,
+                       unsigned int       height,
+                       unsigned int       channels);
+
+#endif
@@ -0,0 +1,246 @@
+#include "pyramid.hpp"
+
+#include "AIS_cubic.hpp"
+#include "ThreadPool.hpp"
+#include "bilinear.hpp"
+#include "stats.hpp"
+#include <OpenImageIO/imageio.h>
+#include <algorithm>
+#include <filesystem>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+#include <doctest\doctest.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+	// Tile edge of MIP-mapped files
+	constexpr int MIP_TILE = 64;
+
+	inline bool covers(const Dimensions& a, const Dimensions& b) {
+		return a.width >= b.width && a.height >= b.height;
+	}
+
+	// How far apart two sizes are, as the larger ratio of their areas
+	double distance(const Dimensions& a, const Dimensions& b) {
+		const double ratio = static_cast<double>(a.width) * a.height /
+		                     (static_cast<double>(b.width) * b.height);
+		return ratio >= 1 ? ratio : 1 / ratio;
+	}
+
+	// Whether dimensions are the source doubled by AIS one or more times
+	bool ais_doubling(const Dimensions& source, const Dimensions& dimensions) {
+		Dimensions level = source;
+		while(level.width < dimensions.width) {
+			level = {level.width * 2 - 1, level.height * 2 - 1};
+		}
+		return level.width == dimensions.width &&
+		       level.height == dimensions.height && !covers(source, level);
+	}
+
+	// Whether target may be resized from level, already rendered from source,
+	// and come out as well as from the source
+	bool derives(Method            method,
+	             const Dimensions& source,
+	             const Dimensions& level,
+	             const Dimensions& target) {
+		if(method == Method::AIS && ais_doubling(source, level)) {
+			return covers(target, level);
+		}
+		return covers(source, level) && covers(level, target) &&
+		       level.width <= 2 * target.width &&
+		       level.height <= 2 * target.height;
+	}
+
+	PyramidLevel parse_level(const std::string& name) {
+		PyramidLevel      level{name, 0.0f, {0, 0}};
+		std::stringstream ss(name);
+		char              by = 0;
+		if(name.find('x') != std::string::npos) {
+			ss >> level.dimensions.width >> by >> level.dimensions.height;
+		} else {
+			ss >> level.scale;
+		}
+		const bool sized = by == 'x' && level.dimensions.width > 0 &&
+		                   level.dimensions.height > 0;
+		if(ss.fail() || !ss.eof() || !(sized || level.scale > 0)) {
+			throw std::runtime_error("pyramid level unrecognized: " + name + "\n");
+		}
+		return level;
+	}
+
+	OIIO::ImageSpec level_spec(const Image& level) {
+		OIIO::ImageSpec spec(
+		  level.dimensions().width,
+		  level.dimensions().height,
+		  level.channels(),
+		  {OIIO::TypeDesc::UINT8, OIIO::TypeDesc::SCALAR, OIIO::TypeDesc::COLOR});
+		spec.tile_width  = MIP_TILE;
+		spec.tile_height = MIP_TILE;
+		return spec;
+	}
+} // namespace
+
+std::vector<PyramidLevel> parse_pyramid(const std::string& list) {
+	std::vector<PyramidLevel> levels;
+	std::stringstream         ss(list);
+	std::string               name;
+	while(std::getline(ss, name, ',')) { levels.push_back(parse_level(name)); }
+	if(levels.empty()) {
+		throw std::runtime_error("pyramid level unrecognized: " + list + "\n");
+	}
+	return levels;
+}
+
+Dimensions level_dimensions(Method              method,
+                            const Dimensions&   dimensions,
+                            const PyramidLevel& level) {
+	if(level.scale > 0) {
+		return target_dimensions(method, dimensions, level.scale);
+	}
+	return level.dimensions;
+}
+
+std::string pyramid_output(const std::string&  output,
+                           const PyramidLevel& level) {
+	const fs::path path(output);
+	const char*    suffix = level.scale > 0 ? "x" : "";
+	return (path.parent_path() / (path.stem().string() + "_" + level.name +
+	                              suffix + path.extension().string()))
+	  .string();
+}
+
+std::vector<Dimensions> mip_dimensions(const Dimensions& top) {
+	std::vector<Dimensions> levels{top};
+	while(levels.back().width > 1 || levels.back().height > 1) {
+		const Dimensions& last = levels.back();
+		levels.push_back(
+		  {std::max(1u, last.width / 2), std::max(1u, last.height / 2)});
+	}
+	return levels;
+}
+
+std::vector<std::unique_ptr<Image>>
+render_pyramid(Method                         method,
+               const Image&                   src,
+               const std::vector<Dimensions>& targets) {
+	const Dimensions& source = src.dimensions();
+
+	// Nearest the source first, so that later levels find theirs rendered
+	std::vector<std::size_t> order(targets.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+		return distance(source, targets[a]) < distance(source, targets[b]);
+	});
+
+	std::vector<std::unique_ptr<Image>> levels(targets.size());
+	for(std::size_t i : order) {
+		const Image* base = &src;
+		for(const auto& level : levels) {
+			if(level &&
+			   derives(method, source, level->dimensions(), targets[i]) &&
+			   distance(level->dimensions(), targets[i]) <
+			     distance(base->dimensions(), targets[i])) {
+				base = level.get();
+			}
+		}
+		levels[i] = std::make_unique<Image>(resize(method, *base, targets[i]));
+	}
+	return levels;
+}
+
+void save_pyramid(const std::vector<std::unique_ptr<Image>>& levels,
+                  const std::vector<std::string>&            filenames) {
+	Expects(levels.size() == filenames.size());
+	const std::ptrdiff_t count = levels.size();
+	parallel_for(0, count, [&](std::ptrdiff_t first, std::ptrdiff_t last) {
+		for(std::ptrdiff_t i = first; i < last; ++i) {
+			levels[i]->save(filenames[i]);
+		}
+	});
+}
+
+void save_mip(const std::vector<std::unique_ptr<Image>>& levels,
+              const std::string&                         filename) {
+	StageTimer timer(Stage::save);
+	auto       out = OIIO::ImageOutput::create(filename);
+	if(!out || !out->supports("mipmap")) {
+		throw std::runtime_error("cannot write MIP levels to " + filename + "\n");
+	}
+
+	auto mode = OIIO::ImageOutput::Create;
+	for(const auto& level : levels) {
+		if(!out->open(filename, level_spec(*level), mode) ||
+		   !out->write_image(
+		     {OIIO::TypeDesc::UINT8, OIIO::TypeDesc::SCALAR, OIIO::TypeDesc::COLOR},
+		     level->data())) {
+			throw std::runtime_error(out->geterror() + "\n");
+		}
+		timer.add_bytes(level->size());
+		mode = OIIO::ImageOutput::AppendMIPLevel;
+	}
+	out->close();
+}
+
+TEST_CASE("Pyramids render each level from the nearest that allows") {
+	SUBCASE("Levels") {
+		const auto levels = parse_pyramid("2,0.25,640x480");
+		REQUIRE(levels.size() == 3);
+		CHECK(levels[0].scale == 2.0f);
+		CHECK(levels[1].scale == 0.25f);
+		CHECK(levels[2].dimensions.width == 640);
+		CHECK(levels[2].dimensions.height == 480);
+		CHECK(pyramid_output("out/a.png", levels[0]) ==
+		      fs::path("out/a_2x.png").string());
+		CHECK(pyramid_output("a.png", levels[2]) == "a_640x480.png");
+		CHECK_THROWS(parse_pyramid("2,,4"));
+		CHECK_THROWS(parse_pyramid("640x"));
+		CHECK_THROWS(parse_pyramid("-1"));
+
+		const auto mip = mip_dimensions({5, 2});
+		REQUIRE(mip.size() == 3);
+		CHECK(mip[1].width == 2);
+		CHECK(mip[1].height == 1);
+		CHECK(mip[2].width == 1);
+	}
+
+	Image src({17, 13}, 3);
+	for(index y = 0; y < 13; ++y) {
+		for(index x = 0; x < 17; ++x) {
+			for(index channel = 0; channel < 3; ++channel) {
+				src.set(x, y, (x * 53 + y * 29 + channel * 71) % 256, channel);
+			}
+		}
+	}
+	auto same = [](const Image& a, const Image& b) {
+		return a.dimensions().width == b.dimensions().width &&
+		       a.dimensions().height == b.dimensions().height &&
+		       std::equal(a.data(), a.data() + a.size(), b.data());
+	};
+
+	SUBCASE("AIS levels through doublings come out as rendered alone") {
+		std::vector<Dimensions> targets;
+		for(float scale : {4.0f, 2.0f, 3.0f, 0.5f}) {
+			targets.push_back(
+			  target_dimensions(Method::AIS, src.dimensions(), scale));
+		}
+		const auto levels = render_pyramid(Method::AIS, src, targets);
+		for(std::size_t i = 0; i < targets.size(); ++i) {
+			CHECK(same(*levels[i], resize(Method::AIS, src, targets[i])));
+		}
+	}
+
+	SUBCASE("Downscales chain at most 2:1") {
+		const auto levels =
+		  render_pyramid(Method::bilinear, src, {{4, 3}, {8, 6}, {2, 2}});
+		auto        shrink = [](const Image& image, const Dimensions& target) {
+			return resize(Method::bilinear, image, target);
+		};
+		const Image half = shrink(src, {8, 6});
+		CHECK(same(*levels[1], half));
+		CHECK(same(*levels[0], shrink(half, {4, 3})));
+		CHECK(same(*levels[2], shrink(shrink(half, {4, 3}), {2, 2})));
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include "Image.hpp"
+#include "resize.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// One size of a pyramid, as given on the command line: a scale such as 2 or
+// 0.25, or exact dimensions such as 640x480
+struct PyramidLevel final {
+	std::string name; // as given, for output file names
+	float       scale;
+	Dimensions  dimensions; // when scale is 0
+};
+
+// Parses a comma-separated list of levels
+std::vector<PyramidLevel> parse_pyramid(const std::string& list);
+
+// The size `method` renders `level` of a source of `dimensions` at
+Dimensions level_dimensions(Method              method,
+                            const Dimensions&   dimensions,
+                            const PyramidLevel& level);
+
+// Where a level is written: output with _2x or _640x480 before the extension
+std::string pyramid_output(const std::string&  output,
+                           const PyramidLevel& level);
+
+// The levels of a MIP map over top: top itself, then each halved, rounding
+// down, until 1x1
+std::vector<Dimensions> mip_dimensions(const Dimensions& top);
+
+// Renders src at every one of targets from a single decode. Each level is
+// resized from the nearest one already rendered that loses nothing against
+// the source: an AIS doubling for any larger AIS level, whose renders pass
+// through it anyway, or a level between the source and a downscale at most
+// 2:1 above it, so that every pixel still contributes; 2:1 bilinear is a box
+// filter. Anything else comes from the source. Levels are returned in the
+// order of targets.
+std::vector<std::unique_ptr<Image>>
+render_pyramid(Method                         method,
+               const Image&                   src,
+               const std::vector<Dimensions>& targets);
+
+// Writes each level to its file, several at once on the global pool
+void save_pyramid(const std::vector<std::unique_ptr<Image>>& levels,
+                  const std::vector<std::string>&            filenames);
+
+// Writes the levels of mip_dimensions as the MIP levels of one tiled file,
+// in a format that holds them, such as TIFF or OpenEXR
+void save_mip(const std::vector<std::unique_ptr<Image>>& levels,
+              const std::string&                         filename);
+
+#endif
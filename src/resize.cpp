@@ -0,0 +1,668 @@
+#include "resize.hpp"
+
+#include "AIS_cubic.hpp"
+#include "BufferPool.hpp"
+#include "IMDDT.hpp"
+#include "area.hpp"
+#include "bilinear.hpp"
+#include "sampling.hpp"
+#include "separable.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <gsl\gsl-lite.hpp>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include <doctest\doctest.h>
+
+using namespace gsl;
+
+namespace {
+	// The most times AIS doubles on the way to a target
+	constexpr std::size_t AIS_MAX_DOUBLINGS = 16;
+
+	// Output rows per band of the resample fused into the last doubling
+	constexpr unsigned int AIS_RESAMPLE_ROWS = 128;
+
+	inline bool same(const Dimensions& a, const Dimensions& b) {
+		return a.width == b.width && a.height == b.height;
+	}
+
+	// Columns are worked out as the rows of the image on its side
+	inline Dimensions transposed(const Dimensions& dimensions) {
+		return {dimensions.height, dimensions.width};
+	}
+
+	// One new pixel between each pair, the source pixels keeping their places
+	inline Dimensions doubled(const Dimensions& dimensions) {
+		return {dimensions.width * 2 - 1, dimensions.height * 2 - 1};
+	}
+
+	// The output rows an AIS band is rendered over, so that [first_row,
+	// end_row) come out exact
+	RowRange ais_window(unsigned int height,
+	                    unsigned int first_row,
+	                    unsigned int end_row) {
+		return {first_row > AIS_HALO ? first_row - AIS_HALO : 0,
+		        std::min(height, end_row + AIS_HALO)};
+	}
+
+	// The source rows of a doubling to `height` rows that [first, end) need
+	RowRange ais_source_rows(unsigned int height, const RowRange& rows) {
+		const RowRange window = ais_window(height, rows.first, rows.end);
+		return {(window.first + 1) / 2, (window.end + 1) / 2};
+	}
+
+	// The source columns of a doubling to `width` columns that [first, end)
+	// need, rendered as an image of their own. Columns within AIS_HALO of the
+	// edge of such a crop differ from the whole image, unless that edge is
+	// the image's own, so the crop reaches that far further.
+	RowRange ais_source_columns(unsigned int width, const RowRange& columns) {
+		const RowRange window = ais_window(width, columns.first, columns.end);
+		return {window.first / 2, (window.end + 1) / 2};
+	}
+
+	// The source rows of a bilinear resample that [first, end) need. Samples
+	// only ever move down the source.
+	RowRange resample_rows(const Dimensions& source,
+	                       const Dimensions& target,
+	                       const RowRange&   rows) {
+		const auto samples = sample_axis(source.height, target.height);
+		return {samples[rows.first].first, samples[rows.end - 1].second + 1};
+	}
+
+	// The source rows of AIS's resample of its last doubling that [first, end)
+	// need
+	RowRange lattice_rows(const Dimensions& source,
+	                      const Dimensions& target,
+	                      const RowRange&   rows) {
+		const auto samples = sample_lattice(source.height, target.height);
+		return {samples[rows.first].first, samples[rows.end - 1].second + 1};
+	}
+
+	// The source rows of a bilinear resize that [first, end) need, by area
+	// when it shrinks
+	RowRange bilinear_rows(const Dimensions& source,
+	                       const Dimensions& target,
+	                       const RowRange&   rows) {
+		if(shrinks(source, target)) {
+			return area_rows(source.height, target.height, rows);
+		}
+		return resample_rows(source, target, rows);
+	}
+
+	// Shrinks by area, anything else by sampling
+	void bilinear_or_area(const ImageView& src, const MutableImageView& dst) {
+		if(shrinks(src.dimensions(), dst.dimensions())) {
+			area(src, dst);
+		} else {
+			bilinear(src, dst);
+		}
+	}
+
+	// The source and each doubling of it, up to the first that covers target
+	std::vector<Dimensions> ais_levels(const Dimensions& source,
+	                                   const Dimensions& target) {
+		std::vector<Dimensions> levels{source};
+		while((levels.back().width < target.width ||
+		       levels.back().height < target.height) &&
+		      levels.size() <= AIS_MAX_DOUBLINGS) {
+			levels.push_back(doubled(levels.back()));
+		}
+		return levels;
+	}
+
+	void copy_rows(const ImageView&        src,
+	               const MutableImageView& dst,
+	               unsigned int            first_row,
+	               unsigned int            end_row) {
+		const std::size_t row_size =
+		  std::size_t{dst.dimensions().width} * dst.channels();
+		for(index y = first_row; y < end_row; ++y) {
+			std::copy_n(src.row(y), row_size, dst.row(y));
+		}
+	}
+
+	// AIS over a band: rendered with a halo of rows into scratch, of which only
+	// the band is kept
+	void AIS_band(const ImageView& src, const MutableImageView& dst) {
+		const Dimensions&  dimensions = dst.dimensions();
+		const unsigned int channels   = dst.channels();
+		const RowRange     window =
+		  ais_window(dimensions.height, dst.first_row(), dst.end_row());
+
+		const std::size_t stride = std::size_t{dimensions.width} * channels;
+		Image scratch({dimensions.width, window.end - window.first},
+		              channels,
+		              Image::Init::none);
+		const MutableImageView band(
+		  scratch.data(), dimensions, channels, stride, window.first, window.end);
+		AIS_cubic(src, band);
+		copy_rows(band, dst, dst.first_row(), dst.end_row());
+	}
+
+	// Rows [first, end) of a doubling level, rendered from the rows of the
+	// level below that they need. Levels alternate between the two buffers:
+	// the level below is always in the other one, and the one below that has
+	// been used up.
+	ImageView render_level(const ImageView&               src,
+	                       const std::vector<Dimensions>& levels,
+	                       std::size_t                    level,
+	                       const RowRange&                rows,
+	                       PooledBuffer (&buffers)[2]) {
+		if(level == 0) { return src; }
+
+		const Dimensions& dimensions = levels[level];
+		const RowRange    needed     = ais_source_rows(dimensions.height, rows);
+		const ImageView   below =
+		  render_level(src, levels, level - 1, needed, buffers);
+
+		const unsigned int channels = src.channels();
+		const std::size_t  stride   = std::size_t{dimensions.width} * channels;
+		PooledBuffer&      buffer   = buffers[level % 2];
+		buffer = BufferPool::global().acquire(stride * (rows.end - rows.first));
+		const MutableImageView out(
+		  buffer.data(), dimensions, channels, stride, rows.first, rows.end);
+		resize(Method::AIS, below, out);
+		return out;
+	}
+
+	// The source columns AIS_region renders output columns [first, end) from:
+	// back through the resample, if any, and every doubling
+	RowRange ais_crop(const std::vector<Dimensions>& levels,
+	                  const Dimensions&              target,
+	                  RowRange                       columns) {
+		std::size_t level = levels.size() - 1;
+		if(level == 0) {
+			return bilinear_rows(
+			  transposed(levels[0]), transposed(target), columns);
+		}
+		if(!same(levels[level], target)) {
+			columns = lattice_rows(
+			  transposed(levels[level]), transposed(target), columns);
+		}
+		for(; level > 0; --level) {
+			columns = ais_source_columns(levels[level].width, columns);
+		}
+		return columns;
+	}
+
+	// AIS over a region narrower than the image. The doublings are rendered
+	// from a crop of the source wide enough for the region's columns, which
+	// come out as in the whole image, and rows as AIS_scaled does; those
+	// columns are then copied or resampled into dst.
+	void AIS_region(const ImageView& src, const MutableImageView& dst) {
+		const auto        levels = ais_levels(src.dimensions(), dst.dimensions());
+		const std::size_t last   = levels.size() - 1;
+		const Dimensions& top    = levels[last];
+		const bool        exact  = same(top, dst.dimensions());
+		PooledBuffer      buffers[2];
+
+		if(last == 0) {
+			bilinear_or_area(src, dst);
+			return;
+		}
+
+		// The rows of the last doubling dst needs, and the source columns its
+		// columns come from, of which the doublings are rendered
+		RowRange rows{dst.first_row(), dst.end_row()};
+		if(!exact) { rows = lattice_rows(top, dst.dimensions(), rows); }
+		const RowRange crop = ais_crop(
+		  levels, dst.dimensions(), {dst.first_column(), dst.end_column()});
+		Expects(crop.first >= src.first_column() && crop.end <= src.end_column());
+		const unsigned int channels = src.channels();
+		const ImageView    cropped(&src.at(crop.first, src.first_row(), 0),
+		                           {crop.end - crop.first, src.dimensions().height},
+		                           channels,
+		                           src.stride(),
+		                           src.first_row(),
+		                           src.end_row());
+		std::vector<Dimensions> crop_levels{cropped.dimensions()};
+		while(crop_levels.size() < levels.size()) {
+			crop_levels.push_back(doubled(crop_levels.back()));
+		}
+		const ImageView doubling =
+		  render_level(cropped, crop_levels, last, rows, buffers);
+
+		// The same pixels as a window onto the whole of the last doubling
+		const unsigned int first_column = crop.first << last;
+		const ImageView    region(doubling.row(rows.first),
+		                          top,
+		                          channels,
+		                          doubling.stride(),
+		                          rows.first,
+		                          rows.end,
+		                          first_column,
+		                          first_column + crop_levels[last].width);
+		if(!exact) {
+			bilinear_lattice(region, dst);
+			return;
+		}
+		const std::size_t row_size =
+		  std::size_t{dst.end_column() - dst.first_column()} * channels;
+		for(index y = dst.first_row(); y < dst.end_row(); ++y) {
+			std::copy_n(&region.at(dst.first_column(), y, 0), row_size, dst.row(y));
+		}
+	}
+
+	// AIS to any size: doubled until it covers dst, then resampled. The last
+	// doubling is rendered a band at a time, each band resampled into dst
+	// straight away, so it never exists at full size.
+	void AIS_scaled(const ImageView& src, const MutableImageView& dst) {
+		const auto        levels = ais_levels(src.dimensions(), dst.dimensions());
+		const std::size_t last   = levels.size() - 1;
+		const Dimensions& top    = levels[last];
+		const RowRange    wanted{dst.first_row(), dst.end_row()};
+		PooledBuffer      buffers[2];
+
+		// Shrinking, or the same size: nothing to double
+		if(last == 0) {
+			bilinear_or_area(src, dst);
+			return;
+		}
+
+		// A power of two: the last doubling is the result
+		if(same(top, dst.dimensions())) {
+			const RowRange rows = ais_source_rows(top.height, wanted);
+			resize(Method::AIS,
+			       render_level(src, levels, last - 1, rows, buffers),
+			       dst);
+			return;
+		}
+
+		// The rows of the last doubling every band together needs, and the rows
+		// of the level below those need
+		const RowRange  rows   = lattice_rows(top, dst.dimensions(), wanted);
+		const RowRange  needed = ais_source_rows(top.height, rows);
+		const ImageView below =
+		  render_level(src, levels, last - 1, needed, buffers);
+
+		const unsigned int channels = src.channels();
+		const std::size_t  stride   = std::size_t{top.width} * channels;
+		for(unsigned int first = wanted.first; first < wanted.end;
+		    first += AIS_RESAMPLE_ROWS) {
+			const unsigned int end = std::min(wanted.end, first + AIS_RESAMPLE_ROWS);
+			const RowRange     band_rows =
+			  lattice_rows(top, dst.dimensions(), {first, end});
+			PooledBuffer band = BufferPool::global().acquire(
+			  stride * (band_rows.end - band_rows.first));
+			const MutableImageView doubling(
+			  band.data(), top, channels, stride, band_rows.first, band_rows.end);
+			resize(Method::AIS, below, doubling);
+			bilinear_lattice(doubling, dst.window(first, end));
+		}
+	}
+} // namespace
+
+Method parse_method(const std::string& name) {
+	for(Method method : {Method::bilinear,
+	                     Method::bicubic,
+	                     Method::lanczos3,
+	                     Method::IMDDT,
+	                     Method::AIS}) {
+		if(name == method_name(method)) { return method; }
+	}
+	throw std::runtime_error("method unrecognized\n");
+}
+
+const char* method_name(Method method) {
+	switch(method) {
+		case Method::bilinear: return "bilinear";
+		case Method::bicubic: return "bicubic";
+		case Method::lanczos3: return "lanczos3";
+		case Method::IMDDT: return "IMDDT";
+		case Method::AIS: return "AIS";
+		default: return "unknown";
+	}
+}
+
+Region parse_region(const std::string& text) {
+	std::stringstream ss(text);
+	Region            region{0, 0, 0, 0};
+	char              comma_1 = 0, comma_2 = 0, times = 0;
+	ss >> region.x >> comma_1 >> region.y >> comma_2 >> region.width >> times >>
+	  region.height;
+	if(!ss || !ss.eof() || comma_1 != ',' || comma_2 != ',' || times != 'x' ||
+	   region.width == 0 || region.height == 0 ||
+	   text.find('-') != std::string::npos) {
+		throw std::runtime_error("region unrecognized: " + text + "\n");
+	}
+	return region;
+}
+
+void check_scale(float scale) {
+	if(!std::isfinite(scale) || scale <= 0) {
+		std::stringstream ss;
+		ss << "scale must be a positive number: " << scale << "\n";
+		throw std::runtime_error(ss.str());
+	}
+}
+
+Dimensions
+target_dimensions(Method method, const Dimensions& dimensions, float scale) {
+	check_scale(scale);
+	// AIS adds the last source pixel to the lattice's scaled spans
+	const unsigned int lattice = method == Method::AIS ? 1 : 0;
+	const float        width   = (dimensions.width - lattice) * scale;
+	const float        height  = (dimensions.height - lattice) * scale;
+	if(width + lattice < 1 || height + lattice < 1 ||
+	   width + lattice > MAX_TARGET_SIDE || height + lattice > MAX_TARGET_SIDE ||
+	   double{width} * height > MAX_TARGET_PIXELS) {
+		std::stringstream ss;
+		ss << "scale " << scale << " gives an output of " << width + lattice
+		   << "x" << height + lattice << " pixels, outside 1x1 to "
+		   << MAX_TARGET_SIDE << "x" << MAX_TARGET_SIDE << " and "
+		   << MAX_TARGET_PIXELS << " pixels\n";
+		throw std::runtime_error(ss.str());
+	}
+	return {static_cast<unsigned int>(width) + lattice,
+	        static_cast<unsigned int>(height) + lattice};
+}
+
+RowRange source_rows(Method            method,
+                     const Dimensions& source,
+                     const Dimensions& target,
+                     unsigned int      first_row,
+                     unsigned int      end_row) {
+	Expects(first_row < end_row && end_row <= target.height);
+	RowRange rows{first_row, end_row};
+	if(method == Method::AIS) {
+		// Back down through the resample, if any, and every doubling
+		const auto  levels = ais_levels(source, target);
+		std::size_t level  = levels.size() - 1;
+		if(level == 0) { return bilinear_rows(source, target, rows); }
+		if(!same(levels[level], target)) {
+			rows = lattice_rows(levels[level], target, rows);
+		}
+		for(; level > 0; --level) {
+			rows = ais_source_rows(levels[level].height, rows);
+		}
+		return rows;
+	}
+	if(method == Method::bicubic || method == Method::lanczos3) {
+		const Filter     filter = method == Method::bicubic ? Filter::bicubic :
+		                                                      Filter::lanczos3;
+		const FilterAxis axis = filter_axis(filter, source.height, target.height);
+		return {axis.first[first_row], axis.first[end_row - 1] + axis.taps};
+	}
+	if(method == Method::bilinear) {
+		return bilinear_rows(source, target, rows);
+	}
+	return resample_rows(source, target, rows);
+}
+
+Region source_region(Method            method,
+                     const Dimensions& source,
+                     const Dimensions& target,
+                     const Region&     region) {
+	Expects(region.x + region.width <= target.width);
+	const RowRange rows = source_rows(
+	  method, source, target, region.y, region.y + region.height);
+	const RowRange columns =
+	  method == Method::AIS ?
+	    ais_crop(ais_levels(source, target),
+	             target,
+	             {region.x, region.x + region.width}) :
+	    source_rows(method,
+	                transposed(source),
+	                transposed(target),
+	                region.x,
+	                region.x + region.width);
+	return {columns.first,
+	        rows.first,
+	        columns.end - columns.first,
+	        rows.end - rows.first};
+}
+
+void resize(Method method, const ImageView& src, const MutableImageView& dst) {
+	const bool whole =
+	  dst.first_row() == 0 && dst.end_row() == dst.dimensions().height;
+	switch(method) {
+		case Method::bilinear: bilinear_or_area(src, dst); break;
+		case Method::bicubic: bicubic(src, dst); break;
+		case Method::lanczos3: lanczos3(src, dst); break;
+		case Method::IMDDT: IMDDT(src, dst); break;
+		case Method::AIS:
+			if(!dst.full_width()) {
+				AIS_region(src, dst);
+			} else if(!same(dst.dimensions(), doubled(src.dimensions()))) {
+				AIS_scaled(src, dst);
+			} else if(whole) {
+				AIS_cubic(src, dst);
+			} else {
+				AIS_band(src, dst);
+			}
+			break;
+		default: throw std::runtime_error("method unrecognized\n");
+	}
+}
+
+Image resize(Method method, const Image& src, const Dimensions& target) {
+	Image dst(target, src.channels(), Image::Init::none);
+	resize(method, ImageView(src), MutableImageView(dst));
+	return dst;
+}
+
+Image resize(Method method, const Image& src, float scale) {
+	return resize(
+	  method, src, target_dimensions(method, src.dimensions(), scale));
+}
+
+Image resize(Method             method,
+             const Image&       src,
+             float              scale,
+             const std::string& outFile) {
+	Image dst(outFile,
+	          target_dimensions(method, src.dimensions(), scale),
+	          src.channels());
+	resize(method, ImageView(src), MutableImageView(dst));
+	return dst;
+}
+
+Image resize_region(Method            method,
+                    const ImageView&  src,
+                    const Dimensions& target,
+                    const Region&     region) {
+	Expects(region.x + region.width <= target.width);
+	Expects(region.y + region.height <= target.height);
+	Image out({region.width, region.height}, src.channels(), Image::Init::none);
+	const MutableImageView dst(out.data(),
+	                           target,
+	                           src.channels(),
+	                           std::size_t{region.width} * src.channels(),
+	                           region.y,
+	                           region.y + region.height,
+	                           region.x,
+	                           region.x + region.width);
+	resize(method, src, dst);
+	return out;
+}
+
+TEST_CASE("Bands render like the whole image") {
+	std::mt19937                       rng(11);
+	std::uniform_int_distribution<int> value(0, 255);
+
+	Image src({19, 23}, 3);
+	for(index y = 0; y < 23; ++y) {
+		for(index x = 0; x < 19; ++x) {
+			for(index channel = 0; channel < 3; ++channel) {
+				src.set(x, y, value(rng), channel);
+			}
+		}
+	}
+
+	// Each band sees only the source rows source_rows asks for
+	auto banded = [&](Method method, float scale, unsigned int band_rows) {
+		const Image       whole  = resize(method, src, scale);
+		const Dimensions& target = whole.dimensions();
+		Image             bands(target, 3);
+		for(unsigned int first = 0; first < target.height; first += band_rows) {
+			const unsigned int end = std::min(target.height, first + band_rows);
+			const RowRange     rows =
+			  source_rows(method, src.dimensions(), target, first, end);
+			const ImageView in(
+			  src.row(rows.first), src.dimensions(), 3, 19 * 3, rows.first, rows.end);
+			const MutableImageView out(
+			  bands.row(first), target, 3, target.width * 3, first, end);
+			resize(method, in, out);
+		}
+		return std::equal(whole.data(),
+		                  whole.data() + target.width * target.height * 3,
+		                  bands.data());
+	};
+
+	CHECK(banded(Method::bilinear, 1.7f, 5));
+	CHECK(banded(Method::bilinear, 0.6f, 4));
+	CHECK(banded(Method::bilinear, 0.3f, 3));
+	CHECK(banded(Method::AIS, 0.4f, 2));
+	CHECK(banded(Method::bicubic, 1.7f, 5));
+	CHECK(banded(Method::lanczos3, 0.6f, 4));
+	CHECK(banded(Method::IMDDT, 1.7f, 5));
+	CHECK(banded(Method::AIS, 2.0f, 7));
+	CHECK(banded(Method::AIS, 3.0f, 7));
+	CHECK(banded(Method::AIS, 1.5f, 5));
+}
+
+TEST_CASE("Regions render like the whole image") {
+	std::mt19937                       rng(13);
+	std::uniform_int_distribution<int> value(0, 255);
+
+	Image src({29, 23}, 3);
+	for(index y = 0; y < 23; ++y) {
+		for(index x = 0; x < 29; ++x) {
+			for(index channel = 0; channel < 3; ++channel) {
+				src.set(x, y, value(rng), channel);
+			}
+		}
+	}
+
+	// Each region sees only the source pixels source_region asks for
+	auto cut = [&](Method method, float scale, const Region& region) {
+		const Image       whole  = resize(method, src, scale);
+		const Dimensions& target = whole.dimensions();
+		const Region      needed =
+		  source_region(method, src.dimensions(), target, region);
+		const ImageView in = ImageView(src).window(needed.y,
+		                                           needed.y + needed.height,
+		                                           needed.x,
+		                                           needed.x + needed.width);
+		const Image     out = resize_region(method, in, target, region);
+		for(index y = 0; y < region.height; ++y) {
+			for(index x = 0; x < region.width * 3; ++x) {
+				if(out.row(y)[x] != whole.row(region.y + y)[region.x * 3 + x]) {
+					return false;
+				}
+			}
+		}
+		return true;
+	};
+
+	for(const Region& region : {Region{0, 0, 5, 4},
+	                            Region{7, 9, 6, 5},
+	                            Region{13, 3, 11, 1},
+	                            Region{20, 16, 9, 6}}) {
+		CHECK(cut(Method::bilinear, 1.7f, region));
+		CHECK(cut(Method::bilinear, 1.0f, region));
+		CHECK(cut(Method::bicubic, 1.7f, region));
+		CHECK(cut(Method::lanczos3, 1.2f, region));
+		CHECK(cut(Method::IMDDT, 1.7f, region));
+		CHECK(cut(Method::bilinear, 3.0f, region));
+		CHECK(cut(Method::IMDDT, 3.0f, region));
+		CHECK(cut(Method::IMDDT, 4.0f, region));
+		CHECK(cut(Method::AIS, 2.0f, region));
+		CHECK(cut(Method::AIS, 3.0f, region));
+		CHECK(cut(Method::AIS, 1.5f, region));
+	}
+
+	// Shrinks, down to a region of one pixel
+	CHECK(cut(Method::bilinear, 0.3f, {1, 2, 5, 3}));
+	CHECK(cut(Method::bilinear, 0.3f, {7, 5, 1, 1}));
+	CHECK(cut(Method::AIS, 0.4f, {2, 3, 9, 4}));
+
+	// Whole rows take the band paths
+	CHECK(cut(Method::AIS, 3.0f, {0, 30, 85, 9}));
+
+	const Region region = parse_region("512,256,256x128");
+	CHECK(region.x == 512);
+	CHECK(region.height == 128);
+	CHECK_THROWS(parse_region("512,256,256"));
+	CHECK_THROWS(parse_region("1,2,0x4"));
+	CHECK_THROWS(parse_region("1,-2,3x4"));
+}
+
+TEST_CASE("AIS scales by doubling and then resampling") {
+	Image src({9, 7}, 3);
+	for(index y = 0; y < 7; ++y) {
+		for(index x = 0; x < 9; ++x) {
+			for(index channel = 0; channel < 3; ++channel) {
+				src.set(x, y, (x * 37 + y * 91 + channel * 50) % 256, channel);
+			}
+		}
+	}
+
+	// Powers of two are repeated doublings, with nothing to resample
+	const Image twice = AIS_cubic(AIS_cubic(src));
+	const Image four  = resize(Method::AIS, src, 4.0f);
+	CHECK(four.dimensions().width == 33);
+	CHECK(std::equal(twice.data(), twice.data() + 33 * 25 * 3, four.data()));
+
+	// Others finish with a resample of the next doubling up, on its lattice:
+	// 24 spans onto its 32, so every third pixel is every fourth of it and
+	// the source's own pixels stay where they were
+	const Image three = resize(Method::AIS, src, 3.0f);
+	CHECK(three.dimensions().width == 25);
+	CHECK(three.dimensions().height == 19);
+	Image resampled({25, 19}, 3);
+	bilinear_lattice(ImageView(twice), MutableImageView(resampled));
+	CHECK(std::equal(
+	  resampled.data(), resampled.data() + 25 * 19 * 3, three.data()));
+	for(index y = 0; y < 19; y += 3) {
+		for(index x = 0; x < 25; x += 3) {
+			for(index channel = 0; channel < 3; ++channel) {
+				CHECK(three.at(x, y, channel) ==
+				      twice.at(x / 3 * 4, y / 3 * 4, channel));
+			}
+		}
+	}
+	CHECK(three.at(24, 18, 0) == src.at(8, 6, 0));
+}
+
+TEST_CASE("Scales must give an output of a sensible size") {
+	const Dimensions size(640, 480);
+	CHECK(target_dimensions(Method::bilinear, size, 0.5f).width == 320);
+	CHECK(target_dimensions(Method::AIS, size, 0.001f).width == 1);
+	for(float scale : {0.0f,
+	                   -1.0f,
+	                   std::nanf(""),
+	                   std::numeric_limits<float>::infinity(),
+	                   0.001f,
+	                   1000.0f}) {
+		CHECK_THROWS(target_dimensions(Method::bilinear, size, scale));
+	}
+}
+
+TEST_CASE("Resizing an image again takes every buffer from the pool") {
+	// Counted with stats on, left as they were found
+	const bool enabled = stats_enabled();
+	if(!enabled) { enable_stats(false); }
+	const Image src({97, 61}, 3);
+	auto        resize_all = [&] {
+		for(Method method : {Method::bilinear,
+		                     Method::bicubic,
+		                     Method::lanczos3,
+		                     Method::IMDDT,
+		                     Method::AIS}) {
+			for(float scale : {0.5f, 2.0f, 2.5f}) { resize(method, src, scale); }
+		}
+	};
+
+	resize_all();
+	const std::uint64_t allocations = counted(Counter::pool_allocations);
+	resize_all();
+	CHECK(counted(Counter::pool_allocations) == allocations);
+	CHECK(counted(Counter::pool_reuses) > 0);
+	if(!enabled) { disable_stats(); }
+}
@@ -0,0 +1,85 @@
+#ifndef RESIZE_H
+#define RESIZE_H
+
+#include "Image.hpp"
+#include "ImageT.hpp"
+#include <cstddef>
+#include <string>
+
+enum class Method { bilinear, bicubic, lanczos3, IMDDT, AIS };
+
+// Parses "bilinear", "bicubic", "lanczos3", "IMDDT" or "AIS"
+Method parse_method(const std::string& name);
+
+const char* method_name(Method method);
+
+// Largest output side and pixel count a scale may ask for
+constexpr unsigned int MAX_TARGET_SIDE   = 1u << 16;
+constexpr std::size_t  MAX_TARGET_PIXELS = std::size_t{1} << 30;
+
+// Throws unless scale is finite and above zero
+void check_scale(float scale);
+
+// The size `method` produces from a source of `dimensions` at `scale`. AIS
+// keeps the source pixels on a lattice, (width - 1) * scale + 1 wide, so that
+// 2x is one doubling and 4x two. Other scales resample the next doubling up.
+// Throws for a scale check_scale rejects, and for a size that is empty or
+// beyond the limits above.
+Dimensions
+target_dimensions(Method method, const Dimensions& dimensions, float scale);
+
+// Source rows [first, end), or columns
+struct RowRange final {
+	unsigned int first;
+	unsigned int end;
+};
+
+// The source rows needed to render output rows [first_row, end_row) of a
+// resize from `source` to `target`
+RowRange source_rows(Method            method,
+                     const Dimensions& source,
+                     const Dimensions& target,
+                     unsigned int      first_row,
+                     unsigned int      end_row);
+
+// A rectangle of output pixels, from column x and row y
+struct Region final {
+	unsigned int x;
+	unsigned int y;
+	unsigned int width;
+	unsigned int height;
+};
+
+// Parses "x,y,widthxheight", as in 512,256,256x256
+Region parse_region(const std::string& text);
+
+// The source pixels needed to render `region` of a resize from `source` to
+// `target`: those under it and the halo the method reaches past them
+Region source_region(Method            method,
+                     const Dimensions& source,
+                     const Dimensions& target,
+                     const Region&     region);
+
+// Resizes src to the size of dst. dst may be a window onto a band of output
+// rows, or onto any region, which then comes out exactly as in the full image;
+// src must hold at least the rows source_rows gives for it, or the region
+// source_region gives.
+void resize(Method method, const ImageView& src, const MutableImageView& dst);
+
+// Only `region` of the resize of src to target, into an image of its own
+Image resize_region(Method            method,
+                    const ImageView&  src,
+                    const Dimensions& target,
+                    const Region&     region);
+
+Image resize(Method method, const Image& src, const Dimensions& target);
+Image resize(Method method, const Image& src, float scale);
+
+// Resizes src into an image of outFile (see Image), which for formats that
+// store pixels raw renders straight into the file
+Image resize(Method             method,
+             const Image&       src,
+             float              scale,
+             const std::string& outFile);
+
+#endif
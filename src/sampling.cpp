@@ -0,0 +1,46 @@
+#include "sampling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <gsl\gsl-lite.hpp>
+
+using namespace gsl;
+
+std::vector<AxisSample> sample_axis(unsigned int srcSize,
+                                    unsigned int dstSize) {
+	std::vector<AxisSample> samples(dstSize);
+	for(index pos_dst = 0; pos_dst < dstSize; ++pos_dst) {
+		const uint64_t position   = uint64_t{srcSize} * pos_dst;
+		const index    pos_src    = position / dstSize;
+		const double   fraction   = position % dstSize;
+		samples[pos_dst].first    = pos_src;
+		samples[pos_dst].second   = std::min<index>(pos_src + 1, srcSize - 1);
+		samples[pos_dst].distance = fraction / dstSize;
+	}
+	return samples;
+}
+
+std::vector<AxisSample> sample_lattice(unsigned int srcSize,
+                                       unsigned int dstSize) {
+	std::vector<AxisSample> samples(dstSize);
+	const unsigned int      spans = std::max(dstSize, 2u) - 1;
+	for(index pos_dst = 0; pos_dst < dstSize; ++pos_dst) {
+		const uint64_t position   = uint64_t{srcSize - 1} * pos_dst;
+		const index    pos_src    = position / spans;
+		const double   fraction   = position % spans;
+		samples[pos_dst].first    = pos_src;
+		samples[pos_dst].second   = std::min<index>(pos_src + 1, srcSize - 1);
+		samples[pos_dst].distance = fraction / spans;
+	}
+	return samples;
+}
+
+unsigned int integer_ratio(unsigned int srcSize, unsigned int dstSize) {
+	return dstSize % srcSize == 0 ? dstSize / srcSize : 0;
+}
+
+unsigned int fixed_distance(double distance, unsigned int bits) {
+	Expects(distance >= 0.0 && distance <= 1.0);
+	return std::lround(std::ldexp(distance, bits));
+}
@@ -0,0 +1,44 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <array>
+#include <vector>
+
+// Where one destination row or column lands in the source: the two
+// neighbouring source indices and the fractional distance from the first
+struct AxisSample final {
+	unsigned int first;
+	unsigned int second;
+	double       distance;
+};
+
+// The samples of every destination index. Positions are worked out in whole
+// numbers, so that samples the same fraction into a source pixel have the
+// same distance.
+std::vector<AxisSample> sample_axis(unsigned int srcSize, unsigned int dstSize);
+
+// The same with the first and last destination indices on the first and last
+// source ones, each of the dstSize - 1 spans between samples
+// (srcSize - 1) / (dstSize - 1) long, as AIS places the pixels of a doubling
+std::vector<AxisSample> sample_lattice(unsigned int srcSize,
+                                       unsigned int dstSize);
+
+// dstSize / srcSize when that is a whole number, 0 otherwise. A whole ratio
+// splits every source pixel into the same samples.
+unsigned int integer_ratio(unsigned int srcSize, unsigned int dstSize);
+
+// A distance in [0, 1] as a fixed-point fraction with `bits` fractional bits
+unsigned int fixed_distance(double distance, unsigned int bits);
+
+// fixed_distance of the Ratio samples in a source pixel, k / Ratio for each
+// k, as constants. None of them is a tie that could round either way.
+template<unsigned int Ratio>
+constexpr std::array<unsigned int, Ratio> ratio_distances(unsigned int bits) {
+	std::array<unsigned int, Ratio> distances{};
+	for(unsigned int k = 0; k < Ratio; ++k) {
+		distances[k] = ((2 * k << bits) + Ratio) / (2 * Ratio);
+	}
+	return distances;
+}
+
+#endif
@@ -0,0 +1,393 @@
+#include "separable.hpp"
+#include "ThreadPool.hpp"
+#include "kernels.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <gsl\gsl-lite.hpp>
+#include <random>
+#include <utility>
+
+#include <doctest\doctest.h>
+
+using namespace gsl;
+
+namespace {
+	constexpr double PI = 3.14159265358979323846;
+
+	unsigned int radius(Filter filter) {
+		return filter == Filter::bicubic ? 2 : 3;
+	}
+
+	double sinc(double x) {
+		if(x == 0) { return 1; }
+		return std::sin(PI * x) / (PI * x);
+	}
+
+	double kernel(Filter filter, double x) {
+		x = std::abs(x);
+		switch(filter) {
+			case Filter::bicubic:
+				if(x < 1) { return (1.5 * x - 2.5) * x * x + 1; }
+				if(x < 2) { return ((-0.5 * x + 2.5) * x - 4) * x + 2; }
+				return 0;
+			case Filter::lanczos3: return x < 3 ? sinc(x) * sinc(x / 3) : 0;
+			default: return 0;
+		}
+	}
+
+	// The weighted sum of every Channels-th value from pixel, spelled out so
+	// that it needs no loop
+	template<unsigned int Channels, std::size_t... K>
+	inline int dot(const int16_t*  weight,
+	               const uint8_t*  pixel,
+	               std::index_sequence<K...>) {
+		return (0 + ... + (weight[K] * pixel[K * Channels]));
+	}
+
+	// Horizontal pass over one source row, to FILTER_INTERMEDIATE_BITS, for
+	// output columns [first_x, end_x). in is source column first_in. Taps is
+	// columns.taps, or 0 when only known at run time.
+	template<unsigned int Channels, unsigned int Taps>
+	void filter_row_columns(const FilterAxis& columns,
+	                        index             first_x,
+	                        index             end_x,
+	                        unsigned int      channels,
+	                        const uint8_t*    in,
+	                        index             first_in,
+	                        int16_t*          out) {
+		constexpr int      shift = FILTER_BITS - FILTER_INTERMEDIATE_BITS;
+		const unsigned int taps  = Taps == 0 ? columns.taps : Taps;
+		if(Channels != DYNAMIC_CHANNELS) { channels = Channels; }
+
+		for(index pos_dst_x = first_x; pos_dst_x < end_x; ++pos_dst_x) {
+			const uint8_t* pixel =
+			  in + (columns.first[pos_dst_x] - first_in) * channels;
+			const int16_t* weight = &columns.weights[pos_dst_x * taps];
+			for(index channel = 0; channel < channels; ++channel) {
+				int sum = 1 << (shift - 1);
+				if constexpr(Taps != 0 && Channels != DYNAMIC_CHANNELS) {
+					sum += dot<Channels>(
+					  weight, pixel + channel, std::make_index_sequence<Taps>());
+				} else {
+					for(index k = 0; k < taps; ++k) {
+						sum += weight[k] * pixel[k * channels + channel];
+					}
+				}
+				out[channel] = sum >> shift;
+			}
+			out += channels;
+		}
+	}
+
+	template<unsigned int Channels>
+	void filter_rows(const FilterAxis&               columns,
+	                 const FilterAxis&               rows,
+	                 ImageT<const uint8_t, Channels> src,
+	                 ImageT<uint8_t, Channels>       dst) {
+		const unsigned int channels = src.channels();
+
+		// Only the columns dst has, when it is a window onto a region
+		const index       first_x  = dst.first_column();
+		const index       end_x    = dst.end_column();
+		const std::size_t row_size = std::size_t(end_x - first_x) * channels;
+		Expects(first_x == end_x ||
+		        (columns.first[first_x] >= src.first_column() &&
+		         columns.first[end_x - 1] + columns.taps <= src.end_column()));
+
+		// Upscales, the common case, have the kernel's own width, halvings
+		// twice that plus one, and area passes two or three; those widths are
+		// unrolled
+		auto filter_columns = &filter_row_columns<Channels, 0>;
+		switch(columns.taps) {
+			case 2: filter_columns = &filter_row_columns<Channels, 2>; break;
+			case 3: filter_columns = &filter_row_columns<Channels, 3>; break;
+			case 4: filter_columns = &filter_row_columns<Channels, 4>; break;
+			case 6: filter_columns = &filter_row_columns<Channels, 6>; break;
+			case 9: filter_columns = &filter_row_columns<Channels, 9>; break;
+			case 13: filter_columns = &filter_row_columns<Channels, 13>; break;
+			default: break;
+		}
+		auto filter_source_row = [&](unsigned int pos_src_y, int16_t* out) {
+			filter_columns(columns,
+			               first_x,
+			               end_x,
+			               channels,
+			               src.row(pos_src_y),
+			               src.first_column(),
+			               out);
+		};
+
+		const Kernels& simd = kernels();
+
+		// Only the rows dst has, when it is a window onto a band
+		const index first_row = dst.first_row();
+		const index end_row   = dst.end_row();
+		parallel_for(first_row, end_row, [&](index first_y, index last_y) {
+			// The filtered source rows under the kernel, in a ring in which source
+			// row y has slot y % taps. The kernel moves down one output row at a
+			// time, so most of its rows are already there.
+			constexpr unsigned int      none = ~0u;
+			const unsigned int          taps = rows.taps;
+			std::vector<int16_t>        ring(taps * row_size);
+			std::vector<unsigned int>   held(taps, none);
+			std::vector<const int16_t*> window(taps);
+
+			for(index pos_dst_y = first_y; pos_dst_y < last_y; ++pos_dst_y) {
+				for(unsigned int k = 0; k < taps; ++k) {
+					const unsigned int pos_src_y = rows.first[pos_dst_y] + k;
+					const unsigned int slot      = pos_src_y % taps;
+					int16_t*           row       = ring.data() + slot * row_size;
+					if(held[slot] != pos_src_y) {
+						filter_source_row(pos_src_y, row);
+						held[slot] = pos_src_y;
+					}
+					window[k] = row;
+				}
+
+				const FilterSpan span = {
+				  window.data(), &rows.weights[pos_dst_y * taps], taps};
+				simd.filter_row(span, dst.row(pos_dst_y), row_size);
+			}
+		});
+	}
+
+	// Rounding leaves the sum off by a little, which the largest weight takes
+	// up
+	void fix_weights(const std::vector<double>& weights,
+	                 double                     total,
+	                 int16_t*                   fixed) {
+		int          sum     = 0;
+		unsigned int largest = 0;
+		for(unsigned int k = 0; k < weights.size(); ++k) {
+			fixed[k] = std::lround(std::ldexp(weights[k] / total, FILTER_BITS));
+			sum += fixed[k];
+			if(fixed[k] > fixed[largest]) { largest = k; }
+		}
+		fixed[largest] += (1 << FILTER_BITS) - sum;
+	}
+} // namespace
+
+FilterAxis
+filter_axis(Filter filter, unsigned int srcSize, unsigned int dstSize) {
+	const double       scale   = static_cast<double>(srcSize) / dstSize;
+	const double       stretch = std::max(1.0, scale);
+	const double       support = radius(filter) * stretch;
+	const unsigned int span =
+	  scale <= 1 ? 2 * radius(filter) : std::ceil(2 * support) + 1;
+
+	FilterAxis axis;
+	axis.taps = std::min(span, srcSize);
+	axis.first.resize(dstSize);
+	axis.weights.resize(std::size_t{dstSize} * axis.taps);
+
+	std::vector<double> weights(axis.taps);
+	for(index pos_dst = 0; pos_dst < dstSize; ++pos_dst) {
+		// Pixel centres line up
+		const double center = (pos_dst + 0.5) * scale - 0.5;
+		const index  start  = std::floor(center - support) + 1;
+		const index  first  = std::clamp<index>(start, 0, srcSize - axis.taps);
+
+		std::fill(weights.begin(), weights.end(), 0.0);
+		double total = 0;
+		for(index pos_src = start; pos_src < start + span; ++pos_src) {
+			const double weight = kernel(filter, (pos_src - center) / stretch);
+			const index  edge   = std::clamp<index>(pos_src, 0, srcSize - 1);
+			weights[edge - first] += weight;
+			total += weight;
+		}
+
+		fix_weights(weights, total, &axis.weights[pos_dst * axis.taps]);
+		axis.first[pos_dst] = first;
+	}
+	return axis;
+}
+
+FilterAxis
+area_axis(double extent, unsigned int srcSize, unsigned int dstSize) {
+	const double scale = extent / dstSize;
+
+	FilterAxis axis;
+	axis.taps = std::min<unsigned int>(std::ceil(scale) + 1, srcSize);
+	axis.first.resize(dstSize);
+	axis.weights.resize(std::size_t{dstSize} * axis.taps);
+
+	std::vector<double> weights(axis.taps);
+	for(index pos_dst = 0; pos_dst < dstSize; ++pos_dst) {
+		const double start = pos_dst * scale;
+		const double end   = std::min(extent, (pos_dst + 1) * scale);
+		const index  first =
+		  std::min<index>(std::floor(start), srcSize - axis.taps);
+
+		// Source pixel pos_src covers [pos_src, pos_src + 1) of the extent
+		for(unsigned int k = 0; k < axis.taps; ++k) {
+			const double left  = std::max<double>(start, first + k);
+			const double right = std::min<double>(end, first + k + 1);
+			weights[k]         = std::max(0.0, right - left);
+		}
+		fix_weights(weights, end - start, &axis.weights[pos_dst * axis.taps]);
+		axis.first[pos_dst] = first;
+	}
+	return axis;
+}
+
+void filter_separable(const FilterAxis&       columns,
+                      const FilterAxis&       rows,
+                      const ImageView&        src,
+                      const MutableImageView& dst) {
+	dispatch_channels(src, dst, [&](auto in, auto out) {
+		filter_rows(columns, rows, in, out);
+	});
+}
+
+Image bicubic(const Image& src, const Dimensions& targetDim) {
+	Image dst(targetDim, src.channels(), Image::Init::none);
+	bicubic(ImageView(src), MutableImageView(dst));
+	return dst;
+}
+
+void bicubic(const ImageView& src, const MutableImageView& dst) {
+	StageTimer timer(Stage::bicubic, dst.values());
+	filter_separable(filter_axis(Filter::bicubic,
+	                             src.dimensions().width,
+	                             dst.dimensions().width),
+	                 filter_axis(Filter::bicubic,
+	                             src.dimensions().height,
+	                             dst.dimensions().height),
+	                 src,
+	                 dst);
+}
+
+Image lanczos3(const Image& src, const Dimensions& targetDim) {
+	Image dst(targetDim, src.channels(), Image::Init::none);
+	lanczos3(ImageView(src), MutableImageView(dst));
+	return dst;
+}
+
+void lanczos3(const ImageView& src, const MutableImageView& dst) {
+	StageTimer timer(Stage::lanczos3, dst.values());
+	filter_separable(filter_axis(Filter::lanczos3,
+	                             src.dimensions().width,
+	                             dst.dimensions().width),
+	                 filter_axis(Filter::lanczos3,
+	                             src.dimensions().height,
+	                             dst.dimensions().height),
+	                 src,
+	                 dst);
+}
+
+TEST_CASE("Separable filters keep the identity exact and flat areas flat") {
+	std::mt19937                       rng(5);
+	std::uniform_int_distribution<int> value(0, 255);
+
+	Image noise({21, 16}, 3);
+	Image flat({21, 16}, 3);
+	for(index y = 0; y < 16; ++y) {
+		for(index x = 0; x < 21; ++x) {
+			for(index channel = 0; channel < 3; ++channel) {
+				noise.set(x, y, value(rng), channel);
+				flat.set(x, y, 77 + channel, channel);
+			}
+		}
+	}
+	auto all = [](const Image& image, auto predicate) {
+		for(index y = 0; y < image.dimensions().height; ++y) {
+			for(index x = 0; x < image.dimensions().width; ++x) {
+				for(index channel = 0; channel < image.channels(); ++channel) {
+					if(!predicate(x, y, channel)) { return false; }
+				}
+			}
+		}
+		return true;
+	};
+
+	using Resample = Image (*)(const Image&, const Dimensions&);
+	for(Resample resample : {Resample(bicubic), Resample(lanczos3)}) {
+		// Kernels vanish at whole pixel offsets
+		const Image same = resample(noise, {21, 16});
+		CHECK(all(same, [&](index x, index y, index channel) {
+			return same.at(x, y, channel) == noise.at(x, y, channel);
+		}));
+
+		for(const Dimensions& targetDim : {Dimensions(47, 39), Dimensions(8, 5)}) {
+			const Image resized = resample(flat, targetDim);
+			CHECK(all(resized, [&](index x, index y, index channel) {
+				return resized.at(x, y, channel) == 77 + channel;
+			}));
+		}
+	}
+
+	// The weight of every source index in destination index pos_dst, with
+	// taps past the edges on the edge pixels
+	auto taps = [](Filter       filter,
+	               unsigned int srcSize,
+	               unsigned int dstSize,
+	               index        pos_dst) {
+		const double        scale   = static_cast<double>(srcSize) / dstSize;
+		const double        stretch = std::max(1.0, scale);
+		const double        support = radius(filter) * stretch;
+		const double        center  = (pos_dst + 0.5) * scale - 0.5;
+		std::vector<double> weights(srcSize);
+		double              total = 0;
+		for(index pos_src = std::floor(center - support) + 1;
+		    pos_src < center + support;
+		    ++pos_src) {
+			const double weight = kernel(filter, (pos_src - center) / stretch);
+			weights[std::clamp<index>(pos_src, 0, srcSize - 1)] += weight;
+			total += weight;
+		}
+		for(double& weight : weights) { weight /= total; }
+		return weights;
+	};
+
+	// Each filter within one level of the same filter applied directly, in
+	// double precision
+	auto direct = [&](Filter filter, const Image& src, const Dimensions& target) {
+		const Dimensions& source = src.dimensions();
+		Image             dst(target, src.channels());
+		for(index y = 0; y < target.height; ++y) {
+			const auto rows = taps(filter, source.height, target.height, y);
+			for(index x = 0; x < target.width; ++x) {
+				const auto columns = taps(filter, source.width, target.width, x);
+				for(index channel = 0; channel < src.channels(); ++channel) {
+					double sum = 0;
+					for(index v = 0; v < source.height; ++v) {
+						for(index u = 0; u < source.width; ++u) {
+							sum += rows[v] * columns[u] * src.at(u, v, channel);
+						}
+					}
+					dst.set(x, y, std::clamp(std::lround(sum), 0l, 255l), channel);
+				}
+			}
+		}
+		return dst;
+	};
+	for(Filter filter : {Filter::bicubic, Filter::lanczos3}) {
+		const Resample resample =
+		  filter == Filter::bicubic ? Resample(bicubic) : Resample(lanczos3);
+		for(const Dimensions& targetDim : {Dimensions(47, 39), Dimensions(8, 5)}) {
+			const Image resized = resample(noise, targetDim);
+			const Image exact   = direct(filter, noise, targetDim);
+			CHECK(all(resized, [&](index x, index y, index channel) {
+				return std::abs(resized.at(x, y, channel) -
+				                exact.at(x, y, channel)) <= 1;
+			}));
+		}
+	}
+
+	for(Filter filter : {Filter::bicubic, Filter::lanczos3}) {
+		for(unsigned int dstSize : {3u, 16u, 40u}) {
+			const FilterAxis axis = filter_axis(filter, 16, dstSize);
+			bool             ones = true;
+			for(index pos_dst = 0; pos_dst < dstSize; ++pos_dst) {
+				int sum = 0;
+				for(index k = 0; k < axis.taps; ++k) {
+					sum += axis.weights[pos_dst * axis.taps + k];
+				}
+				ones = ones && sum == 1 << FILTER_BITS &&
+				       axis.first[pos_dst] + axis.taps <= 16;
+			}
+			CHECK(ones);
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef SEPARABLE_H
+#define SEPARABLE_H
+
+#include "Image.hpp"
+#include "ImageT.hpp"
+#include <cstdint>
+#include <vector>
+
+// Convolution kernels resampled as two 1D passes: a horizontal one into
+// 16-bit rows, then a vertical one over those rows
+enum class Filter {
+	bicubic, // Catmull-Rom, radius 2
+	lanczos3 // windowed sinc, radius 3
+};
+
+// The weights of one axis of a resize, computed once per resize: for every
+// destination index, `taps` consecutive source indices from first. Shrinking
+// stretches the kernel over the source so that every source pixel
+// contributes. Taps past the edges are folded onto the edge pixels.
+struct FilterAxis final {
+	unsigned int              taps = 0;
+	std::vector<unsigned int> first{};
+	// taps per index, FILTER_BITS fixed-point
+	std::vector<int16_t>      weights{};
+};
+
+FilterAxis
+filter_axis(Filter filter, unsigned int srcSize, unsigned int dstSize);
+
+// The weights of averaging the area under each of dstSize pixels spread over
+// `extent` source pixels, of which there are srcSize: the last may be cut
+// short, and covers what is left of the extent past srcSize - 1
+FilterAxis
+area_axis(double extent, unsigned int srcSize, unsigned int dstSize);
+
+// Resamples src into dst with the weights of each axis: columns from the
+// width of src to that of dst, rows from its height to dst's
+void filter_separable(const FilterAxis&       columns,
+                      const FilterAxis&       rows,
+                      const ImageView&        src,
+                      const MutableImageView& dst);
+
+Image bicubic(const Image& src, const Dimensions& targetDim);
+void  bicubic(const ImageView& src, const MutableImageView& dst);
+
+Image lanczos3(const Image& src, const Dimensions& targetDim);
+void  lanczos3(const ImageView& src, const MutableImageView& dst);
+
+#endif
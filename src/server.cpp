@@ -0,0 +1,501 @@
+#include "server.hpp"
+
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+#include "cache.hpp"
+#include "kernels.hpp"
+#include "resize.hpp"
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <doctest\doctest.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	double milliseconds(Clock::duration duration) {
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+	// Reads the flat JSON objects jobs are made of: string, number, true,
+	// false and null values, no nesting
+	class JobReader final {
+		private:
+		const std::string& m_text;
+		std::size_t        m_at;
+
+		[[noreturn]] void fail() const {
+			std::stringstream ss;
+			ss << "malformed job at column " << m_at + 1 << "\n";
+			throw std::runtime_error(ss.str());
+		}
+
+		void skip_space() {
+			while(m_at < m_text.size() &&
+			      std::isspace(static_cast<unsigned char>(m_text[m_at]))) {
+				++m_at;
+			}
+		}
+
+		bool accept(char c) {
+			skip_space();
+			if(m_at < m_text.size() && m_text[m_at] == c) {
+				++m_at;
+				return true;
+			}
+			return false;
+		}
+
+		void expect(char c) {
+			if(!accept(c)) { fail(); }
+		}
+
+		bool accept_word(const std::string& word) {
+			if(m_text.compare(m_at, word.size(), word) != 0) { return false; }
+			m_at += word.size();
+			return true;
+		}
+
+		// One digit or more
+		void skip_digits() {
+			const std::size_t start = m_at;
+			while(m_at < m_text.size() &&
+			      std::isdigit(static_cast<unsigned char>(m_text[m_at]))) {
+				++m_at;
+			}
+			if(m_at == start) { fail(); }
+		}
+
+		// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+		void skip_number() {
+			accept_word("-");
+			if(!accept_word("0")) {
+				if(m_at < m_text.size() && m_text[m_at] == '0') { fail(); }
+				skip_digits();
+			}
+			if(accept_word(".")) { skip_digits(); }
+			if(accept_word("e") || accept_word("E")) {
+				if(!accept_word("+")) { accept_word("-"); }
+				skip_digits();
+			}
+		}
+
+		unsigned int read_hex() {
+			unsigned int value = 0;
+			for(int i = 0; i < 4; ++i) {
+				if(m_at == m_text.size() ||
+				   !std::isxdigit(static_cast<unsigned char>(m_text[m_at]))) {
+					fail();
+				}
+				const char c = m_text[m_at++];
+				value        = value * 16 +
+				        (std::isdigit(c) ? c - '0' : std::tolower(c) - 'a' + 10);
+			}
+			return value;
+		}
+
+		// The code point of a \u escape, after the u, joining a surrogate pair
+		unsigned int read_code_point() {
+			const unsigned int unit = read_hex();
+			if(unit >= 0xdc00 && unit < 0xe000) { fail(); }
+			if(unit < 0xd800 || unit >= 0xdc00) { return unit; }
+			if(!accept_word("\\u")) { fail(); }
+			const unsigned int low = read_hex();
+			if(low < 0xdc00 || low >= 0xe000) { fail(); }
+			return 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+		}
+
+		static void append_utf8(std::string& text, unsigned int code_point) {
+			auto byte = [&](unsigned int bits) {
+				text += static_cast<char>(bits);
+			};
+			if(code_point < 0x80) {
+				byte(code_point);
+			} else if(code_point < 0x800) {
+				byte(0xc0 | code_point >> 6);
+				byte(0x80 | (code_point & 0x3f));
+			} else if(code_point < 0x10000) {
+				byte(0xe0 | code_point >> 12);
+				byte(0x80 | (code_point >> 6 & 0x3f));
+				byte(0x80 | (code_point & 0x3f));
+			} else {
+				byte(0xf0 | code_point >> 18);
+				byte(0x80 | (code_point >> 12 & 0x3f));
+				byte(0x80 | (code_point >> 6 & 0x3f));
+				byte(0x80 | (code_point & 0x3f));
+			}
+		}
+
+		public:
+		explicit JobReader(const std::string& text) : m_text(text), m_at(0) {}
+
+		template<typename Field>
+		void read_object(Field field) {
+			expect('{');
+			if(!accept('}')) {
+				do {
+					const std::string key = read_string();
+					expect(':');
+					field(key);
+				} while(accept(','));
+				expect('}');
+			}
+			skip_space();
+			if(m_at != m_text.size()) { fail(); }
+		}
+
+		std::string read_string() {
+			expect('"');
+			std::string value;
+			while(m_at < m_text.size() && m_text[m_at] != '"') {
+				char c = m_text[m_at++];
+				if(c == '\\') {
+					if(m_at == m_text.size()) { fail(); }
+					switch(m_text[m_at++]) {
+						case '"': c = '"'; break;
+						case '\\': c = '\\'; break;
+						case '/': c = '/'; break;
+						case 'b': c = '\b'; break;
+						case 'f': c = '\f'; break;
+						case 'n': c = '\n'; break;
+						case 'r': c = '\r'; break;
+						case 't': c = '\t'; break;
+						case 'u': append_utf8(value, read_code_point()); continue;
+						default: fail();
+					}
+				}
+				value += c;
+			}
+			expect('"');
+			return value;
+		}
+
+		// Any value, as its JSON text
+		std::string read_raw() {
+			skip_space();
+			const std::size_t start = m_at;
+			if(m_at < m_text.size() && m_text[m_at] == '"') {
+				read_string();
+			} else if(!accept_word("true") && !accept_word("false") &&
+			          !accept_word("null")) {
+				skip_number();
+			}
+			return m_text.substr(start, m_at - start);
+		}
+
+		float read_number() {
+			const std::string text = read_raw();
+			std::stringstream ss(text);
+			float             number = 0;
+			if(!(ss >> number) || !ss.eof()) { fail(); }
+			return number;
+		}
+	};
+
+	std::string quoted(const std::string& text) {
+		std::stringstream ss;
+		ss << '"';
+		for(char c : text) {
+			switch(c) {
+				case '"': ss << "\\\""; break;
+				case '\\': ss << "\\\\"; break;
+				case '\n': ss << "\\n"; break;
+				case '\r': ss << "\\r"; break;
+				case '\t': ss << "\\t"; break;
+				default:
+					if(static_cast<unsigned char>(c) < 0x20) {
+						ss << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+						   << static_cast<int>(c) << std::dec;
+					} else {
+						ss << c;
+					}
+			}
+		}
+		ss << '"';
+		return ss.str();
+	}
+
+	// Error messages end in a newline, which records leave out
+	std::string error_record(const std::string& id, std::string message) {
+		if(!message.empty() && message.back() == '\n') { message.pop_back(); }
+		std::stringstream ss;
+		ss << "{";
+		if(!id.empty()) { ss << "\"id\": " << id << ", "; }
+		ss << "\"ok\": false, \"error\": " << quoted(message) << "}";
+		return ss.str();
+	}
+
+	std::string answer(const std::string& line,
+	                   const JobDefaults& defaults,
+	                   const ResultCache* cache) {
+		Job job;
+		try {
+			job = parse_job(line, defaults);
+		} catch(const std::exception& e) {
+			return error_record("", e.what());
+		}
+		return run_job(job, cache);
+	}
+
+	// Loads what a job needs before the first one arrives: the worker threads
+	// and the kernels for this CPU
+	void warm_up() {
+		ThreadPool::global();
+		kernels();
+	}
+} // namespace
+
+Job parse_job(const std::string& line, const JobDefaults& defaults) {
+	Job       job{"", "", "", defaults.method, defaults.scale};
+	JobReader reader(line);
+	reader.read_object([&](const std::string& key) {
+		if(key == "input") {
+			job.input = reader.read_string();
+		} else if(key == "output") {
+			job.output = reader.read_string();
+		} else if(key == "method") {
+			job.method = reader.read_string();
+		} else if(key == "scale") {
+			job.scale = reader.read_number();
+			check_scale(job.scale);
+		} else if(key == "id") {
+			job.id = reader.read_raw();
+		} else {
+			reader.read_raw();
+		}
+	});
+	if(job.input.empty()) { throw std::runtime_error("job without input\n"); }
+	if(job.method.empty()) { throw std::runtime_error("job without method\n"); }
+	if(job.output.empty()) {
+		const fs::path    path(job.input);
+		std::stringstream ss;
+		ss << job.method << "-" << job.scale << "x_" << path.filename().string();
+		job.output = (path.parent_path() / ss.str()).string();
+	}
+	return job;
+}
+
+std::string run_job(const Job& job, const ResultCache* cache) {
+	try {
+		const Method            method = parse_method(job.method);
+		const Clock::time_point start  = Clock::now();
+		std::string             key;
+		if(cache) {
+			key = cache->key(job.input, method, job.scale, job.output);
+			if(cache->fetch(key, job.output)) {
+				std::stringstream ss;
+				ss << "{";
+				if(!job.id.empty()) { ss << "\"id\": " << job.id << ", "; }
+				ss << "\"ok\": true, \"output\": " << quoted(job.output)
+				   << ", \"cached\": true, \"total_ms\": "
+				   << milliseconds(Clock::now() - start) << "}";
+				return ss.str();
+			}
+			replace_output(job.output);
+		}
+		const Image             src(job.input);
+		const Clock::time_point loaded = Clock::now();
+		const Image             dst =
+		  resize(method, src, job.scale, job.output);
+		const Clock::time_point resized = Clock::now();
+		dst.save(job.output);
+		const Clock::time_point saved = Clock::now();
+		if(cache) { cache->store(key, job.output); }
+
+		std::stringstream ss;
+		ss << "{";
+		if(!job.id.empty()) { ss << "\"id\": " << job.id << ", "; }
+		ss << "\"ok\": true, \"output\": " << quoted(job.output)
+		   << ", \"width\": " << dst.dimensions().width
+		   << ", \"height\": " << dst.dimensions().height
+		   << ", \"load_ms\": " << milliseconds(loaded - start)
+		   << ", \"resize_ms\": " << milliseconds(resized - loaded)
+		   << ", \"save_ms\": " << milliseconds(saved - resized)
+		   << ", \"total_ms\": " << milliseconds(saved - start) << "}";
+		return ss.str();
+	} catch(const std::exception& e) {
+		return error_record(job.id, e.what());
+	}
+}
+
+void serve(std::istream&      in,
+           std::ostream&      out,
+           const JobDefaults& defaults,
+           const ResultCache* cache) {
+	warm_up();
+	std::string line;
+	while(std::getline(in, line)) {
+		if(!line.empty() && line.back() == '\r') { line.pop_back(); }
+		if(line.empty()) { continue; }
+		out << answer(line, defaults, cache) << std::endl;
+	}
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+namespace {
+	// A client that hangs up early fails the send instead of raising SIGPIPE
+#if defined(MSG_NOSIGNAL)
+	constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+	constexpr int SEND_FLAGS = 0;
+#endif
+
+	// Writes all of text, as send may take it in parts
+	bool send_all(int connection, const std::string& text) {
+		std::size_t sent = 0;
+		while(sent < text.size()) {
+			const ssize_t count = send(
+			  connection, text.data() + sent, text.size() - sent, SEND_FLAGS);
+			if(count <= 0) { return false; }
+			sent += count;
+		}
+		return true;
+	}
+
+	void serve_connection(int                connection,
+	                      const JobDefaults& defaults,
+	                      const ResultCache* cache) {
+		std::string pending;
+		char        buffer[4096];
+		ssize_t     count = 0;
+		while((count = recv(connection, buffer, sizeof(buffer), 0)) > 0) {
+			pending.append(buffer, count);
+			std::size_t end = 0;
+			while((end = pending.find('\n')) != std::string::npos) {
+				std::string line = pending.substr(0, end);
+				pending.erase(0, end + 1);
+				if(!line.empty() && line.back() == '\r') { line.pop_back(); }
+				if(line.empty()) { continue; }
+				if(!send_all(connection, answer(line, defaults, cache) + "\n")) {
+					close(connection);
+					return;
+				}
+			}
+		}
+		close(connection);
+	}
+} // namespace
+
+void serve_socket(const std::string& path,
+                  const JobDefaults& defaults,
+                  const ResultCache* cache) {
+	sockaddr_un address{};
+	if(path.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error("socket path too long: " + path + "\n");
+	}
+	address.sun_family = AF_UNIX;
+	path.copy(address.sun_path, path.size());
+
+	// A socket left by an earlier server is replaced; anything else there is
+	// not ours to remove
+	struct stat status;
+	if(lstat(path.c_str(), &status) == 0) {
+		if(!S_ISSOCK(status.st_mode)) {
+			throw std::runtime_error("cannot listen on socket " + path +
+			                         ": a file that is not a socket is there\n");
+		}
+		unlink(path.c_str());
+	}
+
+	const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener < 0 ||
+	   bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+	     0 ||
+	   listen(listener, SOMAXCONN) < 0) {
+		if(listener >= 0) { close(listener); }
+		throw std::runtime_error("cannot listen on socket " + path + "\n");
+	}
+
+	warm_up();
+	for(;;) {
+		const int connection = accept(listener, nullptr, nullptr);
+		if(connection < 0) { continue; }
+		std::thread(serve_connection, connection, defaults, cache).detach();
+	}
+}
+#else
+void serve_socket(const std::string& path,
+                  const JobDefaults&,
+                  const ResultCache*) {
+	throw std::runtime_error("cannot listen on socket " + path +
+	                         ": unsupported on this platform\n");
+}
+#endif
+
+TEST_CASE("Server jobs and records") {
+	const JobDefaults defaults{"bilinear", 2.0f};
+
+	const Job job = parse_job(
+	  R"({"id": 7, "input": "in\/a.png", "method": "AIS", "extra": true})",
+	  defaults);
+	CHECK(job.id == "7");
+	CHECK(job.input == "in/a.png");
+	CHECK(job.method == "AIS");
+	CHECK(job.scale == 2.0f);
+	CHECK(job.output == (fs::path("in") / "AIS-2x_a.png").string());
+
+	const Job named = parse_job(
+	  R"({"input":"a.png","output":"b \"1\".png","scale":0.5,"id":"x"})",
+	  defaults);
+	CHECK(named.output == "b \"1\".png");
+	CHECK(named.scale == 0.5f);
+	CHECK(named.id == "\"x\"");
+
+	CHECK_THROWS(parse_job(R"({"output": "b.png"})", defaults));
+	CHECK_THROWS(parse_job(R"({"input": "a.png")", defaults));
+	CHECK_THROWS(parse_job(R"({"input": "a.png", "scale": "big"})", defaults));
+	CHECK_THROWS(parse_job(R"({"input": "a.png", "scale": -1})", defaults));
+	CHECK_THROWS(parse_job(R"({"input": "a.png", "scale": 0})", defaults));
+	CHECK_THROWS(parse_job(R"({"input": "a.png", "scale": 1e39})", defaults));
+
+	// \u escapes, a surrogate pair among them, decode to UTF-8
+	const Job escaped = parse_job(
+	  R"({"input": "caf\u00e9 \ud83d\ude00\u0041.png", "id": null})", defaults);
+	CHECK(escaped.input == "caf\xc3\xa9 \xf0\x9f\x98\x80" "A.png");
+	CHECK(escaped.id == "null");
+	CHECK_THROWS(parse_job(R"({"input": "\ud83d.png"})", defaults));
+	CHECK_THROWS(parse_job(R"({"input": "\u00g9.png"})", defaults));
+
+	// Ids are JSON values, echoed as they came, and nothing else
+	CHECK(parse_job(R"({"input": "a", "id": -1.5e3})", defaults).id == "-1.5e3");
+	CHECK_THROWS(parse_job(R"({"input": "a", "id": abc})", defaults));
+	CHECK_THROWS(parse_job(R"({"input": "a", "id": 07})", defaults));
+	CHECK_THROWS(parse_job(R"({"input": "a", "id": 1.})", defaults));
+
+	// Failures are answered rather than ending the stream
+	std::stringstream in("not json\n\n{\"id\": 3, \"input\": \"missing.png\"}\n");
+	std::stringstream out;
+	serve(in, out, defaults);
+	std::string first, second, rest;
+	std::getline(out, first);
+	std::getline(out, second);
+	CHECK(first.find("\"ok\": false") != std::string::npos);
+	CHECK(second.find("{\"id\": 3, \"ok\": false") == 0);
+	CHECK(!std::getline(out, rest));
+
+#if defined(__unix__) || defined(__APPLE__)
+	// A socket path that names some other file is left alone
+	const std::string taken =
+	  (fs::temp_directory_path() / "resize-server-test.txt").string();
+	std::ofstream(taken) << "not a socket";
+	CHECK_THROWS(serve_socket(taken, defaults, nullptr));
+	CHECK(fs::file_size(taken) == 12);
+	fs::remove(taken);
+#endif
+}
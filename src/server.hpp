@@ -0,0 +1,49 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <iosfwd>
+#include <string>
+
+class ResultCache;
+
+// Settings for the fields a job leaves out, from the command line
+struct JobDefaults final {
+	std::string method; // none when empty: jobs must name one
+	float       scale;
+};
+
+// One resize request. Only input is required; without output the result is
+// written next to it as method-scalex_name.
+struct Job final {
+	std::string id{}; // echoed in the record, as the JSON text it was given as
+	std::string input{};
+	std::string output{};
+	std::string method{};
+	float       scale = 0;
+};
+
+// Parses one line of newline-delimited JSON, a flat object with the fields
+// of Job
+Job parse_job(const std::string& line, const JobDefaults& defaults);
+
+// Runs a job and returns its completion record, one line of JSON holding the
+// milliseconds spent loading, resizing and saving, or the error that stopped
+// it. With a cache, a job already done is answered from it.
+std::string run_job(const Job& job, const ResultCache* cache = nullptr);
+
+// Runs every job read from in, answering each on out in turn, until in ends.
+// A line that is not a job gets an error record. The process stays up, so
+// the thread pool, the buffer pool and the image plugins stay warm across
+// jobs.
+void serve(std::istream&      in,
+           std::ostream&      out,
+           const JobDefaults& defaults,
+           const ResultCache* cache = nullptr);
+
+// Serves every connection to a Unix domain socket at path as serve does,
+// each on a thread of its own, until the process is stopped
+void serve_socket(const std::string& path,
+                  const JobDefaults& defaults,
+                  const ResultCache* cache = nullptr);
+
+#endif
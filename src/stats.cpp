@@ -0,0 +1,283 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <doctest\doctest.h>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr std::size_t STAGES   = static_cast<std::size_t>(Stage::count);
+	constexpr std::size_t COUNTERS = static_cast<std::size_t>(Counter::count);
+
+	struct Event final {
+		Stage             stage;
+		unsigned int      thread;
+		Clock::time_point start;
+		Clock::time_point end;
+	};
+
+	std::atomic<bool>          g_enabled(false);
+	std::atomic<bool>          g_tracing(false);
+	Clock::time_point          g_epoch;
+	std::atomic<std::uint64_t> g_calls[STAGES];
+	std::atomic<std::uint64_t> g_nanoseconds[STAGES];
+	std::atomic<std::uint64_t> g_bytes[STAGES];
+	std::atomic<std::uint64_t> g_counters[COUNTERS];
+
+	std::mutex            g_eventMutex;
+	std::vector<Event>    g_events;
+	std::atomic<unsigned> g_nextThread(0);
+	thread_local Stage    t_stage  = Stage::none;
+	thread_local unsigned t_thread = g_nextThread++;
+
+	const char* stage_name(Stage stage) {
+		switch(stage) {
+			case Stage::load: return "load";
+			case Stage::save: return "save";
+			case Stage::bilinear: return "bilinear";
+			case Stage::bicubic: return "bicubic";
+			case Stage::lanczos3: return "lanczos3";
+			case Stage::area: return "area";
+			case Stage::IMDDT: return "IMDDT";
+			case Stage::ais_copy: return "ais_copy";
+			case Stage::ais_stage1: return "ais_stage1";
+			case Stage::ais_stage2: return "ais_stage2";
+			case Stage::none:
+			case Stage::count:
+			default: return "none";
+		}
+	}
+
+	const char* counter_name(Counter counter) {
+		switch(counter) {
+			case Counter::ais_strong_a: return "ais_strong_a";
+			case Counter::ais_strong_b: return "ais_strong_b";
+			case Counter::ais_weak: return "ais_weak";
+			case Counter::pool_allocations: return "pool_allocations";
+			case Counter::pool_reuses: return "pool_reuses";
+			case Counter::pool_allocated_bytes: return "pool_allocated_bytes";
+			case Counter::mapped_files: return "mapped_files";
+			case Counter::count:
+			default: return "none";
+		}
+	}
+
+	void trace(Stage stage, Clock::time_point start, Clock::time_point end) {
+		if(!g_tracing.load(std::memory_order_relaxed)) { return; }
+		std::lock_guard<std::mutex> lock(g_eventMutex);
+		g_events.push_back({stage, t_thread, start, end});
+	}
+
+	double microseconds(Clock::duration duration) {
+		return std::chrono::duration<double, std::micro>(duration).count();
+	}
+} // namespace
+
+void enable_stats(bool trace) {
+	g_epoch = Clock::now();
+	g_tracing.store(trace);
+	g_enabled.store(true);
+}
+
+bool stats_enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+void disable_stats() {
+	g_enabled.store(false);
+	g_tracing.store(false);
+	for(std::size_t stage = 0; stage < STAGES; ++stage) {
+		g_calls[stage]       = 0;
+		g_nanoseconds[stage] = 0;
+		g_bytes[stage]       = 0;
+	}
+	for(auto& counter : g_counters) { counter = 0; }
+	std::lock_guard<std::mutex> lock(g_eventMutex);
+	g_events.clear();
+}
+
+void count(Counter counter, std::uint64_t amount) {
+	if(!stats_enabled()) { return; }
+	g_counters[static_cast<std::size_t>(counter)].fetch_add(
+	  amount, std::memory_order_relaxed);
+}
+
+std::uint64_t counted(Counter counter) {
+	return g_counters[static_cast<std::size_t>(counter)];
+}
+
+StageTimer::StageTimer(Stage stage, std::uint64_t bytes)
+  : m_stage(stats_enabled() ? stage : Stage::none)
+  , m_outer(t_stage)
+  , m_bytes(bytes)
+  , m_start() {
+	if(m_stage == Stage::none) { return; }
+	t_stage = m_stage;
+	m_start = Clock::now();
+}
+
+StageTimer::~StageTimer() {
+	if(m_stage == Stage::none) { return; }
+	const Clock::time_point end   = Clock::now();
+	const std::size_t       stage = static_cast<std::size_t>(m_stage);
+	g_calls[stage].fetch_add(1, std::memory_order_relaxed);
+	g_nanoseconds[stage].fetch_add(
+	  std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count(),
+	  std::memory_order_relaxed);
+	g_bytes[stage].fetch_add(m_bytes, std::memory_order_relaxed);
+	trace(m_stage, m_start, end);
+	t_stage = m_outer;
+}
+
+ChunkTrace::ChunkTrace(Stage stage)
+  : m_stage(g_tracing.load(std::memory_order_relaxed) ? stage : Stage::none)
+  , m_start() {
+	if(m_stage != Stage::none) { m_start = Clock::now(); }
+}
+
+ChunkTrace::~ChunkTrace() {
+	if(m_stage != Stage::none) { trace(m_stage, m_start, Clock::now()); }
+}
+
+Stage current_stage() { return t_stage; }
+
+void write_stats_json(std::ostream& out) {
+	out << "{\n  \"stages\": {";
+	const char* separator = "\n";
+	for(std::size_t stage = 1; stage < STAGES; ++stage) {
+		const std::uint64_t calls = g_calls[stage];
+		if(calls == 0) { continue; }
+		const double milliseconds = g_nanoseconds[stage] / 1e6;
+		const double megabytes    = g_bytes[stage] / 1e6;
+		// Calls too quick for the clock get a rate of 0 rather than inf or nan
+		const double rate =
+		  milliseconds > 0 ? megabytes / (milliseconds / 1000) : 0;
+		out << separator << "    \"" << stage_name(static_cast<Stage>(stage))
+		    << "\": {\"calls\": " << calls << ", \"ms\": " << milliseconds
+		    << ", \"bytes\": " << g_bytes[stage] << ", \"mb_per_s\": " << rate
+		    << "}";
+		separator = ",\n";
+	}
+	out << "\n  },\n  \"counters\": {";
+	separator = "\n";
+	for(std::size_t counter = 0; counter < COUNTERS; ++counter) {
+		out << separator << "    \""
+		    << counter_name(static_cast<Counter>(counter))
+		    << "\": " << g_counters[counter];
+		separator = ",\n";
+	}
+	out << "\n  }\n}\n";
+}
+
+void write_trace(const std::string& filename) {
+	std::ofstream out(filename);
+	if(!out) { throw std::runtime_error("cannot write file " + filename + "\n"); }
+
+	std::lock_guard<std::mutex> lock(g_eventMutex);
+	out << "{\"traceEvents\": [";
+	const char* separator = "\n";
+	for(const Event& event : g_events) {
+		out << separator << "{\"name\": \"" << stage_name(event.stage)
+		    << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+		    << ", \"ts\": " << microseconds(event.start - g_epoch)
+		    << ", \"dur\": " << microseconds(event.end - event.start) << "}";
+		separator = ",\n";
+	}
+	out << "\n]}\n";
+}
+
+TEST_CASE("Stats write well-formed JSON and clear when disabled") {
+	// Whether text is one JSON value of the kinds written here and nothing
+	// more: objects, arrays, strings without escapes and finite numbers
+	auto well_formed = [](const std::string& text) {
+		std::size_t at   = 0;
+		auto        skip = [&] {
+			while(at < text.size() && std::isspace(text[at])) { ++at; }
+		};
+		std::function<bool()> value = [&] {
+			skip();
+			if(at >= text.size()) { return false; }
+			const char opening = text[at];
+			if(opening == '{' || opening == '[') {
+				const char closing = opening == '{' ? '}' : ']';
+				++at;
+				skip();
+				if(at < text.size() && text[at] == closing) { return ++at, true; }
+				do {
+					if(opening == '{') {
+						skip();
+						if(at >= text.size() || text[at] != '"' || !value()) {
+							return false;
+						}
+						skip();
+						if(at >= text.size() || text[at++] != ':') { return false; }
+					}
+					if(!value()) { return false; }
+					skip();
+				} while(at < text.size() && text[at] == ',' && ++at);
+				return at < text.size() && text[at++] == closing;
+			}
+			if(opening == '"') {
+				const std::size_t end = text.find('"', at + 1);
+				at                    = end + 1;
+				return end != std::string::npos;
+			}
+			const std::size_t digit = at + (opening == '-');
+			if(digit >= text.size() || !std::isdigit(text[digit])) { return false; }
+			char* end = nullptr;
+			std::strtod(text.c_str() + at, &end);
+			at = end - text.c_str();
+			return true;
+		};
+		return value() && (skip(), at == text.size());
+	};
+	CHECK(well_formed("{\"a\": [1, -2.5e3, {}], \"b\": \"c\"}\n"));
+	CHECK(!well_formed("{\"mb_per_s\": inf}"));
+	CHECK(!well_formed("{\"a\": 1,}"));
+
+	auto counter = [](const std::string& json, const std::string& name) {
+		const std::size_t at = json.find("\"" + name + "\": ");
+		REQUIRE(at != std::string::npos);
+		return std::stoull(json.substr(at + name.size() + 4));
+	};
+
+	// From nothing collected, whatever ran before
+	disable_stats();
+	enable_stats(true);
+	{
+		StageTimer timer(Stage::ais_stage2, 300);
+		count(Counter::ais_weak, 7);
+	}
+	std::stringstream json;
+	write_stats_json(json);
+	CHECK(well_formed(json.str()));
+	CHECK(counter(json.str(), "ais_weak") == 7);
+	CHECK(counter(json.str(), "bytes") == 300);
+
+	const std::string trace =
+	  (std::filesystem::temp_directory_path() / "resize-stats-test.json")
+	    .string();
+	write_trace(trace);
+	std::stringstream written;
+	written << std::ifstream(trace).rdbuf();
+	CHECK(well_formed(written.str()));
+	CHECK(written.str().find("\"ais_stage2\"") != std::string::npos);
+	std::remove(trace.c_str());
+
+	// Nothing is left on for the rest of the run, nor counted since
+	disable_stats();
+	count(Counter::ais_weak, 7);
+	CHECK(!stats_enabled());
+	CHECK(counted(Counter::ais_weak) == 0);
+}
@@ -0,0 +1,91 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Wall time, calls and bytes per stage of a run, plus event counters, for
+// --stats, and optionally a Chrome trace (chrome://tracing, Perfetto) of the
+// stages and their parallel_for chunks on every thread. Collection is off
+// unless enable_stats was called; until then every hook only tests a flag.
+
+enum class Stage {
+	none,
+	load,
+	save,
+	bilinear,
+	bicubic,
+	lanczos3,
+	area,
+	IMDDT,
+	ais_copy,
+	ais_stage1,
+	ais_stage2, // both passes, which share one sweep
+	count
+};
+
+enum class Counter {
+	ais_strong_a,         // cubic along the first line
+	ais_strong_b,         // cubic along the second line
+	ais_weak,             // smoothness-weighted average
+	pool_allocations,     // image buffers allocated from the system
+	pool_reuses,          // image buffers recycled by the pool
+	pool_allocated_bytes, // bytes of the former
+	mapped_files,         // images read or written through a mapping
+	count
+};
+
+void enable_stats(bool trace);
+bool stats_enabled();
+
+// Stops collection and clears everything collected so far
+void disable_stats();
+
+void count(Counter counter, std::uint64_t amount);
+
+// The total counted so far
+std::uint64_t counted(Counter counter);
+
+// Times its own lifetime as one call of a stage. parallel_for chunks started
+// meanwhile on this thread appear under the same stage in the trace.
+class StageTimer final {
+	private:
+	Stage                                 m_stage;
+	Stage                                 m_outer;
+	std::uint64_t                         m_bytes;
+	std::chrono::steady_clock::time_point m_start;
+
+	public:
+	explicit StageTimer(Stage stage, std::uint64_t bytes = 0);
+	~StageTimer();
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+	inline void add_bytes(std::uint64_t bytes) { m_bytes += bytes; }
+};
+
+// A trace event for one parallel_for chunk of the stage timed on the thread
+// that started the loop
+class ChunkTrace final {
+	private:
+	Stage                                 m_stage;
+	std::chrono::steady_clock::time_point m_start;
+
+	public:
+	explicit ChunkTrace(Stage stage);
+	~ChunkTrace();
+
+	ChunkTrace(const ChunkTrace&) = delete;
+	ChunkTrace& operator=(const ChunkTrace&) = delete;
+};
+
+// The stage a StageTimer on this thread is timing, or Stage::none
+Stage current_stage();
+
+void write_stats_json(std::ostream& out);
+void write_trace(const std::string& filename);
+
+#endif
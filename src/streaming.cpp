@@ -0,0 +1,159 @@
+#include "streaming.hpp"
+#include "BufferPool.hpp"
+
+#include "Image.hpp"
+#include "ImageT.hpp"
+#include "stats.hpp"
+#include <OpenImageIO/imageio.h>
+#include <algorithm>
+#include <cstdint>
+#include <gsl\gsl-lite.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace gsl;
+
+namespace {
+	const OIIO::TypeDesc PIXEL_TYPE = {
+	  OIIO::TypeDesc::UINT8, OIIO::TypeDesc::SCALAR, OIIO::TypeDesc::COLOR};
+
+	std::runtime_error file_error(const char* what, const std::string& filename) {
+		std::stringstream ss;
+		ss << what << " " << filename << "\n";
+		return std::runtime_error(ss.str());
+	}
+
+	// The decoded source rows [first, end), advanced down the image one band at
+	// a time. Rows still needed move to the front of the buffer; the rest are
+	// read from the file.
+	class SourceRows final {
+		private:
+		OIIO::ImageInput&    m_input;
+		Dimensions           m_dimensions;
+		unsigned int         m_channels;
+		std::vector<uint8_t> m_data;
+		RowRange             m_rows;
+
+		inline std::size_t row_size() const {
+			return std::size_t{m_dimensions.width} * m_channels;
+		}
+
+		public:
+		explicit SourceRows(OIIO::ImageInput& input)
+		  : m_input(input)
+		  , m_dimensions(input.spec().width, input.spec().height)
+		  , m_channels(input.spec().nchannels)
+		  , m_data()
+		  , m_rows{0, 0} {}
+
+		inline const Dimensions& dimensions() const { return m_dimensions; }
+		inline unsigned int      channels() const { return m_channels; }
+
+		ImageView advance(const RowRange& rows) {
+			Expects(rows.first >= m_rows.first && rows.end >= m_rows.end);
+
+			const unsigned int kept_first = std::min(rows.first, m_rows.end);
+			std::copy(m_data.begin() + (kept_first - m_rows.first) * row_size(),
+			          m_data.begin() + (m_rows.end - m_rows.first) * row_size(),
+			          m_data.begin());
+			m_data.resize((rows.end - rows.first) * row_size());
+
+			const unsigned int read_first = std::max(rows.first, m_rows.end);
+			if(read_first < rows.end) {
+				StageTimer timer(Stage::load, (rows.end - read_first) * row_size());
+				if(!m_input.read_scanlines(
+				     0,
+				     0,
+				     read_first,
+				     rows.end,
+				     0,
+				     0,
+				     m_channels,
+				     PIXEL_TYPE,
+				     m_data.data() + (read_first - rows.first) * row_size())) {
+					throw std::runtime_error(m_input.geterror() + "\n");
+				}
+			}
+
+			m_rows = rows;
+			return ImageView(m_data.data(),
+			                 m_dimensions,
+			                 m_channels,
+			                 row_size(),
+			                 rows.first,
+			                 rows.end);
+		}
+	};
+} // namespace
+
+void resize_streaming(Method             method,
+                      const std::string& inFile,
+                      const std::string& outFile,
+                      float              scale) {
+	auto input = OIIO::ImageInput::open(inFile);
+	if(!input) { throw file_error("cannot open file", inFile); }
+	SourceRows source(*input);
+
+	const unsigned int channels = source.channels();
+	const Dimensions   target =
+	  target_dimensions(method, source.dimensions(), scale);
+
+	auto            output = OIIO::ImageOutput::create(outFile);
+	OIIO::ImageSpec spec(target.width, target.height, channels, PIXEL_TYPE);
+	if(!output || !output->open(outFile, spec)) {
+		throw file_error("cannot write file", outFile);
+	}
+
+	const std::size_t row_size = std::size_t{target.width} * channels;
+	PooledBuffer band = BufferPool::global().acquire(STREAM_BAND_ROWS * row_size);
+	for(unsigned int first = 0; first < target.height;
+	    first += STREAM_BAND_ROWS) {
+		const unsigned int end = std::min(target.height, first + STREAM_BAND_ROWS);
+		const RowRange     rows =
+		  source_rows(method, source.dimensions(), target, first, end);
+
+		const MutableImageView dst(
+		  band.data(), target, channels, row_size, first, end);
+		resize(method, source.advance(rows), dst);
+		StageTimer timer(Stage::save, (end - first) * row_size);
+		if(!output->write_scanlines(first, end, 0, PIXEL_TYPE, band.data())) {
+			throw std::runtime_error(output->geterror() + "\n");
+		}
+	}
+
+	output->close();
+	input->close();
+}
+
+void resize_region(Method             method,
+                   const std::string& inFile,
+                   const std::string& outFile,
+                   float              scale,
+                   const Region&      region) {
+	auto input = OIIO::ImageInput::open(inFile);
+	if(!input) { throw file_error("cannot open file", inFile); }
+	SourceRows source(*input);
+
+	const Dimensions target =
+	  target_dimensions(method, source.dimensions(), scale);
+	if(region.x + region.width > target.width ||
+	   region.y + region.height > target.height) {
+		std::stringstream ss;
+		ss << "region outside the " << target.width << "x" << target.height
+		   << " output\n";
+		throw std::runtime_error(ss.str());
+	}
+
+	const Region needed =
+	  source_region(method, source.dimensions(), target, region);
+	const ImageView src =
+	  source.advance({needed.y, needed.y + needed.height})
+	    .window(needed.y,
+	            needed.y + needed.height,
+	            needed.x,
+	            needed.x + needed.width);
+	const Image dst = resize_region(method, src, target, region);
+	input->close();
+	dst.save(outFile);
+}
@@ -0,0 +1,26 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include "resize.hpp"
+#include <string>
+
+// Output rows rendered and written per band
+constexpr unsigned int STREAM_BAND_ROWS = 64;
+
+// Resizes inFile into outFile a band of scanlines at a time. Only the source
+// rows the current band needs are kept decoded, so memory grows with the width
+// of the images rather than their area.
+void resize_streaming(Method             method,
+                      const std::string& inFile,
+                      const std::string& outFile,
+                      float              scale);
+
+// Resizes only `region` of the output of inFile at scale into outFile, an
+// image of the region's size, reading only the source rows it needs
+void resize_region(Method             method,
+                   const std::string& inFile,
+                   const std::string& outFile,
+                   float              scale,
+                   const Region&      region);
+
+#endif
@@ -0,0 +1,318 @@
+#include "video.hpp"
+
+#include "BoundedQueue.hpp"
+#include "Image.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <doctest\doctest.h>
+
+namespace {
+	const std::string Y4M_MAGIC = "YUV4MPEG2";
+	const std::string Y4M_FRAME = "FRAME";
+
+	// A frame on its way through the pipeline, numbered in stream order
+	struct Frame final {
+		std::size_t        number = 0;
+		std::string        header{}; // the y4m FRAME line, with any parameters
+		std::vector<Image> planes{};
+	};
+
+	std::vector<PlaneFormat> y4m_planes(const std::string& colourspace) {
+		if(colourspace == "420" || colourspace == "420jpeg" ||
+		   colourspace == "420paldv" || colourspace == "420mpeg2") {
+			return {{1, 1, 1}, {1, 2, 2}, {1, 2, 2}};
+		}
+		if(colourspace == "422") { return {{1, 1, 1}, {1, 2, 1}, {1, 2, 1}}; }
+		if(colourspace == "444") { return {{1, 1, 1}, {1, 1, 1}, {1, 1, 1}}; }
+		if(colourspace == "mono") { return {{1, 1, 1}}; }
+		throw std::runtime_error("y4m colour space unsupported: C" + colourspace +
+		                         "\n");
+	}
+
+	std::size_t frame_bytes(const StreamFormat& format) {
+		std::size_t bytes = 0;
+		for(const PlaneFormat& plane : format.planes) {
+			const Dimensions size = plane_size(format.size, plane);
+			bytes += std::size_t{size.width} * size.height * plane.channels;
+		}
+		return bytes;
+	}
+
+	// Reads the next frame into frame; false at the end of the stream
+	bool read_frame(std::istream& in, const StreamFormat& format, Frame& frame) {
+		StageTimer timer(Stage::load, frame_bytes(format));
+		if(format.y4m) {
+			if(!std::getline(in, frame.header)) { return false; }
+			if(frame.header.compare(0, Y4M_FRAME.size(), Y4M_FRAME) != 0) {
+				throw std::runtime_error("y4m frame header expected\n");
+			}
+		} else if(in.peek() == std::istream::traits_type::eof()) {
+			return false;
+		}
+
+		frame.planes.clear();
+		for(const PlaneFormat& plane : format.planes) {
+			Image image(
+			  plane_size(format.size, plane), plane.channels, Image::Init::none);
+			const auto bytes = static_cast<std::streamsize>(image.size());
+			in.read(reinterpret_cast<char*>(image.data()), bytes);
+			if(in.gcount() != bytes) {
+				std::stringstream ss;
+				ss << "video stream ends inside frame " << frame.number << "\n";
+				throw std::runtime_error(ss.str());
+			}
+			frame.planes.push_back(std::move(image));
+		}
+		return true;
+	}
+
+	void write_frame(std::ostream& out, const Frame& frame) {
+		StageTimer timer(Stage::save);
+		if(!frame.header.empty()) { out << frame.header << '\n'; }
+		for(const Image& plane : frame.planes) {
+			out.write(reinterpret_cast<const char*>(plane.data()),
+			          static_cast<std::streamsize>(plane.size()));
+			timer.add_bytes(plane.size());
+		}
+		if(!out) { throw std::runtime_error("cannot write video output\n"); }
+	}
+
+	void resize_frame(Method method, const StreamFormat& target, Frame& frame) {
+		for(std::size_t i = 0; i < frame.planes.size(); ++i) {
+			frame.planes[i] = resize(
+			  method, frame.planes[i], plane_size(target.size, target.planes[i]));
+		}
+	}
+} // namespace
+
+Dimensions parse_frame_size(const std::string& text) {
+	std::stringstream ss(text);
+	Dimensions        size(0, 0);
+	char              times = 0;
+	ss >> size.width >> times >> size.height;
+	if(!ss || !ss.eof() || times != 'x' || size.width == 0 || size.height == 0 ||
+	   text.find('-') != std::string::npos) {
+		throw std::runtime_error("frame size unrecognized: " + text + "\n");
+	}
+	return size;
+}
+
+StreamFormat read_y4m_header(std::istream& in) {
+	std::string line;
+	std::getline(in, line);
+	std::stringstream ss(line);
+	std::string       token;
+	ss >> token;
+	if(token != Y4M_MAGIC) {
+		throw std::runtime_error("video input is not a YUV4MPEG2 stream\n");
+	}
+
+	StreamFormat format{true, {0, 0}, {}, ""};
+	std::string  colourspace = "420jpeg";
+	while(ss >> token) {
+		switch(token.front()) {
+			case 'W': format.size.width = std::stoul(token.substr(1)); break;
+			case 'H': format.size.height = std::stoul(token.substr(1)); break;
+			case 'C':
+				colourspace = token.substr(1);
+				format.tags += " " + token;
+				break;
+			default: format.tags += " " + token; break;
+		}
+	}
+	if(format.size.width == 0 || format.size.height == 0) {
+		throw std::runtime_error("y4m header without a frame size\n");
+	}
+	format.planes = y4m_planes(colourspace);
+	return format;
+}
+
+StreamFormat raw_rgb_format(const Dimensions& size) {
+	return {false, size, {{3, 1, 1}}, ""};
+}
+
+Dimensions plane_size(const Dimensions& frame, const PlaneFormat& plane) {
+	return {(frame.width + plane.xSubsampling - 1) / plane.xSubsampling,
+	        (frame.height + plane.ySubsampling - 1) / plane.ySubsampling};
+}
+
+std::size_t
+run_video(std::istream& in, std::ostream& out, const VideoOptions& options) {
+	const StreamFormat source = options.rawSize.width > 0 ?
+	                              raw_rgb_format(options.rawSize) :
+	                              read_y4m_header(in);
+	StreamFormat       target = source;
+	target.size = target_dimensions(options.method, source.size, options.scale);
+	if(target.y4m) {
+		out << Y4M_MAGIC << " W" << target.size.width << " H"
+		    << target.size.height << target.tags << '\n';
+	}
+
+	// Frames are resized out of order and written in order: a frame resized
+	// ahead of its turn waits in `ahead` until the ones before it are written.
+	// A resizer holds back a frame framesInFlight or more ahead of the next
+	// to write, so a slow frame cannot leave the others piling up there.
+	const unsigned int  resizers = std::max(1u, options.framesInFlight);
+	BoundedQueue<Frame> read(resizers);
+	BoundedQueue<Frame> resized(resizers);
+
+	// The first error stops reading. The stages after it keep draining their
+	// queues, so that none blocks on a full one, and it is rethrown at the end.
+	std::exception_ptr      failure;
+	std::atomic<bool>       failed(false);
+	std::size_t             written = 0;
+	std::mutex              progressMutex; // guards failure and written
+	std::condition_variable progress;
+
+	auto attempt = [&](auto&& stage) {
+		try {
+			stage();
+			return true;
+		} catch(...) {
+			{
+				std::lock_guard<std::mutex> lock(progressMutex);
+				if(!failure) { failure = std::current_exception(); }
+				failed = true;
+			}
+			progress.notify_all();
+		}
+		return false;
+	};
+
+	std::thread reader([&] {
+		for(std::size_t number = 0; !failed; ++number) {
+			Frame frame;
+			frame.number = number;
+			bool more    = false;
+			attempt([&] { more = read_frame(in, source, frame); });
+			if(!more) { break; }
+			read.push(std::move(frame));
+		}
+	});
+
+	std::vector<std::thread> resizing;
+	for(unsigned int i = 0; i < resizers; ++i) {
+		resizing.emplace_back([&] {
+			Frame frame;
+			while(read.pop(frame)) {
+				{
+					std::unique_lock<std::mutex> lock(progressMutex);
+					progress.wait(lock, [&] {
+						return failed || frame.number - written < resizers;
+					});
+				}
+				if(failed) { continue; }
+				auto scale = [&] { resize_frame(options.method, target, frame); };
+				if(attempt(scale)) { resized.push(std::move(frame)); }
+			}
+		});
+	}
+
+	std::thread writer([&] {
+		std::map<std::size_t, Frame> ahead;
+		Frame                        frame;
+		while(resized.pop(frame)) {
+			if(failed) { continue; }
+			ahead.emplace(frame.number, std::move(frame));
+			auto next = ahead.find(written);
+			while(next != ahead.end() && !failed) {
+				if(attempt([&] { write_frame(out, next->second); })) {
+					{
+						std::lock_guard<std::mutex> lock(progressMutex);
+						++written;
+					}
+					progress.notify_all();
+				}
+				ahead.erase(next);
+				next = ahead.find(written);
+			}
+		}
+		out.flush();
+	});
+
+	// Each stage ends once the one before it has, and its queue is drained
+	reader.join();
+	read.close();
+	for(auto& thread : resizing) { thread.join(); }
+	resized.close();
+	writer.join();
+
+	if(failure) { std::rethrow_exception(failure); }
+	return written;
+}
+
+TEST_CASE("Video streams resize every frame in order") {
+	CHECK(parse_frame_size("1920x1080").height == 1080);
+	CHECK_THROWS(parse_frame_size("1920"));
+	CHECK_THROWS(parse_frame_size("0x1080"));
+
+	std::mt19937                       rng(17);
+	std::uniform_int_distribution<int> value(0, 255);
+	auto noise = [&](const Dimensions& size, unsigned int channels) {
+		Image image(size, channels);
+		std::generate_n(image.data(), image.size(), [&] { return value(rng); });
+		return image;
+	};
+	auto bytes = [](const Image& image) {
+		return std::string(reinterpret_cast<const char*>(image.data()),
+		                   image.size());
+	};
+
+	SUBCASE("y4m") {
+		// 4:2:0 planes of an odd size round up, before and after resizing
+		std::stringstream in, expected, out;
+		in << "YUV4MPEG2 W5 H3 F25:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n";
+		expected << "YUV4MPEG2 W10 H6 F25:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n";
+		for(int frame = 0; frame < 7; ++frame) {
+			const std::string header = frame == 3 ? "FRAME Ixyz" : "FRAME";
+			in << header << '\n';
+			expected << header << '\n';
+			for(const Dimensions& size : {Dimensions(5, 3),
+			                              Dimensions(3, 2),
+			                              Dimensions(3, 2)}) {
+				const Image plane = noise(size, 1);
+				const Dimensions target(size.width == 5 ? 10 : 5,
+				                        size.width == 5 ? 6 : 3);
+				in << bytes(plane);
+				expected << bytes(resize(Method::bilinear, plane, target));
+			}
+		}
+		CHECK(run_video(in, out, {Method::bilinear, 2.0f, {0, 0}, 3}) == 7);
+		CHECK(out.str() == expected.str());
+
+		std::stringstream deep("YUV4MPEG2 W5 H3 C420p10\n");
+		CHECK_THROWS(read_y4m_header(deep));
+		std::stringstream sizeless("YUV4MPEG2 W5 C444\n");
+		CHECK_THROWS(read_y4m_header(sizeless));
+	}
+
+	SUBCASE("Raw RGB") {
+		std::stringstream in, expected, out;
+		for(int frame = 0; frame < 5; ++frame) {
+			const Image rgb = noise({4, 3}, 3);
+			in << bytes(rgb);
+			expected << bytes(resize(Method::AIS, rgb, 2.0f));
+		}
+		CHECK(run_video(in, out, {Method::AIS, 2.0f, {4, 3}, 2}) == 5);
+		CHECK(out.str() == expected.str());
+
+		// A stream that ends inside a frame
+		std::stringstream truncated(in.str() + "rgb");
+		std::stringstream discarded;
+		CHECK_THROWS(run_video(
+		  truncated, discarded, {Method::bilinear, 2.0f, {4, 3}, 2}));
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include "resize.hpp"
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+struct VideoOptions final {
+	Method       method;
+	float        scale;
+	Dimensions   rawSize; // of headerless RGB frames; 0x0 for YUV4MPEG2
+	unsigned int framesInFlight;
+};
+
+// One plane of a frame: interleaved channels, one sample per subsampling
+// pixels of the frame along each axis
+struct PlaneFormat final {
+	unsigned int channels;
+	unsigned int xSubsampling;
+	unsigned int ySubsampling;
+};
+
+// How a stream lays out its frames
+struct StreamFormat final {
+	bool                     y4m;
+	Dimensions               size;
+	std::vector<PlaneFormat> planes;
+	std::string              tags; // y4m header tags but W and H, space-led
+};
+
+// Parses "WIDTHxHEIGHT"
+Dimensions parse_frame_size(const std::string& text);
+
+// Reads the header of a YUV4MPEG2 stream. 8-bit 4:2:0, 4:2:2, 4:4:4 and
+// monochrome streams are supported; without a C tag a stream is 4:2:0.
+StreamFormat read_y4m_header(std::istream& in);
+
+// Frames of packed RGB and nothing else
+StreamFormat raw_rgb_format(const Dimensions& size);
+
+// The size of plane in a frame of frame's size, rounding up
+Dimensions plane_size(const Dimensions& frame, const PlaneFormat& plane);
+
+// Resizes every frame read from in, y4m or raw RGB as options say, and writes
+// them to out in order in the same format. Reading, resizing and writing run
+// on threads of their own, with framesInFlight frames resized at once, each
+// over the global pool, and none more than framesInFlight ahead of the next
+// to write. Frames come from and return to the BufferPool, so a stream stops
+// allocating after its first few frames. Returns how many frames were
+// written; a stream that ends inside a frame is an error.
+std::size_t
+run_video(std::istream& in, std::ostream& out, const VideoOptions& options);
+
+#endif